@@ -0,0 +1,293 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/stm32/can.h>
+#include "canrx.h"
+#include "ring.h"
+
+#define STD_MASK	0x7ff
+#define EXT_MASK	0x1fffffff
+
+/*
+ * Filter register layouts. 32 bit: STID[10:0] EXID[17:0] IDE RTR 0.
+ * 16 bit: STID[10:0] RTR IDE EXID[17:15]. The masks always include IDE
+ * and RTR, so a rule only matches data frames of its own format.
+ */
+#define F32_IDE		(1 << 2)
+#define F32_RTR		(1 << 1)
+#define F16_RTR		(1 << 4)
+#define F16_IDE		(1 << 3)
+
+#define F32(id)		((id) << 3)
+#define F16(id)		((id) << 5)
+
+/* Entries per bank, by scale and mode, also how far the FMI moves on */
+#define LIST16		4
+#define MASK16		2
+#define LIST32		2
+#define MASK32		1
+
+struct bank {
+	bool scale32;
+	bool list;
+	uint32_t fifo;
+	uint32_t fr1, fr2;
+};
+
+struct entry {
+	uint32_t id, mask;	/* In filter register layout */
+	uint8_t rule;
+};
+
+/* The entries of one kind for one FIFO while the banks are planned */
+struct pool {
+	struct entry e[CANRX_MAX_RULES];
+	uint32_t n;
+};
+
+static struct bank banks[CANRX_BANKS];
+static uint32_t nbanks;
+/* Rule index by filter match index, per FIFO */
+static uint8_t fmi_rule[2][CANRX_BANKS * LIST16];
+static uint8_t fmi_count[2];
+
+#define QUEUE_FRAMES	16
+static struct ring queue[2];
+static uint8_t queue_buffer[2][QUEUE_FRAMES * sizeof(struct canrx_frame)];
+static struct canrx_stats stats;
+
+/* Does rule a let through everything that rule b does? */
+static bool covers(const struct canrx_rule *a, const struct canrx_rule *b)
+{
+	return (a->flags & (CANRX_EXT | CANRX_HIGH)) ==
+	       (b->flags & (CANRX_EXT | CANRX_HIGH)) &&
+	       !(a->mask & ~b->mask) && !((a->id ^ b->id) & a->mask);
+}
+
+/* Leave out rules covered by another; of two identical ones, the later */
+static bool redundant(const struct canrx_rule *rules, uint32_t n, uint32_t i)
+{
+	uint32_t j;
+
+	for (j = 0; j < n; j++) {
+		if (j != i && covers(&rules[j], &rules[i]) &&
+		    (j < i || !covers(&rules[i], &rules[j]))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int add_bank(bool scale32, bool list, uint32_t fifo,
+		    const struct entry *e, uint32_t count)
+{
+	struct bank *b;
+	uint32_t per = scale32 ? (list ? LIST32 : MASK32) :
+				 (list ? LIST16 : MASK16);
+	uint32_t v[4], i, k;
+
+	if (nbanks == CANRX_BANKS) {
+		return -1;
+	}
+	/* Unused slots repeat the last entry, they map to the same rule */
+	for (i = 0; i < per; i++) {
+		k = i < count ? i : count - 1;
+		fmi_rule[fifo][fmi_count[fifo] + i] = e[k].rule;
+		v[i] = list ? e[k].id : e[k].id | e[k].mask << 16;
+	}
+	fmi_count[fifo] += per;
+
+	b = &banks[nbanks++];
+	b->scale32 = scale32;
+	b->list = list;
+	b->fifo = fifo;
+	if (scale32 && list) {
+		b->fr1 = e[0].id;
+		b->fr2 = e[count - 1].id;
+	} else if (scale32) {
+		b->fr1 = e[0].id;
+		b->fr2 = e[0].mask;
+	} else if (list) {
+		b->fr1 = v[0] | v[1] << 16;
+		b->fr2 = v[2] | v[3] << 16;
+	} else {
+		b->fr1 = v[0];
+		b->fr2 = v[1];
+	}
+	return 0;
+}
+
+/* count entries of one kind, per to a bank */
+static int add_banks(bool scale32, bool list, uint32_t fifo,
+		     const struct entry *e, uint32_t count)
+{
+	uint32_t per = scale32 ? (list ? LIST32 : MASK32) :
+				 (list ? LIST16 : MASK16);
+	uint32_t i;
+
+	for (i = 0; i < count; i += per) {
+		if (add_bank(scale32, list, fifo, &e[i],
+			     count - i < per ? count - i : per)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int plan_fifo(const struct canrx_rule *rules, uint32_t n,
+		     uint32_t fifo)
+{
+	static struct pool std_list, std_mask, ext_list, ext_mask;
+	const struct canrx_rule *r;
+	struct entry *e;
+	uint32_t i, left, id, mask;
+
+	std_list.n = std_mask.n = ext_list.n = ext_mask.n = 0;
+	for (i = 0; i < n; i++) {
+		r = &rules[i];
+		if ((r->flags & CANRX_HIGH ? 0 : 1) != fifo ||
+		    redundant(rules, n, i)) {
+			continue;
+		}
+		if (r->flags & CANRX_EXT) {
+			mask = r->mask & EXT_MASK;
+			id = F32(r->id & mask) | F32_IDE;
+			e = mask == EXT_MASK ? &ext_list.e[ext_list.n++] :
+					       &ext_mask.e[ext_mask.n++];
+			e->mask = F32(mask) | F32_IDE | F32_RTR;
+		} else {
+			mask = r->mask & STD_MASK;
+			id = F16(r->id & mask);
+			e = mask == STD_MASK ? &std_list.e[std_list.n++] :
+					       &std_mask.e[std_mask.n++];
+			e->mask = F16(mask) | F16_IDE | F16_RTR;
+		}
+		e->id = id;
+		e->rule = i;
+	}
+
+	/*
+	 * Single standard IDs go four to a list bank. The ones left over for
+	 * a last, partly used list bank move to the mask banks instead, as
+	 * masks with every bit set, if that takes fewer banks: a single ID
+	 * and a mask bank with a spare slot.
+	 */
+	left = std_list.n % LIST16;
+	if (left && (std_mask.n + left + MASK16 - 1) / MASK16 <
+		    (std_mask.n + MASK16 - 1) / MASK16 + 1) {
+		std_list.n -= left;
+		memcpy(&std_mask.e[std_mask.n], &std_list.e[std_list.n],
+		       left * sizeof(struct entry));
+		std_mask.n += left;
+	}
+
+	if (add_banks(true, true, fifo, ext_list.e, ext_list.n) ||
+	    add_banks(true, false, fifo, ext_mask.e, ext_mask.n) ||
+	    add_banks(false, true, fifo, std_list.e, std_list.n) ||
+	    add_banks(false, false, fifo, std_mask.e, std_mask.n)) {
+		return -1;
+	}
+	return 0;
+}
+
+int canrx_setup(const struct canrx_rule *rules, uint32_t n)
+{
+	uint32_t i;
+
+	if (n > CANRX_MAX_RULES) {
+		return -1;
+	}
+	/*
+	 * The FIFO0 banks come first. When a frame matches rules in both
+	 * FIFOs the hardware prefers 32 bit banks to 16 bit ones, list mode
+	 * to mask mode, and then the lower bank number.
+	 */
+	nbanks = 0;
+	fmi_count[0] = fmi_count[1] = 0;
+	if (plan_fifo(rules, n, 0) || plan_fifo(rules, n, 1)) {
+		return -1;
+	}
+
+	for (i = 0; i < CANRX_BANKS; i++) {
+		if (i < nbanks) {
+			can_filter_init(i, banks[i].scale32, banks[i].list,
+					banks[i].fr1, banks[i].fr2,
+					banks[i].fifo, true);
+		} else {
+			can_filter_init(i, false, false, 0, 0, 0, false);
+		}
+	}
+
+	ring_init(&queue[0], queue_buffer[0], sizeof(queue_buffer[0]));
+	ring_init(&queue[1], queue_buffer[1], sizeof(queue_buffer[1]));
+	return nbanks;
+}
+
+/*
+ * Whatever is in the hardware FIFO is read in one go, at most three
+ * frames, so an interrupt driven FIFO costs one interrupt per burst.
+ */
+uint32_t canrx_poll(uint32_t fifo)
+{
+	/* RF1R has the same layout as RF0R */
+	volatile uint32_t *rfr = fifo ? &CAN_RF1R(CAN1) : &CAN_RF0R(CAN1);
+	struct canrx_frame f;
+	uint32_t count = 0;
+	bool ext, rtr;
+	uint8_t fmi;
+
+	if (*rfr & CAN_RF0R_FOVR0) {
+		*rfr = CAN_RF0R_FOVR0;
+		stats.overruns[fifo]++;
+	}
+	while (*rfr & CAN_RF0R_FMP0_MASK) {
+		can_receive(CAN1, fifo, true, &f.id, &ext, &rtr, &fmi,
+			    &f.len, f.data, NULL);
+		f.flags = (ext ? CANRX_FRAME_EXT : 0) |
+			  (fifo ? 0 : CANRX_FRAME_HIGH);
+		f.rule = fmi < fmi_count[fifo] ? fmi_rule[fifo][fmi] : 0xff;
+		f.reserved = 0;
+		count++;
+
+		if (ring_free(&queue[fifo]) < sizeof(f)) {
+			stats.dropped[fifo]++;
+			continue;
+		}
+		ring_write(&queue[fifo], &f, sizeof(f));
+	}
+	stats.frames[fifo] += count;
+	return count;
+}
+
+bool canrx_get(struct canrx_frame *frame)
+{
+	if (ring_used(&queue[0])) {
+		ring_read(&queue[0], frame, sizeof(*frame));
+		return true;
+	}
+	if (ring_used(&queue[1])) {
+		ring_read(&queue[1], frame, sizeof(*frame));
+		return true;
+	}
+	return false;
+}
+
+const struct canrx_stats *canrx_get_stats(void)
+{
+	return &stats;
+}
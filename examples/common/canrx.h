@@ -0,0 +1,87 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CANRX_H
+#define __CANRX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CAN1 reception through the bxCAN acceptance filters.
+ *
+ * The application lists the identifiers it wants, as id/mask rules, and
+ * canrx_setup() packs them into as few of the 14 filter banks as it can:
+ * single standard identifiers four to a bank (16 bit list mode), ranges
+ * of standard identifiers two to a bank (16 bit mask mode), single
+ * extended identifiers two to a bank (32 bit list mode) and ranges of
+ * extended identifiers one to a bank (32 bit mask mode). A rule that is
+ * already covered by another one of the same priority is left out.
+ * Everything else on the bus is dropped by the hardware, without costing
+ * the CPU anything.
+ *
+ * High priority rules go to FIFO0, the rest to FIFO1. canrx_poll()
+ * moves the frames of a hardware FIFO into a software queue, one per
+ * FIFO, and can be called from the FIFO's interrupt or from the main
+ * loop; canrx_get() hands out the high priority queue first. Each frame
+ * carries the index of the rule that let it through, looked up from the
+ * filter match index, so it can be dispatched without comparing IDs.
+ *
+ * Rules match data frames only, remote frames are filtered out.
+ */
+
+#define CANRX_BANKS		14
+#define CANRX_MAX_RULES		64
+
+/* Rule flags */
+#define CANRX_EXT		(1 << 0)	/* 29 bit identifier */
+#define CANRX_HIGH		(1 << 1)	/* FIFO0, the high priority queue */
+
+struct canrx_rule {
+	uint32_t id;
+	uint32_t mask;		/* Bits that have to match, ~0 for just id */
+	uint32_t flags;
+};
+
+/* Frame flags */
+#define CANRX_FRAME_EXT		(1 << 0)
+#define CANRX_FRAME_HIGH	(1 << 1)
+
+/* 16 bytes, so a power of two of them fills a ring exactly */
+struct canrx_frame {
+	uint32_t id;
+	uint8_t len;
+	uint8_t flags;
+	uint8_t rule;		/* Index into the rules given to canrx_setup() */
+	uint8_t reserved;
+	uint8_t data[8];
+};
+
+struct canrx_stats {
+	uint32_t frames[2];	/* Per FIFO */
+	uint32_t dropped[2];	/* Software queue full */
+	uint32_t overruns[2];	/* Hardware FIFO overrun, frames lost */
+};
+
+/* Returns the number of filter banks used, or -1 if the rules don't fit */
+int canrx_setup(const struct canrx_rule *rules, uint32_t n);
+/* Empty hardware FIFO 0 or 1 into its queue, returns the frames moved */
+uint32_t canrx_poll(uint32_t fifo);
+bool canrx_get(struct canrx_frame *frame);
+const struct canrx_stats *canrx_get_stats(void);
+
+#endif
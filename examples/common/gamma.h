@@ -0,0 +1,50 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GAMMA_H
+#define __GAMMA_H
+
+#include <stdint.h>
+
+/*
+ * Gamma correction tables, generated by the compiler.
+ *
+ *	static const uint16_t table[256] = { GAMMA_TABLE(2.2, 16) };
+ *
+ * gives Iout = Iin ** gamma for 256 input levels, scaled to an output of
+ * the given number of bits (up to 16). GCC folds __builtin_pow() of
+ * constants, so the table is built at compile time and pow() is never
+ * linked in; any gamma and depth can be had without pasting in numbers.
+ */
+
+#define GAMMA_ENTRY(i, gamma, bits)					\
+	((uint16_t)(__builtin_pow((double)(i) / 255, (gamma)) *	\
+		    ((1ul << (bits)) - 1) + 0.5))
+
+#define GAMMA_1(i, g, b)	GAMMA_ENTRY(i, g, b)
+#define GAMMA_2(i, g, b)	GAMMA_1(i, g, b), GAMMA_1((i) + 1, g, b)
+#define GAMMA_4(i, g, b)	GAMMA_2(i, g, b), GAMMA_2((i) + 2, g, b)
+#define GAMMA_8(i, g, b)	GAMMA_4(i, g, b), GAMMA_4((i) + 4, g, b)
+#define GAMMA_16(i, g, b)	GAMMA_8(i, g, b), GAMMA_8((i) + 8, g, b)
+#define GAMMA_32(i, g, b)	GAMMA_16(i, g, b), GAMMA_16((i) + 16, g, b)
+#define GAMMA_64(i, g, b)	GAMMA_32(i, g, b), GAMMA_32((i) + 32, g, b)
+#define GAMMA_128(i, g, b)	GAMMA_64(i, g, b), GAMMA_64((i) + 64, g, b)
+
+#define GAMMA_TABLE(gamma, bits)					\
+	GAMMA_128(0, gamma, bits), GAMMA_128(128, gamma, bits)
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HOST_BUILD
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#else
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/cm3/itm.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "prof.h"
+
+#define BAR_WIDTH	32
+
+/* What two back to back prof_now() calls take */
+static uint32_t overhead;
+
+#ifdef HOST_BUILD
+uint32_t prof_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+void prof_init(void)
+{
+	uint32_t i, t0, t, min = UINT32_MAX;
+
+#ifndef HOST_BUILD
+	dwt_enable_cycle_counter();
+#endif
+	for (i = 0; i < 16; i++) {
+		t0 = prof_now();
+		t = prof_now() - t0;
+		if (t < min) {
+			min = t;
+		}
+	}
+	overhead = min;
+}
+
+uint32_t prof_hz(void)
+{
+#ifdef HOST_BUILD
+	return 1000000000;
+#else
+	return rcc_ahb_frequency;
+#endif
+}
+
+void prof_record(struct prof_stat *s, uint32_t ticks)
+{
+	uint32_t b;
+
+	ticks = ticks > overhead ? ticks - overhead : 0;
+	s->count++;
+	s->total += ticks;
+	if (ticks < s->min) {
+		s->min = ticks;
+	}
+	if (ticks > s->max) {
+		s->max = ticks;
+	}
+
+	b = ticks ? 32 - __builtin_clz(ticks) : 0;
+	if (b >= PROF_BUCKETS) {
+		b = PROF_BUCKETS - 1;
+	}
+	s->hist[b]++;
+}
+
+void prof_reset(struct prof_stat *s)
+{
+	const char *name = s->name;
+
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	s->min = UINT32_MAX;
+}
+
+/*
+ * Ticks as microseconds with two decimals. There is no 64 bit printf()
+ * in newlib nano, so the parts go out as unsigned long.
+ */
+static const char *fmt_us(char *buf, uint32_t size, uint64_t ticks)
+{
+	uint64_t v = (ticks * 100000000ull + prof_hz() / 2) / prof_hz();
+
+	snprintf(buf, size, "%lu.%02lu", (unsigned long)(v / 100),
+		 (unsigned long)(v % 100));
+	return buf;
+}
+
+static void report_hist(const struct prof_stat *s, prof_puts out)
+{
+	char line[96], lo[16], hi[16];
+	uint32_t first, last, peak = 0, b, n, bar;
+
+	for (first = 0; first < PROF_BUCKETS && !s->hist[first]; first++);
+	for (last = PROF_BUCKETS - 1; last > first && !s->hist[last]; last--);
+	for (b = first; b <= last; b++) {
+		if (s->hist[b] > peak) {
+			peak = s->hist[b];
+		}
+	}
+
+	for (b = first; b <= last; b++) {
+		fmt_us(lo, sizeof(lo), b ? 1ull << (b - 1) : 0);
+		fmt_us(hi, sizeof(hi), b ? 1ull << b : 1);
+		bar = ((uint64_t)s->hist[b] * BAR_WIDTH + peak - 1) / peak;
+		n = snprintf(line, sizeof(line), "  %10s - %-10s %9lu ", lo, hi,
+			     (unsigned long)s->hist[b]);
+		memset(line + n, '#', bar);
+		strcpy(line + n + bar, "\n");
+		out(line);
+	}
+}
+
+void prof_report(struct prof_stat *const *stats, prof_puts out)
+{
+	const struct prof_stat *s;
+	char line[96], min[16], avg[16], max[16];
+
+	snprintf(line, sizeof(line), "%-16s %9s %10s %10s %10s\n", "",
+		 "count", "min us", "avg us", "max us");
+	out(line);
+	for (; *stats; stats++) {
+		s = *stats;
+		if (!s->count) {
+			snprintf(line, sizeof(line), "%-16s %9s\n", s->name,
+				 "0");
+			out(line);
+			continue;
+		}
+		snprintf(line, sizeof(line), "%-16s %9lu %10s %10s %10s\n",
+			 s->name, (unsigned long)s->count,
+			 fmt_us(min, sizeof(min), s->min),
+			 fmt_us(avg, sizeof(avg), s->total / s->count),
+			 fmt_us(max, sizeof(max), s->max));
+		out(line);
+		report_hist(s, out);
+	}
+}
+
+void prof_swo_puts(const char *s)
+{
+#ifdef HOST_BUILD
+	fputs(s, stdout);
+#else
+	if (!(ITM_TCR & ITM_TCR_ITMENA) || !(ITM_TER[0] & 1)) {
+		return;
+	}
+	while (*s) {
+		while (!(ITM_STIM8(0) & ITM_STIM_FIFOREADY));
+		ITM_STIM8(0) = *s++;
+	}
+#endif
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROF_H
+#define __PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#ifndef HOST_BUILD
+#include <libopencm3/cm3/dwt.h>
+#endif
+
+/*
+ * Cycle counting profiler.
+ *
+ * A struct prof_stat collects the count, minimum, maximum and total of
+ * the times recorded into it, and a histogram with a bucket per power
+ * of two. Times come from the DWT cycle counter on the target, and from
+ * clock_gettime() in nanoseconds in a host build, so the same report
+ * comes out of 'make HOST=1'. The cost of taking the two timestamps is
+ * measured by prof_init() and taken off every time recorded.
+ *
+ *	static PROF_STAT(isr_time, "dma isr");
+ *
+ *	PROF_SCOPE(&isr_time) {
+ *		...
+ *	}
+ *
+ * times the block (leaving it by return or goto skips the record), or
+ * prof_now() and prof_record() do the same by hand. A stat must only be
+ * recorded into from one interrupt priority.
+ */
+
+#define PROF_BUCKETS	32
+
+struct prof_stat {
+	const char *name;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	/* hist[0]: 0, hist[n]: 2^(n-1) up to 2^n - 1, the last: the rest */
+	uint32_t hist[PROF_BUCKETS];
+};
+
+#define PROF_STAT(var, label)						\
+	struct prof_stat var = { .name = (label), .min = UINT32_MAX }
+
+#define PROF_SCOPE(stat)						\
+	for (uint32_t prof_t0_ = prof_now(), prof_once_ = 1;		\
+	     prof_once_;						\
+	     prof_once_ = 0, prof_record((stat), prof_now() - prof_t0_))
+
+typedef void (*prof_puts)(const char *s);
+
+#ifdef HOST_BUILD
+uint32_t prof_now(void);
+#else
+static inline uint32_t prof_now(void)
+{
+	return dwt_read_cycle_counter();
+}
+#endif
+
+/* Enables the cycle counter, call after the clock setup */
+void prof_init(void);
+/* Ticks per second: the core clock, or 1e9 on the host */
+uint32_t prof_hz(void);
+void prof_record(struct prof_stat *s, uint32_t ticks);
+void prof_reset(struct prof_stat *s);
+/*
+ * A table of the stats in the NULL terminated list, in microseconds,
+ * and the histogram of each, a line at a time.
+ */
+void prof_report(struct prof_stat *const *stats, prof_puts out);
+/* To ITM stimulus port 0 if a debugger enabled it, to stdout on a host */
+void prof_swo_puts(const char *s);
+
+#endif
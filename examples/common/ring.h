@@ -0,0 +1,163 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Single producer, single consumer ring buffer.
+ *
+ * One side (say an interrupt handler) only ever writes, the other (say
+ * the main loop) only ever reads, and neither needs to disable
+ * interrupts: the producer is the only one to move head, the consumer
+ * the only one to move tail. Both are free running counters, so
+ * head - tail is the number of bytes in the ring even after they wrap,
+ * and all of the size bytes can be used.
+ *
+ * The size must be a power of two, which turns the index wrap into a
+ * mask. ring_write() and ring_read() move as many bytes as fit with at
+ * most two memcpy() calls, one up to the end of the buffer and one
+ * from its start.
+ *
+ * The barrier makes sure the data is in the buffer before the other
+ * side can see the new head (or that it has been copied out before
+ * the slots are handed back by moving tail). On a single Cortex-M core
+ * a compiler barrier would be enough, the DMB keeps it correct on
+ * parts with a write buffer and on the host, where the two sides are
+ * threads on different cores.
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__arm__)
+#define RING_BARRIER()	__asm__ volatile ("dmb" : : : "memory")
+#else
+#define RING_BARRIER()	__sync_synchronize()
+#endif
+
+struct ring {
+	uint8_t *data;
+	uint32_t size;
+	volatile uint32_t head;		/* written by the producer only */
+	volatile uint32_t tail;		/* written by the consumer only */
+};
+
+#define RING_EMPTY(RING) ((RING)->head == (RING)->tail)
+
+static inline void ring_init(struct ring *ring, uint8_t *buf, uint32_t size)
+{
+	ring->data = buf;
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/* Bytes waiting to be read */
+static inline uint32_t ring_used(const struct ring *ring)
+{
+	return ring->head - ring->tail;
+}
+
+/* Bytes that can be written */
+static inline uint32_t ring_free(const struct ring *ring)
+{
+	return ring->size - (ring->head - ring->tail);
+}
+
+/* Write up to len bytes, returns how many were written */
+static inline uint32_t ring_write(struct ring *ring, const void *buf,
+				  uint32_t len)
+{
+	uint32_t head = ring->head;
+	uint32_t off = head & (ring->size - 1);
+	uint32_t n, first;
+
+	n = ring->size - (head - ring->tail);
+	RING_BARRIER();
+	if (len < n) {
+		n = len;
+	}
+	first = ring->size - off;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(ring->data + off, buf, first);
+	memcpy(ring->data, (const uint8_t *)buf + first, n - first);
+	RING_BARRIER();
+	ring->head = head + n;
+	return n;
+}
+
+/* Read up to len bytes, returns how many were read */
+static inline uint32_t ring_read(struct ring *ring, void *buf, uint32_t len)
+{
+	uint32_t tail = ring->tail;
+	uint32_t off = tail & (ring->size - 1);
+	uint32_t n, first;
+
+	n = ring->head - tail;
+	RING_BARRIER();
+	if (len < n) {
+		n = len;
+	}
+	first = ring->size - off;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(buf, ring->data + off, first);
+	memcpy((uint8_t *)buf + first, ring->data, n - first);
+	RING_BARRIER();
+	ring->tail = tail + n;
+	return n;
+}
+
+/* Write one byte, returns it or -1 if the ring is full */
+static inline int32_t ring_write_ch(struct ring *ring, uint8_t ch)
+{
+	uint32_t head = ring->head;
+
+	if (head - ring->tail == ring->size) {
+		return -1;
+	}
+	RING_BARRIER();
+	ring->data[head & (ring->size - 1)] = ch;
+	RING_BARRIER();
+	ring->head = head + 1;
+	return ch;
+}
+
+/* Read one byte, returns it or -1 if the ring is empty */
+static inline int32_t ring_read_ch(struct ring *ring, uint8_t *ch)
+{
+	uint32_t tail = ring->tail;
+	uint8_t c;
+
+	if (tail == ring->head) {
+		return -1;
+	}
+	RING_BARRIER();
+	c = ring->data[tail & (ring->size - 1)];
+	RING_BARRIER();
+	ring->tail = tail + 1;
+	if (ch) {
+		*ch = c;
+	}
+	return c;
+}
+
+#endif
@@ -0,0 +1,31 @@
+##
+## This file is part of the libopencm3 project.
+##
+## This library is free software: you can redistribute it and/or modify
+## it under the terms of the GNU Lesser General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## This library is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU Lesser General Public License for more details.
+##
+## You should have received a copy of the GNU Lesser General Public License
+## along with this library.  If not, see <http://www.gnu.org/licenses/>.
+##
+
+# Read alongside a libopencm3 per-family library Makefile (lib/stm32/f4/Makefile
+# and friends) to print the absolute paths of the C sources that make up that
+# family's library, resolved through the Makefile's own VPATH. rules.mk uses
+# this to compile the library natively for 'make HOST=1'.
+
+HOST_EXCLUDE	?=
+HOST_SRCDIRS	:= . $(subst :, ,$(VPATH))
+
+host-libsrcs:
+	@echo $(foreach o,$(filter-out $(HOST_EXCLUDE),$(OBJS)),\
+		$(abspath $(firstword $(wildcard \
+			$(addsuffix /$(o:.o=.c),$(HOST_SRCDIRS))))))
+
+.PHONY: host-libsrcs
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory backed register space for 'make HOST=1' builds.
+ *
+ * libopencm3 accesses every peripheral through MMIO32() and friends, which
+ * are plain volatile dereferences of fixed addresses. On a Linux host we
+ * simply map anonymous memory at those same addresses before main() runs,
+ * so the example and the library code execute unmodified: writes land in
+ * memory, reads return whatever was last written.
+ *
+ * A handful of status bits that the setup code busy-waits on (oscillator
+ * ready, clock switch status, USART/SPI transmit empty) are preset, so
+ * that typical clock_setup()/usart_setup() sequences fall through instead
+ * of spinning forever. Anything that waits for a real event (a received
+ * byte, a DMA completion, an interrupt) will of course still wait.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <libopencm3/cm3/common.h>
+#if defined(STM32F1) || defined(STM32F2) || defined(STM32F4)
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/spi.h>
+#endif
+
+struct host_region {
+	uintptr_t base;
+	size_t size;
+	uint8_t fill;		/* reset content, 0xff for erased flash */
+	const char *name;
+};
+
+static const struct host_region regions[] = {
+	{ 0x08000000, 0x00200000, 0xff, "flash" },
+	{ 0x1fff0000, 0x00010000, 0xff, "system memory / option bytes" },
+	{ 0x40000000, 0x20000000, 0x00, "peripherals" },
+	{ 0xa0000000, 0x00001000, 0x00, "FSMC/FMC registers" },
+	{ 0xc0000000, 0x20000000, 0x00, "external memory" },
+	{ 0xe0000000, 0x00100000, 0x00, "private peripheral bus" },
+	{ 0, 0, 0, NULL }
+};
+
+static void host_map_region(const struct host_region *r)
+{
+	void *want = (void *)r->base;
+	void *got;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+#ifdef MAP_FIXED_NOREPLACE
+	flags |= MAP_FIXED_NOREPLACE;
+#endif
+	got = mmap(want, r->size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (got != want) {
+		fprintf(stderr, "host: cannot map %s at 0x%08lx\n",
+			r->name, (unsigned long)r->base);
+		exit(1);
+	}
+	if (r->fill) {
+		memset(got, r->fill, r->size);
+	}
+}
+
+#if defined(STM32F1) || defined(STM32F2) || defined(STM32F4)
+static void host_seed_usart(uint32_t usart)
+{
+	USART_SR(usart) = USART_SR_TXE | USART_SR_TC;
+}
+
+/* spi_xfer() waits for RXNE after each byte, the "reply" is the byte sent */
+static void host_seed_spi(uint32_t spi)
+{
+	SPI_SR(spi) = SPI_SR_TXE | SPI_SR_RXNE;
+}
+
+static void host_seed_stm32(void)
+{
+	/* Every oscillator and PLL reports ready as soon as it is asked. */
+	RCC_CR = RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY;
+#if defined(STM32F4)
+	RCC_CR |= RCC_CR_PLLI2SRDY | RCC_CR_PLLSAIRDY;
+#endif
+	/*
+	 * SWS = PLL. rcc_set_sysclk_source() only touches the SW field, so
+	 * the wait for the switch to the PLL completes immediately.
+	 */
+	RCC_CFGR = 0x2 << 2;
+
+	host_seed_usart(USART1);
+	host_seed_usart(USART2);
+#ifdef USART3
+	host_seed_usart(USART3);
+#endif
+#ifdef UART4
+	host_seed_usart(UART4);
+	host_seed_usart(UART5);
+#endif
+#ifdef USART6
+	host_seed_usart(USART6);
+#endif
+#ifdef UART7
+	host_seed_usart(UART7);
+	host_seed_usart(UART8);
+#endif
+
+	host_seed_spi(SPI1);
+	host_seed_spi(SPI2);
+#ifdef SPI3
+	host_seed_spi(SPI3);
+#endif
+#ifdef SPI4
+	host_seed_spi(SPI4);
+#endif
+#ifdef SPI5
+	host_seed_spi(SPI5);
+	host_seed_spi(SPI6);
+#endif
+}
+#endif
+
+/*
+ * Examples may override this to preset further registers for their own
+ * peripherals; it is called after the default seeding.
+ */
+void host_board_setup(void) __attribute__((weak));
+void host_board_setup(void)
+{
+}
+
+void host_mmio_init(void) __attribute__((constructor));
+void host_mmio_init(void)
+{
+	const struct host_region *r;
+
+	for (r = regions; r->size; r++) {
+		host_map_region(r);
+	}
+
+#if defined(STM32F1) || defined(STM32F2) || defined(STM32F4)
+	host_seed_stm32();
+#endif
+	host_board_setup();
+}
@@ -19,6 +19,9 @@
 ## along with this library.  If not, see <http://www.gnu.org/licenses/>.
 ##
 
+# Directory of this file, used to locate the host build support files.
+EXAMPLES_DIR	:= $(dir $(lastword $(MAKEFILE_LIST)))
+
 # Be silent per default, but 'make V=1' will show all compiler calls.
 ifneq ($(V),1)
 Q		:= @
@@ -119,6 +122,10 @@ TGT_CXXFLAGS	+= -fno-common -ffunction-sections -fdata-sections
 TGT_CPPFLAGS	+= -MD
 TGT_CPPFLAGS	+= -Wall -Wundef
 TGT_CPPFLAGS	+= $(DEFS)
+# Code shared by several examples: headers like ring.h, and sources that
+# an example builds by naming them in OBJS, like canrx.o
+TGT_CPPFLAGS	+= -I$(abspath $(EXAMPLES_DIR)common)
+vpath %.c $(abspath $(EXAMPLES_DIR)common)
 
 ###############################################################################
 # Linker flags
@@ -137,6 +144,44 @@ endif
 
 LDLIBS		+= -Wl,--start-group -lc -lgcc -lnosys -Wl,--end-group
 
+###############################################################################
+# Host build
+#
+# 'make HOST=1' builds $(BINARY).host with the native compiler instead of
+# the cross toolchain, together with a native build of the libopencm3
+# sources for the family. The peripheral address space is backed by plain
+# memory (see host/mmio.c), so the example runs unmodified and its compute
+# loops can be profiled with perf, valgrind or gprof on a Linux box. Code
+# that waits on a real hardware event will wait forever.
+
+HOST_OBJDIR	?= host-build
+
+ifeq ($(HOST),1)
+HOST_CC		?= gcc
+CC		:= $(HOST_CC)
+LD		:= $(HOST_CC)
+ARCH_FLAGS	:=
+DEFS		+= -DHOST_BUILD
+# Register addresses are 32 bit integers, pointers are not.
+TGT_CFLAGS	+= -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast
+
+HOST_DIR	:= $(abspath $(EXAMPLES_DIR)host)
+HOST_LIBDIR	?= $(OPENCM3_DIR)/lib/$(patsubst opencm3_%,%,$(patsubst opencm3_stm32%,stm32/%,$(LIBNAME)))
+# The vector table and the ldrex/strex helpers are target only.
+HOST_EXCLUDE	?= vector.o sync.o
+HOST_LIBSRCS	:= $(shell $(MAKE) -s --no-print-directory -C $(HOST_LIBDIR) \
+			-f Makefile -f $(HOST_DIR)/libsrcs.mk host-libsrcs \
+			HOST_EXCLUDE="$(HOST_EXCLUDE)")
+
+HOST_OBJS	:= $(OBJS:%.o=$(HOST_OBJDIR)/%.o) $(HOST_OBJDIR)/mmio.o
+HOST_OBJS	+= $(patsubst %.c,$(HOST_OBJDIR)/opencm3/%.o,$(notdir $(HOST_LIBSRCS)))
+
+HOST_LDFLAGS	+= $(DEBUG)
+HOST_LDLIBS	:= $(filter-out -l$(LIBNAME) -lnosys,$(LDLIBS))
+
+vpath %.c $(sort $(dir $(HOST_LIBSRCS)))
+endif
+
 ###############################################################################
 ###############################################################################
 ###############################################################################
@@ -145,7 +190,11 @@ LDLIBS		+= -Wl,--start-group -lc -lgcc -lnosys -Wl,--end-group
 .SECONDEXPANSION:
 .SECONDARY:
 
+ifeq ($(HOST),1)
+all: host
+else
 all: elf
+endif
 
 elf: $(BINARY).elf
 bin: $(BINARY).bin
@@ -156,6 +205,7 @@ GENERATED_BINARIES=$(BINARY).elf $(BINARY).bin $(BINARY).hex $(BINARY).srec $(BI
 
 images: $(BINARY).images
 flash: $(BINARY).flash
+host: $(BINARY).host
 
 # Either verify the user provided LDSCRIPT exists, or generate it.
 ifeq ($(strip $(DEVICE)),)
@@ -203,9 +253,28 @@ print-%:
 	@#printf "  LD      $(*).elf\n"
 	$(Q)$(LD) $(TGT_LDFLAGS) $(LDFLAGS) $(OBJS) $(LDLIBS) -o $(*).elf
 
+%.host: $(HOST_OBJS)
+	@#printf "  LD      $(*).host\n"
+	$(Q)$(LD) $(HOST_LDFLAGS) $(HOST_OBJS) $(HOST_LDLIBS) -o $(*).host
+
+$(HOST_OBJDIR)/%.o: %.c
+	@#printf "  HOSTCC  $(*).c\n"
+	@mkdir -p $(dir $@)
+	$(Q)$(CC) $(TGT_CFLAGS) $(CFLAGS) $(TGT_CPPFLAGS) $(CPPFLAGS) -o $@ -c $<
+
+$(HOST_OBJDIR)/opencm3/%.o: %.c
+	@#printf "  HOSTCC  $(*).c\n"
+	@mkdir -p $(dir $@)
+	$(Q)$(CC) $(TGT_CFLAGS) $(CFLAGS) $(TGT_CPPFLAGS) $(CPPFLAGS) -o $@ -c $<
+
+$(HOST_OBJDIR)/mmio.o: $(HOST_DIR)/mmio.c
+	@#printf "  HOSTCC  mmio.c\n"
+	@mkdir -p $(dir $@)
+	$(Q)$(CC) $(TGT_CFLAGS) $(CFLAGS) $(TGT_CPPFLAGS) $(CPPFLAGS) -o $@ -c $<
+
 %.o: %.c
 	@#printf "  CC      $(*).c\n"
-	$(Q)$(CC) $(TGT_CFLAGS) $(CFLAGS) $(TGT_CPPFLAGS) $(CPPFLAGS) -o $(*).o -c $(*).c
+	$(Q)$(CC) $(TGT_CFLAGS) $(CFLAGS) $(TGT_CPPFLAGS) $(CPPFLAGS) -o $(*).o -c $<
 
 %.o: %.cxx
 	@#printf "  CXX     $(*).cxx\n"
@@ -218,6 +287,7 @@ print-%:
 clean:
 	@#printf "  CLEAN\n"
 	$(Q)$(RM) $(GENERATED_BINARIES) generated.* $(OBJS) $(OBJS:%.o=%.d)
+	$(Q)$(RM) -r $(BINARY).host $(HOST_OBJDIR)
 
 stylecheck: $(STYLECHECKFILES:=.stylecheck)
 styleclean: $(STYLECHECKFILES:=.styleclean)
@@ -265,6 +335,9 @@ else
 		   $(*).elf
 endif
 
-.PHONY: images clean stylecheck styleclean elf bin hex srec list
+.PHONY: images clean stylecheck styleclean elf bin hex srec list host
 
 -include $(OBJS:.o=.d)
+ifeq ($(HOST),1)
+-include $(HOST_OBJS:.o=.d)
+endif
@@ -26,6 +26,7 @@
 #include <libopencm3/stm32/spi.h>
 #include <stdio.h>
 #include <errno.h>
+#include "prof.h"
 
 #ifndef USE_16BIT_TRANSFERS
 #define USE_16BIT_TRANSFERS 0
@@ -57,6 +58,17 @@ uint16_t dummy_tx_buf = 0xdd;
 uint8_t dummy_tx_buf = 0xdd;
 #endif
 
+/* Transfers between two profile reports, one round of the counters */
+#define REPORT_TRANSFERS 64
+
+static PROF_STAT(prof_rx_isr, "rx dma isr");
+static PROF_STAT(prof_tx_isr, "tx dma isr");
+static PROF_STAT(prof_transceive, "transceive");
+
+static struct prof_stat *const prof_stats[] = {
+	&prof_rx_isr, &prof_tx_isr, &prof_transceive, NULL
+};
+
 int _write(int file, char *ptr, int len);
 
 static void clock_setup(void)
@@ -277,6 +289,8 @@ static int spi_dma_transceive(uint8_t *tx_buf, int tx_len, uint8_t *rx_buf, int
 /* SPI receive completed with DMA */
 void dma1_channel2_isr(void)
 {
+	uint32_t t0 = prof_now();
+
 	gpio_set(GPIOA,GPIO4);
 	if ((DMA1_ISR &DMA_ISR_TCIF2) != 0) {
 		DMA1_IFCR |= DMA_IFCR_CTCIF2;
@@ -291,11 +305,14 @@ void dma1_channel2_isr(void)
 	/* Increment the status to indicate one of the transfers is complete */
 	transceive_status++;
 	gpio_clear(GPIOA,GPIO4);
+	prof_record(&prof_rx_isr, prof_now() - t0);
 }
 
 /* SPI transmit completed with DMA */
 void dma1_channel3_isr(void)
 {
+	uint32_t t0 = prof_now();
+
 	gpio_set(GPIOB,GPIO1);
 	if ((DMA1_ISR &DMA_ISR_TCIF3) != 0) {
 		DMA1_IFCR |= DMA_IFCR_CTCIF3;
@@ -337,6 +354,7 @@ void dma1_channel3_isr(void)
 	}
 
 	gpio_clear(GPIOB,GPIO1);
+	prof_record(&prof_tx_isr, prof_now() - t0);
 }
 
 static void usart_setup(void)
@@ -373,6 +391,16 @@ int _write(int file, char *ptr, int len)
 	return -1;
 }
 
+static void report_puts(const char *s)
+{
+	while (*s) {
+		if (*s == '\n') {
+			putchar('\r');
+		}
+		putchar(*s++);
+	}
+}
+
 static void gpio_setup(void)
 {
 	/* Set GPIO8 (in GPIO port A) to 'output push-pull'. */
@@ -397,6 +425,8 @@ int main(void)
 	cnt_state counter_state = TX_UP_RX_HOLD;
 
 	int i = 0;
+	int transfers = 0;
+	uint32_t t0;
 
 	/* Transmit and Receive packets, set transmit to index and receive to known unused value to aid in debugging */
 #if USE_16BIT_TRANSFERS
@@ -414,6 +444,7 @@ int main(void)
 	usart_setup();
 	spi_setup();
 	dma_setup();
+	prof_init();
 
 	printf("SPI with DMA Transfer Test (Use loopback)\r\n\r\n");
 
@@ -431,6 +462,7 @@ int main(void)
 		printf("\r\n");
 
 		/* Start a transceive */
+		t0 = prof_now();
 		if (spi_dma_transceive(tx_packet, counter_tx, rx_packet, counter_rx)) {
 			printf("Attempted 0 length tx and rx packets\r\n");
 		}
@@ -446,6 +478,7 @@ int main(void)
 			;
 		while (SPI_SR(SPI1) & SPI_SR_BSY)
 			;
+		prof_record(&prof_transceive, prof_now() - t0);
 
 		/* Print what was received on the SPI bus */
 		printf("Received Packet (rx len %02i):", counter_rx);
@@ -454,6 +487,15 @@ int main(void)
 		}
 		printf("\r\n\r\n");
 
+		/* Report the ISR and transfer times now and then */
+		if (++transfers % REPORT_TRANSFERS == 0) {
+			prof_report(prof_stats, report_puts);
+			printf("\r\n");
+			for (i = 0; prof_stats[i]; i++) {
+				prof_reset(prof_stats[i]);
+			}
+		}
+
 		/* Update counters
 		 * If we use the loopback method, we can not
 		 * have a rx length longer than the tx length.
@@ -22,6 +22,12 @@
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "ring.h"
+
+int _write(int file, char *ptr, int len);
 
 static void clock_setup(void)
 {
@@ -64,9 +70,48 @@ static void usart_setup(void)
 	nvic_set_priority(NVIC_DMA1_CHANNEL6_IRQ, 0);
 	nvic_enable_irq(NVIC_DMA1_CHANNEL6_IRQ);
 
+	/* Same priority as channel 6, see rx_dma_poll() */
+	nvic_set_priority(NVIC_USART2_IRQ, 0);
+	nvic_enable_irq(NVIC_USART2_IRQ);
+
 }
 
-static void dma_write(char *data, int size)
+/*
+ * Transmit.
+ *
+ * Data to send is copied into tx_pool, and every piece of it is
+ * described by an entry in the tx_desc queue. Channel 7 (USART2_TX)
+ * works through the queue on its own: the transfer complete
+ * interrupt releases the piece just sent and starts the next one, so
+ * back to back writes go out without a gap and nobody has to wait for
+ * or poll a transfer. A writer only waits when the pool or the queue
+ * is full.
+ *
+ * The pool is used like a ring, a piece that does not fit before its
+ * end is split in two descriptors. Both the pool and the queue have a
+ * single producer (tx_write()) and a single consumer (the interrupt),
+ * each side only moves its own counter.
+ */
+#define TX_POOL_SIZE	1024		/* Power of two */
+#define TX_DESC_COUNT	16		/* Power of two */
+
+struct tx_desc {
+	const uint8_t *data;
+	uint16_t len;
+};
+
+static uint8_t tx_pool[TX_POOL_SIZE];
+static volatile uint32_t tx_pool_head, tx_pool_tail;
+
+static struct tx_desc tx_desc[TX_DESC_COUNT];
+static volatile uint32_t tx_desc_head, tx_desc_tail;
+
+static volatile int tx_busy;
+
+/* Deepest the queue and fullest the pool have been */
+static uint32_t tx_desc_hwm, tx_pool_hwm;
+
+static void dma_write_setup(void)
 {
 	/*
 	 * Using channel 7 for USART2_TX
@@ -76,8 +121,6 @@ static void dma_write(char *data, int size)
 	dma_channel_reset(DMA1, DMA_CHANNEL7);
 
 	dma_set_peripheral_address(DMA1, DMA_CHANNEL7, (uint32_t)&USART2_DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL7, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL7, size);
 	dma_set_read_from_memory(DMA1, DMA_CHANNEL7);
 	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL7);
 	dma_set_peripheral_size(DMA1, DMA_CHANNEL7, DMA_CCR_PSIZE_8BIT);
@@ -86,29 +129,131 @@ static void dma_write(char *data, int size)
 
 	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL7);
 
-	dma_enable_channel(DMA1, DMA_CHANNEL7);
-
-        usart_enable_tx_dma(USART2);
+	usart_enable_tx_dma(USART2);
 }
 
-volatile int transfered = 0;
+/* Start the descriptor at the tail of the queue, the channel is idle */
+static void dma_write_next(void)
+{
+	const struct tx_desc *d = &tx_desc[tx_desc_tail & (TX_DESC_COUNT - 1)];
+
+	dma_set_memory_address(DMA1, DMA_CHANNEL7, (uint32_t)d->data);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL7, d->len);
+	dma_enable_channel(DMA1, DMA_CHANNEL7);
+}
 
 void dma1_channel7_isr(void)
 {
-	if ((DMA1_ISR &DMA_ISR_TCIF7) != 0) {
-		DMA1_IFCR |= DMA_IFCR_CTCIF7;
+	if ((DMA1_ISR & DMA_ISR_TCIF7) == 0) {
+		return;
+	}
+	DMA1_IFCR |= DMA_IFCR_CTCIF7;
+	dma_disable_channel(DMA1, DMA_CHANNEL7);
+
+	/* Give the piece just sent back to the pool */
+	tx_pool_tail += tx_desc[tx_desc_tail & (TX_DESC_COUNT - 1)].len;
+	tx_desc_tail++;
 
-		transfered = 1;
+	if (tx_desc_tail != tx_desc_head) {
+		dma_write_next();
+	} else {
+		tx_busy = 0;
 	}
+}
 
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL7);
+/* Queue one contiguous piece of the pool, waits for a free descriptor */
+static void tx_queue(const uint8_t *data, uint32_t len)
+{
+	struct tx_desc *d;
+	uint32_t depth;
+
+	while (tx_desc_head - tx_desc_tail == TX_DESC_COUNT);
+	d = &tx_desc[tx_desc_head & (TX_DESC_COUNT - 1)];
+	d->data = data;
+	d->len = len;
+	RING_BARRIER();
+	tx_desc_head++;
+
+	depth = tx_desc_head - tx_desc_tail;
+	if (depth > tx_desc_hwm) {
+		tx_desc_hwm = depth;
+	}
+
+	/*
+	 * The interrupt clears tx_busy when it finds the queue empty, so
+	 * check and start with it masked or the new entry could be
+	 * stranded.
+	 */
+	nvic_disable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+	if (!tx_busy) {
+		tx_busy = 1;
+		dma_write_next();
+	}
+	nvic_enable_irq(NVIC_DMA1_CHANNEL7_IRQ);
+}
 
-	usart_disable_tx_dma(USART2);
+/* Copy data into the pool and queue it for sending */
+static void tx_write(const uint8_t *data, uint32_t len)
+{
+	uint32_t off, n, used;
+
+	while (len) {
+		/* wait for room, at most up to the end of the pool */
+		do {
+			used = tx_pool_head - tx_pool_tail;
+			off = tx_pool_head & (TX_POOL_SIZE - 1);
+			n = TX_POOL_SIZE - used;
+		} while (n == 0);
+		if (n > TX_POOL_SIZE - off) {
+			n = TX_POOL_SIZE - off;
+		}
+		if (n > len) {
+			n = len;
+		}
 
-	dma_disable_channel(DMA1, DMA_CHANNEL7);
+		memcpy(&tx_pool[off], data, n);
+		RING_BARRIER();
+		tx_pool_head += n;
+		if (used + n > tx_pool_hwm) {
+			tx_pool_hwm = used + n;
+		}
+		tx_queue(&tx_pool[off], n);
+		data += n;
+		len -= n;
+	}
 }
 
-static void dma_read(char *data, int size)
+int _write(int file, char *ptr, int len)
+{
+	if (file == 1) {
+		tx_write((const uint8_t *)ptr, len);
+		return len;
+	}
+
+	errno = EIO;
+	return -1;
+}
+
+/*
+ * Receive.
+ *
+ * Channel 6 (USART2_RX) runs in circular mode over rx_dma_buf and is
+ * never stopped, so no byte can slip through between two transfers.
+ * Whatever has arrived is handed to rx_chunk() when the DMA is half
+ * way through or at the end of the buffer, and when the USART sees
+ * the line go idle after a frame; this way frames of any length come
+ * out promptly without an interrupt for every byte. The buffer only
+ * has to hold what arrives in one half of it plus the interrupt
+ * latency, 128 bytes are 1.4ms at 921600 baud.
+ */
+#define RX_DMA_SIZE	256
+
+static uint8_t rx_dma_buf[RX_DMA_SIZE];
+static uint32_t rx_dma_pos;		/* first byte not yet handed on */
+
+static void rx_chunk(const uint8_t *data, uint32_t len);
+
+static void dma_read_start(void)
 {
 	/*
 	 * Using channel 6 for USART2_RX
@@ -118,36 +263,72 @@ static void dma_read(char *data, int size)
 	dma_channel_reset(DMA1, DMA_CHANNEL6);
 
 	dma_set_peripheral_address(DMA1, DMA_CHANNEL6, (uint32_t)&USART2_DR);
-	dma_set_memory_address(DMA1, DMA_CHANNEL6, (uint32_t)data);
-	dma_set_number_of_data(DMA1, DMA_CHANNEL6, size);
+	dma_set_memory_address(DMA1, DMA_CHANNEL6, (uint32_t)rx_dma_buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL6, RX_DMA_SIZE);
 	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL6);
 	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL6);
+	dma_enable_circular_mode(DMA1, DMA_CHANNEL6);
 	dma_set_peripheral_size(DMA1, DMA_CHANNEL6, DMA_CCR_PSIZE_8BIT);
 	dma_set_memory_size(DMA1, DMA_CHANNEL6, DMA_CCR_MSIZE_8BIT);
 	dma_set_priority(DMA1, DMA_CHANNEL6, DMA_CCR_PL_HIGH);
 
+	dma_enable_half_transfer_interrupt(DMA1, DMA_CHANNEL6);
 	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL6);
 
+	rx_dma_pos = 0;
 	dma_enable_channel(DMA1, DMA_CHANNEL6);
 
-        usart_enable_rx_dma(USART2);
+	usart_enable_rx_dma(USART2);
+
+	/* Interrupt when the line goes idle for one frame after a byte. */
+	USART_CR1(USART2) |= USART_CR1_IDLEIE;
 }
 
-volatile int received = 0;
+/*
+ * Hand everything the DMA wrote since the last call to rx_chunk(), in
+ * two pieces if it wrapped around the end of the buffer. Called from
+ * the DMA and the USART interrupt, which have the same priority and
+ * so never run this at the same time.
+ */
+static void rx_dma_poll(void)
+{
+	uint32_t pos = RX_DMA_SIZE - DMA_CNDTR(DMA1, DMA_CHANNEL6);
+
+	if (pos == rx_dma_pos) {
+		return;
+	}
+	if (pos > rx_dma_pos) {
+		rx_chunk(&rx_dma_buf[rx_dma_pos], pos - rx_dma_pos);
+	} else {
+		rx_chunk(&rx_dma_buf[rx_dma_pos], RX_DMA_SIZE - rx_dma_pos);
+		if (pos > 0) {
+			rx_chunk(&rx_dma_buf[0], pos);
+		}
+	}
+	rx_dma_pos = (pos == RX_DMA_SIZE) ? 0 : pos;
+}
 
 void dma1_channel6_isr(void)
 {
-	if ((DMA1_ISR &DMA_ISR_TCIF6) != 0) {
+	if ((DMA1_ISR & DMA_ISR_HTIF6) != 0) {
+		DMA1_IFCR |= DMA_IFCR_CHTIF6;
+	}
+	if ((DMA1_ISR & DMA_ISR_TCIF6) != 0) {
 		DMA1_IFCR |= DMA_IFCR_CTCIF6;
-
-		received = 1;
 	}
+	rx_dma_poll();
+}
 
-	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL6);
-
-	usart_disable_rx_dma(USART2);
-
-	dma_disable_channel(DMA1, DMA_CHANNEL6);
+void usart2_isr(void)
+{
+	if ((USART_SR(USART2) & USART_SR_IDLE) != 0) {
+		/*
+		 * IDLE is cleared by reading SR and then DR. The data
+		 * itself has already been taken by the DMA.
+		 */
+		(void)USART_DR(USART2);
+		rx_dma_poll();
+	}
 }
 
 static void gpio_setup(void)
@@ -157,41 +338,50 @@ static void gpio_setup(void)
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO8);
 }
 
+/*
+ * The example echoes whatever it receives, and answers '?' with the
+ * high water marks of the transmit queue. rx_chunk() runs in interrupt
+ * context and only queues the data, the main loop sends it back.
+ */
+#define ECHO_SIZE	512		/* Power of two, see ring.h */
+
+static uint8_t echo_buf[ECHO_SIZE];
+static struct ring echo_ring = { echo_buf, ECHO_SIZE, 0, 0 };
+
+static void rx_chunk(const uint8_t *data, uint32_t len)
+{
+	/* If the main loop falls behind, the excess is dropped. */
+	(void)ring_write(&echo_ring, data, len);
+}
+
 int main(void)
 {
-	char tx[10] = "abcdefg\r\n";
-	int tx_len = 10;
-	char rx[7] = "bcdefg";
-	int rx_len = 6;
+	uint8_t rx[64];
+	uint32_t i, len;
 
 	clock_setup();
 	gpio_setup();
 	usart_setup();
 
-	transfered = 0;
-	dma_write(tx, tx_len);
-	received = 0;
-	dma_read(rx, rx_len);
+	dma_write_setup();
+	dma_read_start();
 
-	/* Blink the LED (PA8) on the board with every transmitted byte. */
 	while (1) {
-		gpio_toggle(GPIOA, GPIO8);	/* LED on/off */
-		while ( transfered != 1) {
-			if (received == 1) {
-				tx[1] = rx[0];
-				tx[2] = rx[1];
-				tx[3] = rx[2];
-				tx[4] = rx[3];
-				tx[5] = rx[4];
-				tx[6] = rx[5];
-				received = 0;
-				dma_read(rx, rx_len);
+		len = ring_read(&echo_ring, rx, sizeof(rx));
+		if (len == 0) {
+			continue;
+		}
+		/* Toggle the LED (PA8) with every chunk echoed. */
+		gpio_toggle(GPIOA, GPIO8);
+		tx_write(rx, len);
+		for (i = 0; i < len; i++) {
+			if (rx[i] == '?') {
+				printf("\r\ntx queue high water: %u of %u "
+				       "descriptors, %u of %u bytes\r\n",
+				       (unsigned)tx_desc_hwm, TX_DESC_COUNT,
+				       (unsigned)tx_pool_hwm, TX_POOL_SIZE);
 			}
 		}
-		tx[0]++;
-		if (tx[0] > 'z') tx[0] = 'a';
-		transfered = 0;
-		dma_write(tx, tx_len);
 	}
 
 	return 0;
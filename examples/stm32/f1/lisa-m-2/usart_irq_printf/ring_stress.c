@@ -0,0 +1,155 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stress test of ring.h, built by 'make HOST=1'.
+ *
+ * A producer thread and the main thread (the consumer) run the ring
+ * from two cores, the way an interrupt handler and the main loop share
+ * it on the target, only with real concurrency. The producer writes a
+ * byte stream in chunks of 1 to 97 bytes, every eighth chunk a byte at
+ * a time with ring_write_ch(); the consumer reads chunks of 1 to 61
+ * bytes, every fifth one with ring_read_ch(). Each byte is a hash of its
+ * position in the stream, so a lost, repeated or torn byte shows up
+ * even where the position wraps in the ring. Both sides also give up
+ * the CPU every few chunks: on a single core the threads would
+ * otherwise take turns filling and emptying the whole ring, and never
+ * copy across its end.
+ *
+ * This is run for a few ring sizes, and the throughput printed.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include "ring.h"
+
+#define STREAM_BYTES	(1u << 26)
+#define MAX_RING	4096
+
+static uint8_t ring_buffer[MAX_RING];
+static struct ring ring;
+static uint32_t errors;
+
+static uint8_t stream_byte(uint32_t pos)
+{
+	return (pos * 2654435761u) >> 24;
+}
+
+static void *producer(void *arg)
+{
+	uint8_t chunk[97];
+	uint32_t sent = 0, k = 0, i, n;
+
+	(void)arg;
+	while (sent < STREAM_BYTES) {
+		n = 1 + k % sizeof(chunk);
+		if (n > STREAM_BYTES - sent) {
+			n = STREAM_BYTES - sent;
+		}
+		if (k++ % 8 == 0) {
+			for (i = 0; i < n; i++) {
+				while (ring_write_ch(&ring,
+						     stream_byte(sent)) < 0) {
+					sched_yield();
+				}
+				sent++;
+			}
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			chunk[i] = stream_byte(sent + i);
+		}
+		for (i = 0; i < n; i += ring_write(&ring, chunk + i, n - i)) {
+			if (!ring_free(&ring)) {
+				sched_yield();
+			}
+		}
+		sent += n;
+		if (k % 7 == 0) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void consume(void)
+{
+	uint8_t chunk[61];
+	uint32_t got = 0, k = 0, i, n;
+
+	while (got < STREAM_BYTES) {
+		if (k++ % 5 == 0) {
+			n = ring_read_ch(&ring, chunk) < 0 ? 0 : 1;
+		} else {
+			n = ring_read(&ring, chunk, 1 + k % sizeof(chunk));
+		}
+		if (!n) {
+			sched_yield();
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			if (chunk[i] != stream_byte(got + i) && !errors++) {
+				printf("byte %u is 0x%02x, should be 0x%02x\n",
+				       got + i, chunk[i], stream_byte(got + i));
+			}
+		}
+		got += n;
+		if (k % 6 == 0) {
+			sched_yield();
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+	pthread_t thread;
+	uint32_t size;
+	double t;
+
+	printf("%-10s %10s %10s\n", "ring size", "MB", "MB/s");
+	for (size = 64; size <= MAX_RING; size *= 4) {
+		ring_init(&ring, ring_buffer, size);
+		t = now();
+		if (pthread_create(&thread, NULL, producer, NULL)) {
+			printf("cannot start the producer\n");
+			return 1;
+		}
+		consume();
+		pthread_join(thread, NULL);
+		t = now() - t;
+		printf("%-10u %10.1f %10.1f\n", size, STREAM_BYTES / 1e6,
+		       STREAM_BYTES / 1e6 / t);
+		if (!RING_EMPTY(&ring)) {
+			printf("bytes left in the ring\n");
+			errors++;
+		}
+	}
+
+	printf("%s\n", errors ? "FAILED" : "every byte came out once, in order");
+	return errors ? 1 : 0;
+}
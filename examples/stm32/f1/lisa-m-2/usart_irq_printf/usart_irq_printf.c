@@ -25,91 +25,20 @@
 #include <libopencm3/cm3/systick.h>
 #include <stdio.h>
 #include <errno.h>
-
-/******************************************************************************
- * Simple ringbuffer implementation from open-bldc's libgovernor that
- * you can find at:
- * https://github.com/open-bldc/open-bldc/tree/master/source/libgovernor
- *****************************************************************************/
-
-typedef int32_t ring_size_t;
-
-struct ring {
-	uint8_t *data;
-	ring_size_t size;
-	uint32_t begin;
-	uint32_t end;
-};
-
-#define RING_SIZE(RING)  ((RING)->size - 1)
-#define RING_DATA(RING)  (RING)->data
-#define RING_EMPTY(RING) ((RING)->begin == (RING)->end)
+#include "ring.h"
 
 int _write(int file, char *ptr, int len);
 
-static void ring_init(struct ring *ring, uint8_t *buf, ring_size_t size)
-{
-	ring->data = buf;
-	ring->size = size;
-	ring->begin = 0;
-	ring->end = 0;
-}
-
-static int32_t ring_write_ch(struct ring *ring, uint8_t ch)
-{
-	if (((ring->end + 1) % ring->size) != ring->begin) {
-		ring->data[ring->end++] = ch;
-		ring->end %= ring->size;
-		return (uint32_t)ch;
-	}
-
-	return -1;
-}
-
-static int32_t ring_write(struct ring *ring, uint8_t *data, ring_size_t size)
-{
-	int32_t i;
-
-	for (i = 0; i < size; i++) {
-		if (ring_write_ch(ring, data[i]) < 0)
-			return -i;
-	}
-
-	return i;
-}
-
-static int32_t ring_read_ch(struct ring *ring, uint8_t *ch)
-{
-	int32_t ret = -1;
-
-	if (ring->begin != ring->end) {
-		ret = ring->data[ring->begin++];
-		ring->begin %= ring->size;
-		if (ch)
-			*ch = ret;
-	}
-
-	return ret;
-}
-
-/* Not used!
-static int32_t ring_read(struct ring *ring, uint8_t *data, ring_size_t size)
-{
-	int32_t i;
-
-	for (i = 0; i < size; i++) {
-		if (ring_read_ch(ring, data + i) < 0)
-			return i;
-	}
-
-	return -i;
-}
-*/
-
 /******************************************************************************
  * The example implementation
  *****************************************************************************/
 
+/*
+ * Power of two, see ring.h. Both the USART interrupt (echo) and the
+ * SysTick handler (printf) write into the ring; they run at the same
+ * priority and never preempt each other, so there is only ever one
+ * producer at a time, and the TXE interrupt is the consumer.
+ */
 #define BUFFER_SIZE 1024
 
 struct ring output_ring;
@@ -206,10 +135,7 @@ int _write(int file, char *ptr, int len)
 	int ret;
 
 	if (file == 1) {
-		ret = ring_write(&output_ring, (uint8_t *)ptr, len);
-
-		if (ret < 0)
-			ret = -ret;
+		ret = ring_write(&output_ring, ptr, len);
 
 		USART_CR1(USART2) |= USART_CR1_TXEIE;
 
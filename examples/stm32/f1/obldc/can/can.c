@@ -25,6 +25,7 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/flash.h>
 #include <libopencm3/stm32/rcc.h>
+#include "canrx.h"
 
 struct can_tx_msg {
 	uint32_t std_id;
@@ -48,6 +49,26 @@ struct can_rx_msg {
 struct can_tx_msg can_tx_msg;
 struct can_rx_msg can_rx_msg;
 
+/*
+ * What this board listens to, everything else is dropped by the filters.
+ * ID 0 drives the LEDs and goes through FIFO0 and its interrupt, the rest
+ * is only counted and is picked up by polling FIFO1 from the main loop.
+ */
+enum {
+	RULE_LEDS,
+	RULE_STATUS,
+	RULE_J1939,
+	RULES
+};
+
+static const struct canrx_rule rules[] = {
+	[RULE_LEDS] = { 0x000, ~0u, CANRX_HIGH },
+	[RULE_STATUS] = { 0x100, 0x700, 0 },		/* 0x100 - 0x1ff */
+	[RULE_J1939] = { 0x18ff0000, 0x1fff0000, CANRX_EXT },
+};
+
+static uint32_t rule_frames[RULES];
+
 static void gpio_setup(void)
 {
 	/* Enable GPIOA clock. */
@@ -137,15 +158,10 @@ static void can_setup(void)
 			__asm__("nop");
 	}
 
-	/* CAN filter 0 init. */
-	can_filter_id_mask_32bit_init(
-				0,     /* Filter ID */
-				0,     /* CAN ID */
-				0,     /* CAN ID mask */
-				0,     /* FIFO assignment (here: FIFO0) */
-				true); /* Enable the filter. */
+	/* Pack the rules into the filter banks. */
+	canrx_setup(rules, sizeof(rules) / sizeof(rules[0]));
 
-	/* Enable CAN RX interrupt. */
+	/* Enable CAN RX interrupt, for FIFO0 only. */
 	can_enable_irq(CAN1, CAN_IER_FMPIE0);
 }
 
@@ -178,33 +194,30 @@ void sys_tick_handler(void)
 
 void usb_lp_can_rx0_isr(void)
 {
-	uint32_t id;
-	bool ext, rtr;
-	uint8_t fmi, length, data[8];
-
-	can_receive(CAN1, 0, false, &id, &ext, &rtr, &fmi, &length, data, NULL);
+	canrx_poll(0);
+}
 
-	if (data[0] & 1)
+static void leds(uint8_t data)
+{
+	if (data & 1)
 		gpio_clear(GPIOA, GPIO6);
 	else
 		gpio_set(GPIOA, GPIO6);
 
-	if (data[0] & 2)
+	if (data & 2)
 		gpio_clear(GPIOA, GPIO7);
 	else
 		gpio_set(GPIOA, GPIO7);
 
-	if (data[0] & 4)
+	if (data & 4)
 		gpio_clear(GPIOB, GPIO0);
 	else
 		gpio_set(GPIOB, GPIO0);
 
-	if (data[0] & 8)
+	if (data & 8)
 		gpio_clear(GPIOB, GPIO1);
 	else
 		gpio_set(GPIOB, GPIO1);
-
-	can_fifo_release(CAN1, 0);
 }
 
 int main(void)
@@ -214,7 +227,17 @@ int main(void)
 	can_setup();
 	systick_setup();
 
-	while (1); /* Halt. */
+	while (1) {
+		struct canrx_frame frame;
+
+		canrx_poll(1);
+		while (canrx_get(&frame)) {
+			if (frame.rule == RULE_LEDS)
+				leds(frame.data[0]);
+			if (frame.rule < RULES)
+				rule_frames[frame.rule]++;
+		}
+	}
 
 	return 0;
 }
@@ -17,11 +17,30 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
 #include "./dogm128.h"
 
 uint8_t dogm128_ram[1024];
 uint8_t dogm128_cursor_x;
 uint8_t dogm128_cursor_y;
+struct dogm128_stats dogm128_stats;
+
+struct span {
+	uint8_t first, last;	/* Columns, first > last if none */
+};
+
+/* Changed since the last update */
+static struct span dirty[8];
+/* Taken from dirty[] when an update starts, what the DMA works through */
+static struct span flush[8];
+static uint8_t flush_page;
+static uint8_t flush_cmd[3];
+static const uint8_t *flush_data;
+static uint16_t flush_len;
+static uint8_t rx_sink;
+static volatile bool busy;
 
 void dogm128_send_command(uint8_t command)
 {
@@ -82,6 +101,15 @@ void dogm128_init(void)
 
 	/* End transfer. */
 	spi_set_nss_high(DOGM128_SPI);
+
+	/* SPI2 TX is on DMA1 channel 5, RX on channel 4. */
+	rcc_periph_clock_enable(RCC_DMA1);
+	spi_enable_tx_dma(DOGM128_SPI);
+	spi_enable_rx_dma(DOGM128_SPI);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL4_IRQ);
+
+	/* Whatever the display shows now, it is not dogm128_ram. */
+	dogm128_invalidate();
 }
 
 void dogm128_print_char(uint8_t data)
@@ -102,6 +130,10 @@ void dogm128_print_char(uint8_t data)
 			return;
 		dogm128_cursor_x++;
 
+		dogm128_mark_dirty(page, xcoord + i, xcoord + i);
+		if ((shift > 0) && (page > 0))
+			dogm128_mark_dirty(page - 1, xcoord + i, xcoord + i);
+
 		/* 0xAA = end of character - no dots in this line. */
 		if (dogm128_font[data - 0x20][i] == 0xAA) {
 			dogm128_ram[(page * 128) + xcoord + i] &=
@@ -142,35 +174,172 @@ void dogm128_print_string(char *s)
 	}
 }
 
+/* Only a dot that really changes makes its column dirty. */
+static void dogm128_write_dot(uint8_t xcoord, uint8_t ycoord, bool on)
+{
+	uint8_t page = (63 - ycoord) / 8;
+	uint8_t *p = &dogm128_ram[(page * 128) + xcoord];
+	uint8_t v;
+
+	if (on)
+		v = *p | (1 << ((63 - ycoord) % 8));
+	else
+		v = *p & ~(1 << ((63 - ycoord) % 8));
+
+	if (v != *p) {
+		*p = v;
+		dogm128_mark_dirty(page, xcoord, xcoord);
+	}
+}
+
 void dogm128_set_dot(uint8_t xcoord, uint8_t ycoord)
 {
-	dogm128_ram[(((63 - ycoord) / 8) * 128) + xcoord] |=
-		(1 << ((63 - ycoord) % 8));
+	dogm128_write_dot(xcoord, ycoord, true);
 }
 
 void dogm128_clear_dot(uint8_t xcoord, uint8_t ycoord)
 {
-	dogm128_ram[(((63 - ycoord) / 8) * 128) + xcoord] &=
-		~(1 << ((63 - ycoord) % 8));
+	dogm128_write_dot(xcoord, ycoord, false);
+}
+
+void dogm128_mark_dirty(uint8_t page, uint8_t first, uint8_t last)
+{
+	if (dirty[page].first > dirty[page].last) {
+		dirty[page].first = first;
+		dirty[page].last = last;
+		return;
+	}
+	if (first < dirty[page].first)
+		dirty[page].first = first;
+	if (last > dirty[page].last)
+		dirty[page].last = last;
+}
+
+void dogm128_invalidate(void)
+{
+	uint8_t page;
+
+	for (page = 0; page <= 7; page++)
+		dogm128_mark_dirty(page, 0, 127);
+}
+
+/*
+ * Send len bytes from buf. The RX channel only counts them in, its
+ * transfer complete interrupt comes once the last one is on the wire.
+ */
+static void dogm128_dma_start(const uint8_t *buf, uint16_t len)
+{
+	dma_channel_reset(DMA1, DMA_CHANNEL4);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL4,
+				   (uint32_t)&SPI_DR(DOGM128_SPI));
+	dma_set_memory_address(DMA1, DMA_CHANNEL4, (uint32_t)&rx_sink);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL4, len);
+	dma_set_read_from_peripheral(DMA1, DMA_CHANNEL4);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL4, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL4, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL4, DMA_CCR_PL_VERY_HIGH);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL4);
+	dma_enable_channel(DMA1, DMA_CHANNEL4);
+
+	dma_channel_reset(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL5,
+				   (uint32_t)&SPI_DR(DOGM128_SPI));
+	dma_set_memory_address(DMA1, DMA_CHANNEL5, (uint32_t)buf);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL5, len);
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL5);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_HIGH);
+	dma_enable_channel(DMA1, DMA_CHANNEL5);
+}
+
+/*
+ * Each page in flush[] goes out as the three commands that address its
+ * first column, with A0 low, then its columns, with A0 high.
+ */
+static void dogm128_flush_next(void)
+{
+	uint8_t page, first;
+
+	if (flush_len) {
+		/* A0 high for data */
+		gpio_set(DOGM128_A0_PORT, DOGM128_A0_PIN);
+		dogm128_dma_start(flush_data, flush_len);
+		flush_len = 0;
+		return;
+	}
+
+	for (page = flush_page; page <= 7; page++)
+		if (flush[page].first <= flush[page].last)
+			break;
+	if (page > 7) {
+		spi_set_nss_high(DOGM128_SPI);
+		busy = false;
+		return;
+	}
+
+	first = flush[page].first;
+	flush_page = page + 1;
+	flush_data = &dogm128_ram[(page * 128) + first];
+	flush_len = flush[page].last - first + 1;
+
+	flush_cmd[0] = DOGM128_PAGE_BASE + page;
+	flush_cmd[1] = 0x10 | (first >> 4); /* Column upper address. */
+	flush_cmd[2] = first & 0x0F; /* Column lower address. */
+	gpio_clear(DOGM128_A0_PORT, DOGM128_A0_PIN); /* A0 low for commands */
+	dogm128_dma_start(flush_cmd, sizeof(flush_cmd));
+
+	dogm128_stats.pages++;
+	dogm128_stats.bytes += sizeof(flush_cmd) + flush_len;
 }
 
 void dogm128_update_display(void)
 {
-	uint8_t page, column;
+	uint8_t page;
+	bool any = false;
+
+	/* Drawing can go on while this runs; it just makes pages dirty again. */
+	while (busy);
+
+	for (page = 0; page <= 7; page++) {
+		flush[page] = dirty[page];
+		dirty[page].first = 1;
+		dirty[page].last = 0;
+		if (flush[page].first <= flush[page].last)
+			any = true;
+	}
+	dogm128_stats.updates++;
+	if (!any)
+		return;
+
+	/* Drop what the polled commands left in the receiver, and OVR. */
+	(void)SPI_DR(DOGM128_SPI);
+	(void)SPI_SR(DOGM128_SPI);
+
+	busy = true;
+	flush_page = 0;
+	flush_len = 0;
 
 	/* Tell the display that we want to start. */
 	spi_set_nss_low(DOGM128_SPI);
+	dogm128_flush_next();
+}
 
-	for (page = 0; page <= 7; page++) {
-		dogm128_send_command(0xB0 + page); /* Set page. */
-		dogm128_send_command(0x10); /* Set column upper address to 0. */
-		dogm128_send_command(0x00); /* Set column lower address to 0. */
+bool dogm128_busy(void)
+{
+	return busy;
+}
 
-		for (column = 0; column <= 127; column++)
-			dogm128_send_data(dogm128_ram[(page * 128) + column]);
-	}
+/* The last byte of a command or data run has been clocked out. */
+void dma1_channel4_isr(void)
+{
+	if ((DMA1_ISR & DMA_ISR_TCIF4) != 0)
+		DMA1_IFCR |= DMA_IFCR_CTCIF4;
 
-	spi_set_nss_high(DOGM128_SPI);
+	dma_disable_channel(DMA1, DMA_CHANNEL4);
+	dma_disable_channel(DMA1, DMA_CHANNEL5);
+	dogm128_flush_next();
 }
 
 void dogm128_clear(void)
@@ -180,6 +349,7 @@ void dogm128_clear(void)
 	for (i = 0; i <= 1023; i++)
 		dogm128_ram[i] = 0;
 
+	dogm128_invalidate();
 	dogm128_update_display();
 }
 
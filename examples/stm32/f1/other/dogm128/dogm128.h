@@ -69,10 +69,30 @@
 #define DOGM128_STATIC_INDICATOR_ON		0xAD
 #define DOGM128_BOOSTER_RATIO_SET		0xF8
 
+/*
+ * The drawing functions only change dogm128_ram and note which columns of
+ * which pages they changed. dogm128_update_display() then sends just those
+ * spans, a page at a time by DMA on SPI2 TX (DMA1 channel 5), and returns
+ * at once; the DMA interrupt steps through the pages. Code that writes to
+ * dogm128_ram directly has to call dogm128_mark_dirty() for what it
+ * touched, or dogm128_invalidate() to have the whole display sent again.
+ *
+ * The end of each page goes by SPI2 RX on DMA1 channel 4: a received
+ * byte is one that has been fully clocked out, so that is when A0 may
+ * change for the next one. The received bytes themselves are dropped.
+ */
+
+struct dogm128_stats {
+	uint32_t updates;
+	uint32_t pages;		/* Page spans sent */
+	uint32_t bytes;		/* Commands and data, as clocked out */
+};
+
 extern const uint8_t dogm128_font[96][6];
 extern uint8_t dogm128_ram[1024];
 extern uint8_t dogm128_cursor_x;
 extern uint8_t dogm128_cursor_y;
+extern struct dogm128_stats dogm128_stats;
 
 void dogm128_send_command(uint8_t command);
 void dogm128_set_cursor(uint8_t xcoord, uint8_t ycoord);
@@ -82,7 +102,10 @@ void dogm128_set_dot(uint8_t xcoord, uint8_t ycoord);
 void dogm128_clear_dot(uint8_t xcoord, uint8_t ycoord);
 void dogm128_send_data(uint8_t data);
 void dogm128_init(void);
+void dogm128_mark_dirty(uint8_t page, uint8_t first, uint8_t last);
+void dogm128_invalidate(void);
 void dogm128_update_display(void);
+bool dogm128_busy(void);
 void dogm128_clear(void);
 
 #endif
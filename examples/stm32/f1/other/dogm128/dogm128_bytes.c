@@ -0,0 +1,234 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test of the DOGM128 update traffic, built by 'make HOST=1'.
+ *
+ * There is no DMA on the host, so this stands in for it: each time the
+ * driver has set up a run of bytes, they are taken from the channel 5
+ * registers and played into a model of the display controller RAM, and
+ * the channel 4 interrupt is raised by hand. After every update the model
+ * has to match dogm128_ram, which catches any change that was not marked
+ * dirty. The bytes sent per update are counted for a few typical screens
+ * and set against the 8 * (3 + 128) that every update used to cost.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include "./dogm128.h"
+
+#define FULL_UPDATE	(8 * (3 + 128))
+
+static uint8_t lcd[1024];
+static uint8_t lcd_page, lcd_column;
+static uint32_t bytes, updates;
+static int errors;
+
+/*
+ * The register only holds the low 32 bits of the address. Both the
+ * command buffer and dogm128_ram are in the driver's bss, so the rest
+ * is the same as for dogm128_ram.
+ */
+static const uint8_t *dma_buffer(uint32_t cmar)
+{
+	uintptr_t high = (uintptr_t)dogm128_ram & ~(uintptr_t)0xffffffff;
+
+	return (const uint8_t *)(high | cmar);
+}
+
+static void lcd_command(uint8_t c)
+{
+	if ((c & 0xF0) == DOGM128_PAGE_BASE)
+		lcd_page = c & 0x07;
+	else if ((c & 0xF0) == 0x10)
+		lcd_column = (lcd_column & 0x0F) | (c & 0x0F) << 4;
+	else if ((c & 0xF0) == 0x00)
+		lcd_column = (lcd_column & 0xF0) | c;
+}
+
+static void dma_complete(void)
+{
+	uint32_t cmar = DMA_CMAR(DMA1, DMA_CHANNEL5);
+	uint32_t n = DMA_CNDTR(DMA1, DMA_CHANNEL5);
+	uint32_t offset = cmar - (uint32_t)(uintptr_t)dogm128_ram;
+	const uint8_t *p = dma_buffer(cmar);
+
+	if (DMA_CNDTR(DMA1, DMA_CHANNEL4) != n) {
+		printf("RX counts %u bytes, TX sends %u\n",
+		       DMA_CNDTR(DMA1, DMA_CHANNEL4), n);
+		errors++;
+	}
+	bytes += n;
+	while (n--) {
+		if (offset < sizeof(dogm128_ram)) {
+			/* Past column 131 the controller stops counting. */
+			lcd[lcd_page * 128 + (lcd_column & 127)] = *p++;
+			lcd_column++;
+		} else {
+			lcd_command(*p++);
+		}
+	}
+
+	DMA_ISR(DMA1) |= DMA_ISR_TCIF4;
+	dma1_channel4_isr();
+	DMA_ISR(DMA1) = 0;
+}
+
+/* Let the update that was started run to the end, then check it */
+static void finish(void)
+{
+	uint32_t i;
+
+	while (dogm128_busy())
+		dma_complete();
+	updates++;
+
+	for (i = 0; i < sizeof(lcd); i++) {
+		if (lcd[i] != dogm128_ram[i]) {
+			printf("update %u: page %u column %u not sent\n",
+			       updates, i / 128, i % 128);
+			errors++;
+			return;
+		}
+	}
+}
+
+static void update(void)
+{
+	dogm128_update_display();
+	finish();
+}
+
+static void clear(void)
+{
+	dogm128_clear();
+	finish();
+}
+
+static void report(const char *name)
+{
+	printf("%-10s %8u %8u %10.1f %9.1f%%\n", name, updates, bytes,
+	       (double)bytes / updates,
+	       100.0 * bytes / ((double)updates * FULL_UPDATE));
+	if (bytes != dogm128_stats.bytes) {
+		printf("driver counted %u bytes\n", dogm128_stats.bytes);
+		errors++;
+	}
+	bytes = 0;
+	updates = 0;
+	memset(&dogm128_stats, 0, sizeof(dogm128_stats));
+}
+
+/* The screen of main.c */
+static void text(void)
+{
+	dogm128_set_cursor(0, 56);
+	dogm128_print_string("ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+	dogm128_set_cursor(0, 48);
+	dogm128_print_string("abcdefghijklmnopqrstuvwxyz");
+	dogm128_set_cursor(0, 40);
+	dogm128_print_string(" !#$%&'()*+,-./0123456789");
+	dogm128_set_cursor(0, 32);
+	dogm128_print_string(":;<=>?@[\\]^_`{|}~");
+	update();
+}
+
+/* A status line: a counter in the corner, updated each time it changes */
+static void counter(void)
+{
+	char s[8];
+	uint32_t i;
+
+	for (i = 0; i < 1000; i++) {
+		snprintf(s, sizeof(s), "%5u", i * 37);
+		dogm128_set_cursor(96, 7);
+		dogm128_print_string(s);
+		update();
+	}
+}
+
+/*
+ * A plotter: a triangle wave drawn one point at a time over the last
+ * sweep, the screen updated after every point.
+ */
+static void plot(void)
+{
+	uint8_t y[128];
+	uint32_t i, x, t;
+
+	memset(y, 0, sizeof(y));
+	for (i = 0; i < 1024; i++) {
+		x = i % 128;
+		t = (i * 3 + i / 128 * 7) % 96;
+		dogm128_clear_dot(x, y[x]);
+		y[x] = t < 48 ? t + 8 : 104 - t;
+		dogm128_set_dot(x, y[x]);
+		update();
+	}
+}
+
+/* Scattered dots, 16 per update */
+static void scatter(void)
+{
+	uint32_t seed = 1, i, j;
+	uint8_t x, y;
+
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 16; j++) {
+			seed = seed * 1103515245 + 12345;
+			x = seed >> 8 & 127;
+			y = seed >> 16 & 63;
+			if (seed & 0x80000000)
+				dogm128_set_dot(x, y);
+			else
+				dogm128_clear_dot(x, y);
+		}
+		update();
+	}
+}
+
+int main(void)
+{
+	/* Something the first update has to overwrite everywhere */
+	memset(lcd, 0x55, sizeof(lcd));
+
+	dogm128_init();
+	memset(&dogm128_stats, 0, sizeof(dogm128_stats));
+
+	printf("%-10s %8s %8s %10s %10s\n", "workload", "updates", "bytes",
+	       "per update", "of full");
+	clear();
+	report("clear");
+	text();
+	report("text");
+	counter();
+	report("counter");
+	update();
+	report("idle");
+	clear();
+	report("clear");
+	plot();
+	report("plot");
+	scatter();
+	report("scatter");
+
+	printf("%s\n", errors ? "FAILED" : "display RAM matches after every "
+	       "update");
+	return errors ? 1 : 0;
+}
@@ -105,6 +105,7 @@ int main(void)
 	dogm128_set_dot(50, 10);
 
 	dogm128_update_display();
+	while (dogm128_busy()); /* The DMA sends it in the background. */
 
 	gpio_set(GPIOB, GPIO7); /* LED1 off */
 	while (1); /* Halt. */
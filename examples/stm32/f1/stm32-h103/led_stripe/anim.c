@@ -0,0 +1,206 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "anim.h"
+#include "gamma.h"
+
+static const uint16_t gamma_table[256] = { GAMMA_TABLE(ANIM_GAMMA, 16) };
+
+/* x / 255, rounded, for x up to 65535 */
+static inline uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+struct anim_rgb anim_hsv(uint32_t hue, uint8_t sat, uint8_t val)
+{
+	struct anim_rgb c;
+	uint32_t sector = (hue >> 8) % 6, f = hue & 0xff;
+	uint8_t p, q, t;
+
+	p = div255(val * (255 - sat));
+	q = div255(val * (255 - div255(sat * f)));
+	t = div255(val * (255 - div255(sat * (255 - f))));
+
+	switch (sector) {
+	case 0:
+		c.r = val;
+		c.g = t;
+		c.b = p;
+		break;
+	case 1:
+		c.r = q;
+		c.g = val;
+		c.b = p;
+		break;
+	case 2:
+		c.r = p;
+		c.g = val;
+		c.b = t;
+		break;
+	case 3:
+		c.r = p;
+		c.g = q;
+		c.b = val;
+		break;
+	case 4:
+		c.r = t;
+		c.g = p;
+		c.b = val;
+		break;
+	default:
+		c.r = val;
+		c.g = p;
+		c.b = q;
+		break;
+	}
+	return c;
+}
+
+/* Up and down between 0 and max, period frames long */
+static uint32_t triangle(uint32_t frame, uint32_t period, uint32_t max)
+{
+	uint32_t x = frame % period;
+
+	if (x >= period / 2) {
+		x = period - x;
+	}
+	return x * max * 2 / period;
+}
+
+/* A red, a green and a blue LED going round, as the example always did */
+static void chase(struct anim_rgb *px, uint32_t count, uint32_t frame)
+{
+	uint32_t i;
+
+	memset(px, 0, count * sizeof(*px));
+	for (i = 0; i < 3 && i < count; i++) {
+		px[(i + frame) % count] = anim_hsv(i * 512, 255, 255);
+	}
+}
+
+static void rainbow(struct anim_rgb *px, uint32_t count, uint32_t frame)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		px[i] = anim_hsv(i * 1536 / count + frame * 8, 255, 255);
+	}
+}
+
+/* A scanner going back and forth with a fading tail */
+static void scanner(struct anim_rgb *px, uint32_t count, uint32_t frame)
+{
+	uint32_t head = triangle(frame, 2 * count, count - 1), i, d;
+
+	for (i = 0; i < count; i++) {
+		d = i > head ? i - head : head - i;
+		px[i] = anim_hsv(0, 255, d < 8 ? 255 >> d : 0);
+	}
+}
+
+/* A slow, dim breathing, where the dithering has the most to do */
+static void breathe(struct anim_rgb *px, uint32_t count, uint32_t frame)
+{
+	struct anim_rgb c = anim_hsv(1024 + triangle(frame, 1000, 256), 192,
+				     triangle(frame, 240, 96));
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		px[i] = c;
+	}
+}
+
+const struct anim_effect anim_effects[] = {
+	{ "chase", chase },
+	{ "rainbow", rainbow },
+	{ "scanner", scanner },
+	{ "breathe", breathe },
+};
+const uint32_t anim_neffects = sizeof(anim_effects) / sizeof(anim_effects[0]);
+
+int anim_init(struct anim *a, uint32_t count, uint32_t depth)
+{
+	uint32_t max = (1 << depth) - 1, i;
+
+	if (!count || count > ANIM_MAX_LEDS || !depth || depth > 8) {
+		return -1;
+	}
+	memset(a, 0, sizeof(*a));
+	a->count = count;
+	a->depth = depth;
+	a->effect = &anim_effects[0];
+
+	/* Full scale comes out at exactly max steps, with no fraction */
+	for (i = 0; i < 256; i++) {
+		a->level[i] = (gamma_table[i] * max + 255) >> 8;
+	}
+	/*
+	 * Start the LEDs at different points of the dithering cycle, so
+	 * that neighbours showing the same level don't step together.
+	 */
+	for (i = 0; i < count; i++) {
+		a->residue[i][0] = i * 97;
+		a->residue[i][1] = i * 97 + 85;
+		a->residue[i][2] = i * 97 + 170;
+	}
+
+	a->stats.render.name = "render";
+	a->stats.output.name = "output";
+	a->stats.frame.name = "frame";
+	prof_reset(&a->stats.render);
+	prof_reset(&a->stats.output);
+	prof_reset(&a->stats.frame);
+	return 0;
+}
+
+void anim_set_effect(struct anim *a, const struct anim_effect *effect)
+{
+	a->effect = effect;
+	a->frame = 0;
+}
+
+void anim_frame(struct anim *a, anim_output out)
+{
+	const uint32_t shift = 8 - a->depth;
+	uint32_t t0, t1, t2, i, r, g, b;
+	uint8_t *res;
+
+	t0 = prof_now();
+	a->effect->render(a->px, a->count, a->frame);
+	t1 = prof_now();
+
+	/* The residue is what was cut off last time, in 1/256 steps */
+	for (i = 0; i < a->count; i++) {
+		res = a->residue[i];
+		r = a->level[a->px[i].r] + res[0];
+		g = a->level[a->px[i].g] + res[1];
+		b = a->level[a->px[i].b] + res[2];
+		res[0] = r;
+		res[1] = g;
+		res[2] = b;
+		out(i, (r >> 8) << shift, (g >> 8) << shift, (b >> 8) << shift);
+	}
+	t2 = prof_now();
+
+	a->frame++;
+	prof_record(&a->stats.render, t1 - t0);
+	prof_record(&a->stats.output, t2 - t1);
+	prof_record(&a->stats.frame, t2 - t0);
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ANIM_H
+#define __ANIM_H
+
+#include <stdint.h>
+#include "prof.h"
+
+/*
+ * Frame based LED strip animation.
+ *
+ * Every frame, the effect draws the strip in 8 bit RGB as the eye sees
+ * it, from nothing but the frame number, so a given frame always comes
+ * out the same. The output stage then takes each colour through a 2.5
+ * gamma table to 16 bits of light and down to the depth of the strip
+ * with temporal dithering: what is cut off is carried over to the next
+ * frame, so a level between two steps of the strip is shown as a mix of
+ * both. That matters at low brightness, where the gamma curve leaves the
+ * 5 bit LPD6803 only a few steps.
+ *
+ * The time spent in each stage is kept by the profiler in prof.c, in CPU
+ * cycles on the target and in nanoseconds in a host build; prof_init()
+ * has to be called first.
+ */
+
+#define ANIM_MAX_LEDS		300
+#define ANIM_GAMMA		2.5
+
+struct anim_rgb {
+	uint8_t r, g, b;
+};
+
+struct anim_effect {
+	const char *name;
+	void (*render)(struct anim_rgb *px, uint32_t count, uint32_t frame);
+};
+
+extern const struct anim_effect anim_effects[];
+extern const uint32_t anim_neffects;
+
+struct anim_stats {
+	struct prof_stat render;
+	struct prof_stat output;
+	struct prof_stat frame;		/* Both stages */
+};
+
+/* Called for every LED, with depth bits per colour in the top bits */
+typedef void (*anim_output)(uint32_t led, uint8_t r, uint8_t g, uint8_t b);
+
+struct anim {
+	uint32_t count;
+	uint32_t depth;
+	const struct anim_effect *effect;
+	uint32_t frame;
+	/* Gamma corrected, in steps of the strip with 8 fraction bits */
+	uint16_t level[256];
+	struct anim_rgb px[ANIM_MAX_LEDS];
+	uint8_t residue[ANIM_MAX_LEDS][3];
+	struct anim_stats stats;
+};
+
+/*
+ * Hue in 1/256ths of a sixth of the colour wheel (0 - 1535, red, yellow,
+ * green, cyan, blue, magenta), saturation and value 0 - 255.
+ */
+struct anim_rgb anim_hsv(uint32_t hue, uint8_t sat, uint8_t val);
+
+/* depth is the bits per colour of the strip, 1 - 8; returns 0 or -1 */
+int anim_init(struct anim *a, uint32_t count, uint32_t depth);
+void anim_set_effect(struct anim *a, const struct anim_effect *effect);
+/* Draw the next frame and hand every LED to out */
+void anim_frame(struct anim *a, anim_output out);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host renderer and benchmark of the animation engine, built by
+ * 'make HOST=1'.
+ *
+ *	./anim_render.host [<output> [<reference>]]
+ *
+ * Every effect is rendered for FRAMES frames of LEDS LEDs, at the 5 bit
+ * depth of the LPD6803 and the 8 bit depth of the WS2812. The frames are
+ * written to the output file, as they would go to the strip: R, G, B for
+ * each LED, LED after LED, frame after frame. If a reference file from
+ * an earlier run is given, the two are compared and the first frame that
+ * differs is reported. Then the dithering is checked against the gamma
+ * table, and each stage is timed per LED.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "anim.h"
+
+#define LEDS		300
+#define FRAMES		600
+#define BENCH_FRAMES	2000
+
+static struct anim anim;
+static uint8_t frame[LEDS * 3];
+static int errors;
+
+static void store(uint32_t led, uint8_t r, uint8_t g, uint8_t b)
+{
+	frame[led * 3] = r;
+	frame[led * 3 + 1] = g;
+	frame[led * 3 + 2] = b;
+}
+
+static uint32_t fnv1a(uint32_t h, const uint8_t *p, uint32_t len)
+{
+	while (len--) {
+		h = (h ^ *p++) * 16777619;
+	}
+	return h;
+}
+
+static void render(FILE *out, FILE *ref)
+{
+	static const uint32_t depths[] = { 5, 8 };
+	static uint8_t expect[sizeof(frame)];
+	uint32_t d, e, f, h, i;
+
+	for (d = 0; d < 2; d++) {
+		for (e = 0; e < anim_neffects; e++) {
+			anim_init(&anim, LEDS, depths[d]);
+			anim_set_effect(&anim, &anim_effects[e]);
+			h = 2166136261u;
+			for (f = 0; f < FRAMES; f++) {
+				anim_frame(&anim, store);
+				h = fnv1a(h, frame, sizeof(frame));
+				if (out) {
+					fwrite(frame, sizeof(frame), 1, out);
+				}
+				if (!ref || errors) {
+					continue;
+				}
+				if (fread(expect, sizeof(expect), 1, ref) != 1) {
+					printf("reference too short\n");
+					errors++;
+					continue;
+				}
+				for (i = 0; i < sizeof(frame); i++) {
+					if (frame[i] != expect[i]) {
+						printf("%s, %u bits: frame %u LED %u "
+						       "differs from the reference\n",
+						       anim_effects[e].name,
+						       depths[d], f, i / 3);
+						errors++;
+						break;
+					}
+				}
+			}
+			printf("%-8s %u bits: %u frames, fnv1a %08x\n",
+			       anim_effects[e].name, depths[d], FRAMES, h);
+		}
+	}
+}
+
+/* The whole strip at one level, for the dithering check */
+static uint8_t flat_level;
+
+static void flat(struct anim_rgb *px, uint32_t count, uint32_t f)
+{
+	(void)f;
+	memset(px, flat_level, count * sizeof(*px));
+}
+
+static const struct anim_effect flat_effect = { "flat", flat };
+
+/*
+ * Over 256 frames the dithered output of each LED has to add up to 256
+ * times its gamma corrected level, give or take the one step that is
+ * still in the residue.
+ */
+static void check_dither(void)
+{
+	uint32_t sum[LEDS], v, f, i, depth;
+	int32_t diff;
+
+	for (depth = 1; depth <= 8; depth++) {
+		for (v = 0; v < 256; v++) {
+			anim_init(&anim, LEDS, depth);
+			anim_set_effect(&anim, &flat_effect);
+			flat_level = v;
+			memset(sum, 0, sizeof(sum));
+			for (f = 0; f < 256; f++) {
+				anim_frame(&anim, store);
+				for (i = 0; i < LEDS; i++) {
+					sum[i] += frame[i * 3] >> (8 - depth);
+				}
+			}
+			for (i = 0; i < LEDS; i++) {
+				diff = (int32_t)sum[i] - anim.level[v];
+				if (diff < -1 || diff > 1) {
+					printf("%u bits, level %u, LED %u: %u "
+					       "steps in 256 frames, expected "
+					       "%u/256\n", depth, v, i, sum[i],
+					       anim.level[v]);
+					errors++;
+					return;
+				}
+			}
+		}
+	}
+	printf("dithering matches the gamma table at 1 to 8 bits\n");
+}
+
+static void bench(void)
+{
+	uint32_t e, f;
+	double leds = (double)BENCH_FRAMES * LEDS;
+
+	printf("%-8s %9s %9s %9s\n", "", "render", "output", "ns/LED");
+	for (e = 0; e < anim_neffects; e++) {
+		anim_init(&anim, LEDS, 5);
+		anim_set_effect(&anim, &anim_effects[e]);
+		for (f = 0; f < BENCH_FRAMES; f++) {
+			anim_frame(&anim, store);
+		}
+		printf("%-8s %9.2f %9.2f %9.2f, worst frame %uus\n",
+		       anim_effects[e].name, anim.stats.render.total / leds,
+		       anim.stats.output.total / leds,
+		       (anim.stats.render.total + anim.stats.output.total) / leds,
+		       anim.stats.frame.max / 1000);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	FILE *out = NULL, *ref = NULL;
+
+	prof_init();
+	if (argc > 1 && !(out = fopen(argv[1], "wb"))) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (argc > 2 && !(ref = fopen(argv[2], "rb"))) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	render(out, ref);
+	if (ref) {
+		printf("%s the reference\n", errors ? "differs from" :
+		       "identical to");
+		fclose(ref);
+	}
+	if (out) {
+		fclose(out);
+	}
+	check_dither();
+	bench();
+	return errors ? 1 : 0;
+}
@@ -24,52 +24,35 @@
  * http://www.adafruit.com/datasheets/LPD6803.pdf
  */
 
-#include <stdlib.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/cm3/systick.h>
+#include "ledstrip.h"
+#include "anim.h"
 
-#define SPI_BANK GPIOB
-#define SCLK_PIN GPIO13
-#define MOSI_PIN GPIO15
-
-#define SMALL_DELAY_VALUE 0
+/*
+ * The strip is driven by SPI2 and DMA, see ledstrip.h. For a WS2812
+ * strip, change this to LEDSTRIP_WS2812 and STRIP_DEPTH to 8, and
+ * connect DIN to PB15.
+ */
+#define STRIP_TYPE LEDSTRIP_LPD6803
+#define STRIP_DEPTH 5
 
 #define COLOR_COUNT 50
 
-#define SCLK(VAL)				\
-	if (VAL) {				\
-		gpio_set(SPI_BANK, SCLK_PIN);	\
-	} else {				\
-		gpio_clear(SPI_BANK, SCLK_PIN);	\
-	}
+#define FRAME_RATE 60
+#define EFFECT_FRAMES (20 * FRAME_RATE)
 
-#define MOSI(VAL)				\
-	if (VAL) {				\
-		gpio_set(SPI_BANK, MOSI_PIN);	\
-	} else {				\
-		gpio_clear(SPI_BANK, MOSI_PIN);	\
-	}
-
-#define SMALL_DELAY() {				\
-		int j;				\
-		for (j = 0; j < SMALL_DELAY_VALUE; j++)	\
-			__asm__("nop");		\
-	}
-
-struct color {
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-};
+static struct anim anim;
+static volatile uint32_t ticks;
 
 /* Set STM32 to 72 MHz. */
 static void clock_setup(void)
 {
 	rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE8_72MHZ]);
 
-	/* Enable GPIOB and GPIOC clock. */
+	/* Enable GPIOC clock. */
 	rcc_periph_clock_enable(RCC_GPIOC);
-	rcc_periph_clock_enable(RCC_GPIOB);
 }
 
 static void gpio_setup(void)
@@ -77,159 +60,51 @@ static void gpio_setup(void)
 	/* Set GPIO12 (in GPIO port C) to 'output push-pull'. */
 	gpio_set_mode(GPIOC, GPIO_MODE_OUTPUT_50_MHZ,
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
-
-	/* Set GPIO13 (in GPIO port B) to 'output push-pull'. */
-	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
-		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO13);
-
-	/* Set GPIO15 (in GPIO port B) to 'output push-pull'. */
-	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
-		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO15);
-}
-
-static void send_colors(struct color *colors, int count)
-{
-	int i, k;
-
-	/* Initialize SPI pins. */
-	SCLK(0);
-	MOSI(0);
-
-	/* Start frame */
-	for (i = 0; i < 32; i++) {
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
-	}
-
-	/* Color cell output */
-	for (k = 0; k < count; k++) {
-		/* Start bit */
-		MOSI(1);
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
-
-		/* Blue */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].b & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
-		/* Red */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].r & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
-		/* Green */
-		for (i = 0; i < 5; i++) {
-			MOSI(((colors[k].g & ((1 << 4) >> i)) != 0));
-			SCLK(1);
-			SMALL_DELAY();
-			SCLK(0);
-			SMALL_DELAY();
-		}
-	}
-
-	/* End frame */
-	MOSI(0);
-	for (k = 0; k < count; k++) {
-		SCLK(1);
-		SMALL_DELAY();
-		SCLK(0);
-		SMALL_DELAY();
-	}
 }
 
-static void reset_colors(struct color *colors, int count)
+static void systick_setup(void)
 {
-	int i;
-
-	for (i = 0; i < count; i++) {
-		colors[i].r = 0;
-		colors[i].g = 0;
-		colors[i].b = 0;
-	}
+	/* 72MHz / 8 => 9000000 counts per second, one tick per frame */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB_DIV8);
+	systick_set_reload(9000000 / FRAME_RATE - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
 }
 
-static void init_colors(struct color *colors, int count)
+void sys_tick_handler(void)
 {
-	colors[0].r = 0x1F;
-	colors[0].g = 0;
-	colors[0].b = 0;
-	colors[1].r = 0;
-	colors[1].g = 0x1F;
-	colors[1].b = 0;
-	colors[2].r = 0;
-	colors[2].g = 0;
-	colors[2].b = 0x1F;
-
-	count = count;
-}
-
-static void step_colors(struct color *colors, int count)
-{
-	int i;
-	struct color tmp_color1;
-	struct color tmp_color2;
-
-#if 0
-	/* Random blinking. */
-	for (i = 0; i < count; i++) {
-		colors[i].r = rand() & 0x01;
-		colors[i].g = rand() & 0x01;
-		colors[i].b = rand() & 0x01;
-	}
-#endif
-
-	/* Generate next colors. */
-	tmp_color1.r = colors[0].r;
-	tmp_color1.g = colors[0].g;
-	tmp_color1.b = colors[0].b;
-	colors[0].r = colors[count - 1].r;
-	colors[0].g = colors[count - 1].g;
-	colors[0].b = colors[count - 1].b;
-	for (i = 1; i < count; i++) {
-		tmp_color2.r = colors[i].r;
-		tmp_color2.g = colors[i].g;
-		tmp_color2.b = colors[i].b;
-		colors[i].r = tmp_color1.r;
-		colors[i].g = tmp_color1.g;
-		colors[i].b = tmp_color1.b;
-		tmp_color1.r = tmp_color2.r;
-		tmp_color1.g = tmp_color2.g;
-		tmp_color1.b = tmp_color2.b;
-	}
+	ticks++;
 }
 
 int main(void)
 {
-	int i;
-
-	struct color colors[COLOR_COUNT];
+	uint32_t effect = 0, last = 0;
 
 	clock_setup();
+	prof_init();
 	gpio_setup();
-
-	reset_colors(colors, COLOR_COUNT);
-	init_colors(colors, COLOR_COUNT);
-
+	ledstrip_init(STRIP_TYPE, COLOR_COUNT);
+	anim_init(&anim, COLOR_COUNT, STRIP_DEPTH);
+	systick_setup();
+
+	/*
+	 * Each frame is drawn straight into the frame buffer that is not
+	 * being sent, then handed to the DMA. anim.stats has the cycles
+	 * each frame took (see prof.h), for a look with the debugger.
+	 */
 	while (1) {
-		gpio_toggle(GPIOC, GPIO12);	/* LED on/off */
+		while (ticks == last);
+		last = ticks;
 
-		send_colors(colors, COLOR_COUNT);
+		gpio_toggle(GPIOC, GPIO12);	/* LED on/off */
 
-		step_colors(colors, COLOR_COUNT);
+		anim_frame(&anim, ledstrip_set);
+		ledstrip_show();
 
-		for (i = 0; i < 1000000; i++)	/* Wait a bit. */
-			__asm__("nop");
+		if (anim.frame == EFFECT_FRAMES) {
+			effect = (effect + 1) % anim_neffects;
+			anim_set_effect(&anim, &anim_effects[effect]);
+		}
 	}
 
 	return 0;
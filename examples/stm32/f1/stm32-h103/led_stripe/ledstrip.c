@@ -0,0 +1,184 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include "ledstrip.h"
+
+#define LPD6803_START	4
+#define WS2812_BYTES	9
+#define WS2812_RESET	85		/* 300us at 2.25MHz */
+
+/* Both fit the bigger of the two encodings */
+#define FRAME_SIZE	(LEDSTRIP_MAX_LEDS * WS2812_BYTES + WS2812_RESET)
+
+static uint8_t frames[2][FRAME_SIZE];
+static uint8_t *front = frames[0], *back = frames[1];
+static uint32_t frame_len;
+static uint32_t leds;
+static uint32_t spi_div;
+static enum ledstrip_type strip_type;
+static volatile bool busy;
+
+/* Four data bits as four 3 bit WS2812 symbols, 100 or 110 */
+static const uint16_t ws2812_nibble[16] = {
+	0x924, 0x926, 0x934, 0x936, 0x9a4, 0x9a6, 0x9b4, 0x9b6,
+	0xd24, 0xd26, 0xd34, 0xd36, 0xda4, 0xda6, 0xdb4, 0xdb6,
+};
+
+static void ws2812_byte(uint8_t *p, uint8_t v)
+{
+	uint32_t bits = (uint32_t)ws2812_nibble[v >> 4] << 12 |
+			ws2812_nibble[v & 0xf];
+
+	p[0] = bits >> 16;
+	p[1] = bits >> 8;
+	p[2] = bits;
+}
+
+void ledstrip_set(uint32_t led, uint8_t r, uint8_t g, uint8_t b)
+{
+	uint8_t *p;
+	uint16_t cell;
+
+	if (led >= leds) {
+		return;
+	}
+	if (strip_type == LEDSTRIP_WS2812) {
+		p = &back[led * WS2812_BYTES];
+		ws2812_byte(p, g);
+		ws2812_byte(p + 3, r);
+		ws2812_byte(p + 6, b);
+	} else {
+		p = &back[LPD6803_START + led * 2];
+		cell = 0x8000 | (b >> 3) << 10 | (r >> 3) << 5 | g >> 3;
+		p[0] = cell >> 8;
+		p[1] = cell;
+	}
+}
+
+static void spi_setup(void)
+{
+	rcc_periph_clock_enable(RCC_GPIOB);
+	rcc_periph_clock_enable(RCC_SPI2);
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	/* SCK on PB13, MOSI on PB15. A WS2812 strip only uses MOSI. */
+	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
+		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO13 | GPIO15);
+
+	spi_reset(SPI2);
+	spi_init_master(SPI2, spi_div, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
+			SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT,
+			SPI_CR1_MSBFIRST);
+	spi_set_bidirectional_transmit_only_mode(SPI2);
+	spi_enable_software_slave_management(SPI2);
+	spi_set_nss_high(SPI2);
+	spi_enable_tx_dma(SPI2);
+	spi_enable(SPI2);
+
+	/* SPI2 TX is on DMA1 channel 5 */
+	nvic_set_priority(NVIC_DMA1_CHANNEL5_IRQ, 0);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL5_IRQ);
+}
+
+int ledstrip_init(enum ledstrip_type type, uint32_t count)
+{
+	if (count > LEDSTRIP_MAX_LEDS) {
+		return -1;
+	}
+	strip_type = type;
+	leds = count;
+
+	/*
+	 * The start frame, the end clocks and the latch time are zeros and
+	 * stay that way, only the LED cells are ever written.
+	 */
+	memset(frames, 0, sizeof(frames));
+	if (type == LEDSTRIP_WS2812) {
+		/* 36MHz / 16 */
+		spi_div = SPI_CR1_BAUDRATE_FPCLK_DIV_16;
+		frame_len = count * WS2812_BYTES + WS2812_RESET;
+	} else {
+		/* 36MHz / 32, the LPD6803 also runs its PWM from this clock */
+		spi_div = SPI_CR1_BAUDRATE_FPCLK_DIV_32;
+		frame_len = LPD6803_START + count * 2 + (count + 7) / 8;
+	}
+	for (count = 0; count < leds; count++) {
+		ledstrip_set(count, 0, 0, 0);
+	}
+	memcpy(front, back, frame_len);
+
+	spi_setup();
+	return 0;
+}
+
+bool ledstrip_busy(void)
+{
+	return busy;
+}
+
+uint32_t ledstrip_frame_us(void)
+{
+	/* The DIV_n values are log2(n) - 1, shifted into place */
+	uint32_t shift = (spi_div >> 3) + 1;
+
+	return (uint64_t)frame_len * 8 * 1000000 /
+	       (rcc_apb1_frequency >> shift);
+}
+
+void ledstrip_show(void)
+{
+	uint8_t *p;
+
+	while (busy);
+
+	p = front;
+	front = back;
+	back = p;
+	busy = true;
+
+	dma_channel_reset(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_address(DMA1, DMA_CHANNEL5, (uint32_t)&SPI2_DR);
+	dma_set_memory_address(DMA1, DMA_CHANNEL5, (uint32_t)front);
+	dma_set_number_of_data(DMA1, DMA_CHANNEL5, frame_len);
+	dma_set_read_from_memory(DMA1, DMA_CHANNEL5);
+	dma_enable_memory_increment_mode(DMA1, DMA_CHANNEL5);
+	dma_set_peripheral_size(DMA1, DMA_CHANNEL5, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, DMA_CHANNEL5, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, DMA_CHANNEL5, DMA_CCR_PL_HIGH);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
+	dma_enable_channel(DMA1, DMA_CHANNEL5);
+
+	/* The DMA only reads the front buffer, this runs alongside it */
+	memcpy(back, front, frame_len);
+}
+
+/* SPI transmit completed with DMA */
+void dma1_channel5_isr(void)
+{
+	if ((DMA1_ISR & DMA_ISR_TCIF5) != 0) {
+		DMA1_IFCR |= DMA_IFCR_CTCIF5;
+	}
+	dma_disable_transfer_complete_interrupt(DMA1, DMA_CHANNEL5);
+	dma_disable_channel(DMA1, DMA_CHANNEL5);
+	busy = false;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LEDSTRIP_H
+#define __LEDSTRIP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * LED strip output through SPI2 and DMA, clock on PB13 and data on PB15.
+ *
+ * The LEDs are encoded into the frame buffer as they are set, in exactly
+ * the bytes that go out on the wire, so sending a frame is one DMA
+ * transfer that the CPU takes no part in:
+ *
+ * LEDSTRIP_LPD6803	clock and data strips: a 32 bit zero start frame,
+ *			16 bits per LED (a 1, then 5 bits each of blue, red
+ *			and green) and one more clock per LED at the end.
+ * LEDSTRIP_WS2812	single wire strips on PB15 only: every data bit is
+ *			sent as three SPI bits, 100 for a 0 and 110 for a 1,
+ *			at 2.25MHz, so 444ns or 889ns high in 1.33us. Green,
+ *			red, blue, then 300us low to latch.
+ *
+ * There are two frame buffers. ledstrip_set() writes into the one that is
+ * not being sent; ledstrip_show() waits for the previous frame to finish,
+ * starts sending the new one and copies it over, so the next frame starts
+ * from the current picture.
+ */
+
+#define LEDSTRIP_MAX_LEDS	300
+
+enum ledstrip_type {
+	LEDSTRIP_LPD6803,
+	LEDSTRIP_WS2812,
+};
+
+/* Returns 0, or -1 if count is over LEDSTRIP_MAX_LEDS */
+int ledstrip_init(enum ledstrip_type type, uint32_t count);
+void ledstrip_set(uint32_t led, uint8_t r, uint8_t g, uint8_t b);
+void ledstrip_show(void);
+bool ledstrip_busy(void);
+
+/* How long a frame takes on the wire, in microseconds */
+uint32_t ledstrip_frame_us(void);
+
+#endif
@@ -0,0 +1,202 @@
+#! /usr/bin/env python
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Decoder for the records trace.c sends over SWO.
+#
+#   swodecode.py [-c HZ] [-e ID=NAME ...] [swo.bin]
+#
+# Reads the raw ITM byte stream, as captured from the SWO pin with the
+# TPIU formatter off (a file, or stdin), and prints each text line and
+# event at the time it was queued, from the cycle counter value sent
+# ahead of it. At the end it lists, per event, how often it came and the
+# time between two of them. Packets other than stimulus port writes
+# (sync, timestamps, DWT hardware packets) are skipped; ITM overflows and
+# records dropped by trace.c are reported where they happened.
+
+from __future__ import print_function, division
+
+import argparse
+import sys
+
+# The TRACE_PORT_* of trace.h
+PORT_TEXT = 0
+PORT_EVENT = 1
+PORT_TIME = 2
+PORT_DROP = 3
+
+OVERFLOW = 0x70
+
+
+def packets(data):
+	"""Yield (port, size, value) for each stimulus write, and
+	('overflow', 0, 0) for each ITM overflow packet."""
+	i = 0
+	n = len(data)
+	while i < n:
+		h = data[i]
+		i += 1
+		if h & 0x03:
+			size = (1, 2, 4)[(h & 0x03) - 1]
+			if i + size > n:
+				return
+			value = 0
+			for k in range(size):
+				value |= data[i + k] << (8 * k)
+			i += size
+			# Bit 2 set is a hardware (DWT) packet
+			if not h & 0x04:
+				yield h >> 3, size, value
+		elif h == OVERFLOW:
+			yield 'overflow', 0, 0
+		elif h == 0x80:
+			pass		# The end of a sync packet
+		elif h & 0x80:
+			# Timestamp or extension, continued while bit 7 is set
+			while i < n and data[i] & 0x80:
+				i += 1
+			i += 1
+		# else a sync byte or a one byte local timestamp
+
+
+class Decoder(object):
+	def __init__(self, clock, names, out):
+		self.clock = clock
+		self.names = names
+		self.out = out
+		self.time = None	# Cycles, 64 bit
+		self.text = bytearray()
+		self.text_time = None
+		self.events = {}	# id: [count, last, min, max, total]
+		self.dropped = 0
+		self.overflows = 0
+
+	def stamp(self, t):
+		if t is None:
+			return '%12s' % '?'
+		return '%12.3f' % (t * 1e6 / self.clock)
+
+	def show(self, t, what):
+		print('%s us  %s' % (self.stamp(t), what), file=self.out)
+
+	def cycles(self, c):
+		# The counter is 32 bits; assume it wraps at most once between
+		# two records, 59s at 72MHz.
+		if self.time is None:
+			self.time = c
+		else:
+			t = (self.time & ~0xffffffff) | c
+			if t < self.time:
+				t += 1 << 32
+			self.time = t
+
+	def text_bytes(self, value, size):
+		for k in range(size):
+			b = (value >> (8 * k)) & 0xff
+			if not self.text:
+				self.text_time = self.time
+			if b == 0x0a:
+				line = self.text.decode('latin-1').rstrip('\r')
+				self.show(self.text_time, '"%s"' % line)
+				self.text = bytearray()
+			else:
+				self.text.append(b)
+
+	def event(self, value):
+		eid, arg = value >> 16, value & 0xffff
+		name = self.names.get(eid, 'event %d' % eid)
+		s = self.events.setdefault(eid, [0, None, None, None, 0])
+		delta = ''
+		if s[1] is not None and self.time is not None:
+			d = self.time - s[1]
+			s[2] = d if s[2] is None else min(s[2], d)
+			s[3] = d if s[3] is None else max(s[3], d)
+			s[4] += d
+			delta = '  +%.3f us' % (d * 1e6 / self.clock)
+		s[0] += 1
+		s[1] = self.time
+		self.show(self.time, '%s(%d)%s' % (name, arg, delta))
+
+	def feed(self, port, size, value):
+		if port == 'overflow':
+			self.overflows += 1
+			self.show(self.time, '** ITM overflow, packets lost')
+		elif port == PORT_TIME and size == 4:
+			self.cycles(value)
+		elif port == PORT_DROP:
+			self.dropped += value
+			self.show(self.time, '** %d records dropped' % value)
+		elif port == PORT_TEXT:
+			self.text_bytes(value, size)
+		elif port == PORT_EVENT and size == 4:
+			self.event(value)
+
+	def summary(self):
+		if self.text:
+			self.show(self.text_time, '"%s" (no newline)' %
+				  self.text.decode('latin-1'))
+		out = self.out
+		print('', file=out)
+		print('%-16s %8s %12s %12s %12s' %
+		      ('event', 'count', 'min us', 'mean us', 'max us'),
+		      file=out)
+		us = 1e6 / self.clock
+		for eid in sorted(self.events):
+			count, last, lo, hi, total = self.events[eid]
+			name = self.names.get(eid, 'event %d' % eid)
+			if count > 1:
+				print('%-16s %8d %12.3f %12.3f %12.3f' %
+				      (name, count, lo * us,
+				       total * us / (count - 1), hi * us),
+				      file=out)
+			else:
+				print('%-16s %8d' % (name, count), file=out)
+		print('records dropped by the target: %d, ITM overflows: %d' %
+		      (self.dropped, self.overflows), file=out)
+
+
+def main():
+	p = argparse.ArgumentParser(description='Decode trace.c records '
+				    'from a raw SWO capture.')
+	p.add_argument('-c', '--clock', type=float, default=72e6,
+		       help='CPU clock in Hz, for the cycle counter '
+		       '(default 72e6)')
+	p.add_argument('-e', '--event', action='append', default=[],
+		       metavar='ID=NAME', help='name an event ID')
+	p.add_argument('file', nargs='?', help='capture, stdin if none')
+	args = p.parse_args()
+
+	names = {}
+	for e in args.event:
+		eid, _, name = e.partition('=')
+		names[int(eid, 0)] = name
+
+	if args.file:
+		with open(args.file, 'rb') as f:
+			data = bytearray(f.read())
+	else:
+		stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+		data = bytearray(stdin.read())
+
+	d = Decoder(args.clock, names, sys.stdout)
+	for port, size, value in packets(data):
+		d.feed(port, size, value)
+	d.summary()
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,177 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/itm.h>
+#include "trace.h"
+
+/*
+ * Each queued write is a data word and a byte with its port in the low
+ * 5 bits and its size in bytes, less one, in the top two.
+ */
+#define META(port, size)	((port) | ((size) - 1) << 6)
+#define META_PORT(m)		((m) & 0x1f)
+#define META_SIZE(m)		(((m) >> 6) + 1)
+
+/* Data in the queue before the new head is seen */
+#define TRACE_BARRIER()		__asm__ volatile ("" : : : "memory")
+
+struct trace_stats trace_stats;
+
+static uint32_t queue_data[TRACE_QUEUE_WORDS];
+static uint8_t queue_meta[TRACE_QUEUE_WORDS];
+/*
+ * Free running. Producers move head with interrupts masked, so they can
+ * come from any priority; only trace_drain() moves tail.
+ */
+static volatile uint32_t head, tail;
+static uint32_t drop_pending;
+
+static void trace_put(uint32_t h, uint8_t meta, uint32_t data)
+{
+	queue_data[h & (TRACE_QUEUE_WORDS - 1)] = data;
+	queue_meta[h & (TRACE_QUEUE_WORDS - 1)] = meta;
+}
+
+/*
+ * Start a record of n payload writes: mask interrupts and queue the
+ * drop count, if any, and the timestamp. Returns false, with interrupts
+ * as they were, if the whole record doesn't fit.
+ */
+static bool trace_begin(uint32_t n, uint32_t *h, uint32_t *mask)
+{
+	*mask = cm_mask_interrupts(1);
+	*h = head;
+
+	n += drop_pending ? 2 : 1;
+	if (TRACE_QUEUE_WORDS - (*h - tail) < n) {
+		drop_pending++;
+		trace_stats.dropped++;
+		cm_mask_interrupts(*mask);
+		return false;
+	}
+
+	if (drop_pending) {
+		trace_put((*h)++, META(TRACE_PORT_DROP, 4), drop_pending);
+		drop_pending = 0;
+	}
+	trace_put((*h)++, META(TRACE_PORT_TIME, 4), dwt_read_cycle_counter());
+	return true;
+}
+
+static void trace_end(uint32_t h, uint32_t mask)
+{
+	if (h - tail > trace_stats.max_used)
+		trace_stats.max_used = h - tail;
+	trace_stats.records++;
+
+	TRACE_BARRIER();
+	head = h;
+	cm_mask_interrupts(mask);
+}
+
+void trace_puts(const char *s)
+{
+	uint32_t len, n, h, mask, w, i;
+
+	for (len = 0; len < TRACE_MAX_TEXT && s[len]; len++);
+
+	/* Whole words, then a half word and/or a byte for the tail */
+	n = len / 4 + (len & 2) / 2 + (len & 1);
+	if (!trace_begin(n, &h, &mask))
+		return;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		memcpy(&w, s + i, 4);
+		trace_put(h++, META(TRACE_PORT_TEXT, 4), w);
+	}
+	if (len & 2) {
+		trace_put(h++, META(TRACE_PORT_TEXT, 2),
+			  (uint8_t)s[i] | (uint8_t)s[i + 1] << 8);
+		i += 2;
+	}
+	if (len & 1)
+		trace_put(h++, META(TRACE_PORT_TEXT, 1), (uint8_t)s[i]);
+
+	trace_end(h, mask);
+}
+
+void trace_event(uint16_t id, uint16_t arg)
+{
+	uint32_t h, mask;
+
+	if (!trace_begin(1, &h, &mask))
+		return;
+	trace_put(h++, META(TRACE_PORT_EVENT, 4), (uint32_t)id << 16 | arg);
+	trace_end(h, mask);
+}
+
+uint32_t trace_drain(void)
+{
+	uint32_t t = tail, n = 0, data;
+	uint8_t meta, port;
+
+	while (t != head) {
+		data = queue_data[t & (TRACE_QUEUE_WORDS - 1)];
+		meta = queue_meta[t & (TRACE_QUEUE_WORDS - 1)];
+		port = META_PORT(meta);
+
+		/* Leave the rest for next time rather than wait. */
+		if (!(ITM_STIM32(port) & ITM_STIM_FIFOREADY))
+			break;
+
+		switch (META_SIZE(meta)) {
+		case 1:
+			ITM_STIM8(port) = data;
+			break;
+		case 2:
+			ITM_STIM16(port) = data;
+			break;
+		default:
+			ITM_STIM32(port) = data;
+			break;
+		}
+		tail = ++t;
+		n++;
+	}
+
+	trace_stats.words += n;
+	return n;
+}
+
+uint32_t trace_queued(void)
+{
+	return head - tail;
+}
+
+void trace_init(void)
+{
+	head = 0;
+	tail = 0;
+	drop_pending = 0;
+	memset(&trace_stats, 0, sizeof(trace_stats));
+
+	ITM_TER[0] |= (1 << TRACE_PORT_TEXT) | (1 << TRACE_PORT_EVENT) |
+		      (1 << TRACE_PORT_TIME) | (1 << TRACE_PORT_DROP);
+	/*
+	 * Records are stamped with the bare cycle count; the times between
+	 * them are worked out by swodecode.py, not by prof.c on the target.
+	 */
+	dwt_enable_cycle_counter();
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Buffered trace over the ITM.
+ *
+ * trace_puts() and trace_event() never wait for the trace port. They
+ * queue a record in RAM and return; a record that does not fit is
+ * dropped whole and counted. They may be called from any interrupt.
+ * trace_drain() moves the queue out through the ITM stimulus ports, as
+ * much as the ITM FIFO takes without waiting, and is meant to be called
+ * from the lowest priority context there is, usually the main loop.
+ *
+ * Every record goes out as the DWT cycle counter on TRACE_PORT_TIME,
+ * followed by its payload:
+ *
+ *	TRACE_PORT_TEXT		the string, four bytes per 32 bit write, the
+ *				tail as a 16 and/or 8 bit write
+ *	TRACE_PORT_EVENT	one 32 bit write, the event ID in the top 16
+ *				bits and its argument in the bottom 16
+ *
+ * When records had to be dropped, the next one that fits is preceded by
+ * the number dropped on TRACE_PORT_DROP, so the decoder (swodecode.py)
+ * knows where the gaps are.
+ */
+
+#define TRACE_PORT_TEXT		0
+#define TRACE_PORT_EVENT	1
+#define TRACE_PORT_TIME		2
+#define TRACE_PORT_DROP		3
+
+/* Queue size in 32 bit writes, a power of two */
+#define TRACE_QUEUE_WORDS	512
+
+/* Longest string trace_puts() takes, longer ones are cut */
+#define TRACE_MAX_TEXT		128
+
+struct trace_stats {
+	uint32_t records;	/* Queued */
+	uint32_t dropped;	/* Records that did not fit */
+	uint32_t words;		/* Stimulus writes made */
+	uint32_t max_used;	/* Most words ever queued at once */
+};
+
+extern struct trace_stats trace_stats;
+
+/* Enable ports 0 - 3 and the cycle counter; TPIU/SWO setup is separate */
+void trace_init(void);
+void trace_puts(const char *s);
+void trace_event(uint16_t id, uint16_t arg);
+/* Returns the number of stimulus writes made */
+uint32_t trace_drain(void);
+uint32_t trace_queued(void);
+
+#endif
@@ -24,6 +24,11 @@
 #include <libopencm3/cm3/scs.h>
 #include <libopencm3/cm3/tpiu.h>
 #include <libopencm3/cm3/itm.h>
+#include "trace.h"
+
+/* Event IDs, as given to swodecode.py -e */
+#define EVENT_BLINK	1	/* Argument: the LED state */
+#define EVENT_LINE	2	/* Argument: records dropped so far */
 
 static void clock_setup(void)
 {
@@ -54,8 +59,8 @@ static void trace_setup(void)
 
 	/* Enable ITM with ID = 1. */
 	ITM_TCR = (1 << 16) | ITM_TCR_ITMENA;
-	/* Enable stimulus port 1. */
-	ITM_TER[0] = 1;
+	/* Enable the stimulus ports and the cycle counter for the records. */
+	trace_init();
 }
 
 static void gpio_setup(void)
@@ -65,17 +70,10 @@ static void gpio_setup(void)
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
 }
 
-static void trace_send_blocking(char c)
-{
-	while (!(ITM_STIM8(0) & ITM_STIM_FIFOREADY))
-		;
-
-	ITM_STIM8(0) = c;
-}
-
 int main(void)
 {
 	int i, j = 0, c = 0;
+	char s[2] = { 0, 0 };
 
 	clock_setup();
 	gpio_setup();
@@ -84,14 +82,17 @@ int main(void)
 	/* Blink the LED (PC12) on the board with every transmitted byte. */
 	while (1) {
 		gpio_toggle(GPIOC, GPIO12);	/* LED on/off */
-		trace_send_blocking(c + '0');
+		trace_event(EVENT_BLINK, gpio_get(GPIOC, GPIO12) ? 1 : 0);
+		s[0] = c + '0';
+		trace_puts(s);
 		c = (c == 9) ? 0 : c + 1;	/* Increment c. */
 		if ((j++ % 80) == 0) {		/* Newline after line full. */
-			trace_send_blocking('\r');
-			trace_send_blocking('\n');
+			trace_puts("\r\n");
+			trace_event(EVENT_LINE, trace_stats.dropped);
 		}
-		for (i = 0; i < 800000; i++)	/* Wait a bit. */
-			__asm__("nop");
+		/* Wait a bit, sending the queued records meanwhile. */
+		for (i = 0; i < 800000; i++)
+			trace_drain();
 	}
 
 	return 0;
@@ -0,0 +1,288 @@
+#! /usr/bin/env python
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Patch (delta or compressed) downloads for the usb_dfu bootloader.
+#
+#   dfupatch.py diff  old.bin|- new.bin patch.bin   make a patch
+#   dfupatch.py apply old.bin|- patch.bin new.bin   apply it, as a check
+#   dfupatch.py send  patch.bin                     download it
+#
+# With '-' as the old image the patch only uses data from the new image
+# itself, i.e. it is an LZ compressed copy of it. The format is described
+# in patch.h. 'send' needs pyusb, and the bootloader running the image
+# the patch was made against; the images are binaries for 0x08002000.
+
+from __future__ import print_function, division
+
+import struct
+import sys
+import time
+import zlib
+
+APP_ADDRESS = 0x08002000
+PAGE = 1024
+# Overwritten pages the bootloader keeps, PATCH_OLD_PAGES in patch.h
+OLD_PAGES = 4
+HEADER = '<4sIIII'
+
+OP_END = 0
+OP_LITERAL = 1
+OP_OLD = 2
+OP_NEW = 3
+OP_FILL = 4
+
+MIN_MATCH = 4
+MAX_CANDIDATES = 16
+
+
+def varint(v):
+	b = bytearray()
+	while v >= 0x80:
+		b.append((v & 0x7f) | 0x80)
+		v >>= 7
+	b.append(v)
+	return b
+
+
+def zigzag(d):
+	return 2 * d if d >= 0 else 2 * (-d - 1) + 1
+
+
+def crc32(data):
+	return zlib.crc32(bytes(data)) & 0xffffffff
+
+
+def match_len(a, i, b, j, limit):
+	n = 0
+	while n + 32 <= limit and a[i + n:i + n + 32] == b[j + n:j + n + 32]:
+		n += 32
+	while n < limit and a[i + n] == b[j + n]:
+		n += 1
+	return n
+
+
+def index(table, data, start, end):
+	for i in range(start, min(end, len(data) - MIN_MATCH + 1)):
+		key = bytes(data[i:i + MIN_MATCH])
+		positions = table.setdefault(key, [])
+		positions.append(i)
+		if len(positions) > MAX_CANDIDATES:
+			del positions[0]
+
+
+def diff(old, new):
+	out = bytearray(struct.pack(HEADER, b'DPT1', len(new), len(old),
+				    crc32(old), crc32(new)))
+	literal = bytearray()
+	old_table = {}
+	new_table = {}
+	index(old_table, old, 0, len(old))
+
+	o = 0
+	while o < len(new):
+		page_start = o - o % PAGE
+		key = bytes(new[o:o + MIN_MATCH])
+		ops = []
+
+		# The same place in the old image first, then anywhere in it
+		# that the bootloader still has when it gets there: not
+		# overwritten, or in one of the old pages it keeps. Copies
+		# from further back than that must end with the page.
+		window = page_start - OLD_PAGES * PAGE
+		for s in [o] + old_table.get(key, [])[::-1]:
+			if s < window or s >= len(old):
+				continue
+			limit = min(len(new) - o, len(old) - s)
+			if o - s > OLD_PAGES * PAGE:
+				limit = min(limit, page_start + PAGE - o)
+			n = match_len(old, s, new, o, limit)
+			ops.append((n, bytearray([OP_OLD]) + varint(n) +
+				    varint(zigzag(s - o))))
+
+		for q in new_table.get(key, [])[::-1]:
+			n = match_len(new, q, new, o, len(new) - o)
+			ops.append((n, bytearray([OP_NEW]) + varint(n) +
+				    varint(o - q)))
+
+		n = 1
+		while o + n < len(new) and new[o + n] == new[o]:
+			n += 1
+		ops.append((n, bytearray([OP_FILL]) + varint(n) +
+			    new[o:o + 1]))
+
+		# Whatever saves the most bytes over sending literals
+		n, op = max(ops, key=lambda op: op[0] - len(op[1]))
+		if n < MIN_MATCH or n <= len(op):
+			literal.append(new[o])
+			n = 1
+		else:
+			if literal:
+				out += bytearray([OP_LITERAL]) + \
+					varint(len(literal)) + literal
+				literal = bytearray()
+			out += op
+		index(new_table, new, o, o + n)
+		o += n
+
+	if literal:
+		out += bytearray([OP_LITERAL]) + varint(len(literal)) + literal
+	out.append(OP_END)
+	return out
+
+
+def apply(old, patch):
+	magic, new_size, old_size, old_crc, new_crc = \
+		struct.unpack_from(HEADER, bytes(patch))
+	if magic != b'DPT1':
+		raise ValueError('not a patch')
+	if old_size > len(old) or crc32(old[:old_size]) != old_crc:
+		raise ValueError('patch is not for this image')
+
+	def get_varint():
+		v, shift = 0, 0
+		while True:
+			c = patch[pos[0]]
+			pos[0] += 1
+			v |= (c & 0x7f) << shift
+			shift += 7
+			if not c & 0x80:
+				return v
+
+	pos = [struct.calcsize(HEADER)]
+	new = bytearray()
+	while True:
+		op = patch[pos[0]]
+		pos[0] += 1
+		if op == OP_END:
+			break
+		n = get_varint()
+		if op == OP_LITERAL:
+			new += patch[pos[0]:pos[0] + n]
+			pos[0] += n
+		elif op == OP_FILL:
+			new += patch[pos[0]:pos[0] + 1] * n
+			pos[0] += 1
+		elif op == OP_NEW:
+			dist = get_varint()
+			for i in range(n):
+				new.append(new[-dist])
+		elif op == OP_OLD:
+			zz = get_varint()
+			d = -(zz >> 1) - 1 if zz & 1 else zz >> 1
+			for i in range(n):
+				o = len(new)
+				if o + d < o - o % PAGE - OLD_PAGES * PAGE:
+					raise ValueError('reads an overwritten page')
+				new.append(old[o + d])
+		else:
+			raise ValueError('bad op %d' % op)
+	if len(new) != new_size or crc32(new) != new_crc:
+		raise ValueError('result does not match the patch')
+	return new
+
+
+# DFU requests and states, see the DFU 1.1 spec
+DFU_DNLOAD = 1
+DFU_GETSTATUS = 3
+DFU_CLRSTATUS = 4
+STATE_DNLOAD_IDLE = 5
+STATE_MANIFEST = 7
+STATE_ERROR = 10
+CMD_PATCH = 0x50
+TRANSFER_SIZE = 1024
+
+
+def get_status(dev):
+	s = bytearray(dev.ctrl_transfer(0xa1, DFU_GETSTATUS, 0, 0, 6))
+	return s[0], s[1] | (s[2] << 8) | (s[3] << 16), s[4]
+
+
+def download(dev, blocknum, data):
+	dev.ctrl_transfer(0x21, DFU_DNLOAD, blocknum, 0, data)
+	while True:
+		status, timeout, state = get_status(dev)
+		if state == STATE_ERROR:
+			raise IOError('block %d failed, DFU status %d' %
+				      (blocknum, status))
+		if state in (STATE_DNLOAD_IDLE, STATE_MANIFEST):
+			return state
+		time.sleep(timeout / 1000.0)
+
+
+def send(patch):
+	import usb.core
+
+	dev = usb.core.find(idVendor=0x0483, idProduct=0xdf11)
+	if dev is None:
+		raise ValueError('Device not found')
+	dev.set_configuration()
+	if get_status(dev)[2] == STATE_ERROR:
+		dev.ctrl_transfer(0x21, DFU_CLRSTATUS, 0, 0, None)
+
+	start = time.time()
+	download(dev, 0, bytearray([CMD_PATCH]) +
+		 struct.pack('<I', APP_ADDRESS))
+	for i in range(0, len(patch), TRANSFER_SIZE):
+		download(dev, 2 + i // TRANSFER_SIZE,
+			 patch[i:i + TRANSFER_SIZE])
+	# The image is checked while the last blocks are written, then
+	# manifestation resets the device
+	dev.ctrl_transfer(0x21, DFU_DNLOAD, 0, 0, None)
+	try:
+		get_status(dev)
+	except usb.core.USBError:
+		pass
+	print('%d bytes in %.2f s' % (len(patch), time.time() - start))
+
+
+def read(name):
+	if name == '-':
+		return bytearray()
+	with open(name, 'rb') as f:
+		return bytearray(f.read())
+
+
+def write(name, data):
+	with open(name, 'wb') as f:
+		f.write(data)
+
+
+def main():
+	cmd = sys.argv[1] if len(sys.argv) > 1 else None
+	if cmd == 'diff' and len(sys.argv) == 5:
+		old, new = read(sys.argv[2]), read(sys.argv[3])
+		patch = diff(old, new)
+		# Never hand out a patch the bootloader would get wrong
+		if apply(old, patch) != new:
+			raise ValueError('patch does not reproduce the image')
+		write(sys.argv[4], patch)
+		print('%d byte image, %d byte patch (%.1f%%)' %
+		      (len(new), len(patch), 100.0 * len(patch) / len(new)))
+	elif cmd == 'apply' and len(sys.argv) == 5:
+		write(sys.argv[4], apply(read(sys.argv[2]), read(sys.argv[3])))
+	elif cmd == 'send' and len(sys.argv) == 3:
+		send(read(sys.argv[2]))
+	else:
+		print('usage: %s diff old.bin|- new.bin patch.bin\n'
+		      '       %s apply old.bin|- patch.bin new.bin\n'
+		      '       %s send patch.bin' % ((sys.argv[0],) * 3))
+		sys.exit(1)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,274 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "patch.h"
+
+#define OP_END		0x00
+#define OP_LITERAL	0x01
+#define OP_OLD		0x02
+#define OP_NEW		0x03
+#define OP_FILL		0x04
+
+enum {
+	S_HEADER,
+	S_OP,
+	S_COUNT,	/* n varint */
+	S_ARG,		/* delta or dist varint */
+	S_FILL,		/* the fill byte */
+	S_LITERAL,
+	S_COPY,		/* output without input, old/new/fill */
+	S_END,
+	S_DONE,
+	S_ERROR,
+};
+
+/* CRC-32 as in zlib, bit at a time: no table, and fast enough for 128kB */
+uint32_t patch_crc32(const uint8_t *data, uint32_t len)
+{
+	uint32_t crc = 0xffffffff;
+	int i;
+
+	while (len--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint32_t get_le32(const uint8_t *b)
+{
+	return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+void patch_init(struct patch *p, const uint8_t *flash, uint32_t flash_size)
+{
+	memset(p, 0, sizeof(*p));
+	p->flash = flash;
+	p->flash_size = flash_size;
+	p->state = S_HEADER;
+}
+
+static int parse_header(struct patch *p)
+{
+	if (memcmp(p->header, "DPT1", 4))
+		return 0;
+	p->new_size = get_le32(p->header + 4);
+	p->old_size = get_le32(p->header + 8);
+	p->old_crc = get_le32(p->header + 12);
+	p->new_crc = get_le32(p->header + 16);
+	if (p->new_size > p->flash_size || p->old_size > p->flash_size)
+		return 0;
+	/* Nothing has been erased yet: refuse a patch for another image */
+	return patch_crc32(p->flash, p->old_size) == p->old_crc;
+}
+
+/* Accumulate a varint byte into *v, returns 1 when it is complete */
+static int varint(struct patch *p, uint32_t *v, uint8_t c)
+{
+	if (p->shift > 28) {
+		p->state = S_ERROR;
+		return 0;
+	}
+	*v |= (uint32_t)(c & 0x7f) << p->shift;
+	p->shift += 7;
+	return !(c & 0x80);
+}
+
+static void put(struct patch *p, uint8_t c)
+{
+	p->page[p->out % PATCH_PAGE_SIZE] = c;
+	p->out++;
+	if (p->out % PATCH_PAGE_SIZE == 0) {
+		p->page_offset = p->out - PATCH_PAGE_SIZE;
+		p->page_len = PATCH_PAGE_SIZE;
+		/* Last chance to keep what the caller is about to erase */
+		memcpy(p->old[p->page_offset / PATCH_PAGE_SIZE %
+			      PATCH_OLD_PAGES],
+		       p->flash + p->page_offset, PATCH_PAGE_SIZE);
+	}
+}
+
+/* One byte of a copy or fill, 0 if the patch reads where it must not */
+static int copy_byte(struct patch *p)
+{
+	uint32_t page_start = p->out - p->out % PATCH_PAGE_SIZE;
+	uint32_t src;
+
+	switch (p->op) {
+	case OP_OLD:
+		/* zigzag: even is forward, odd backward */
+		if (p->arg & 1)
+			src = p->out - (p->arg >> 1) - 1;
+		else
+			src = p->out + (p->arg >> 1);
+		/*
+		 * Earlier pages have been overwritten already, and going
+		 * back past the start wraps around to beyond old_size.
+		 */
+		if (src + PATCH_OLD_PAGES * PATCH_PAGE_SIZE < page_start ||
+		    src >= p->old_size)
+			return 0;
+		if (src >= page_start)
+			put(p, p->flash[src]);
+		else
+			put(p, p->old[src / PATCH_PAGE_SIZE % PATCH_OLD_PAGES]
+				     [src % PATCH_PAGE_SIZE]);
+		break;
+	case OP_NEW:
+		src = p->out - p->arg;
+		put(p, src >= page_start ? p->page[src % PATCH_PAGE_SIZE] :
+					   p->flash[src]);
+		break;
+	default:
+		put(p, p->fill);
+		break;
+	}
+	return 1;
+}
+
+/* An op has all its arguments, check what can be checked up front */
+static void start_op(struct patch *p)
+{
+	if (p->n > p->new_size - p->out ||
+	    (p->op == OP_NEW && (p->arg == 0 || p->arg > p->out))) {
+		p->state = S_ERROR;
+		return;
+	}
+	if (p->n == 0)
+		p->state = S_OP;
+	else if (p->op == OP_LITERAL)
+		p->state = S_LITERAL;
+	else
+		p->state = S_COPY;
+}
+
+enum patch_result patch_feed(struct patch *p, const uint8_t *in,
+			     uint16_t len, uint16_t *used)
+{
+	enum patch_result ret;
+	uint16_t i = 0;
+	uint8_t c;
+
+	for (;;) {
+		if (p->page_len) {
+			ret = PATCH_PAGE;
+			break;
+		}
+		if (p->state == S_ERROR) {
+			ret = PATCH_ERROR;
+			break;
+		}
+		if (p->state == S_COPY) {
+			while (p->n && !p->page_len) {
+				if (!copy_byte(p)) {
+					p->state = S_ERROR;
+					break;
+				}
+				p->n--;
+			}
+			if (!p->n && p->state == S_COPY)
+				p->state = S_OP;
+			continue;
+		}
+		if (p->state == S_END) {
+			if (p->out != p->new_size) {
+				p->state = S_ERROR;
+				continue;
+			}
+			/* The last page is usually only partly used */
+			if (p->out % PATCH_PAGE_SIZE) {
+				p->page_offset = p->out -
+						 p->out % PATCH_PAGE_SIZE;
+				p->page_len = p->out % PATCH_PAGE_SIZE;
+			}
+			p->state = S_DONE;
+			continue;
+		}
+		if (p->state == S_DONE) {
+			ret = PATCH_DONE;
+			break;
+		}
+		if (i == len) {
+			ret = PATCH_MORE;
+			break;
+		}
+
+		c = in[i++];
+		switch (p->state) {
+		case S_HEADER:
+			p->header[p->n++] = c;
+			if (p->n < PATCH_HEADER_SIZE)
+				break;
+			p->n = 0;
+			p->state = parse_header(p) ? S_OP : S_ERROR;
+			break;
+		case S_OP:
+			p->op = c;
+			p->n = 0;
+			p->shift = 0;
+			if (c == OP_END)
+				p->state = S_END;
+			else if (c <= OP_FILL)
+				p->state = S_COUNT;
+			else
+				p->state = S_ERROR;
+			break;
+		case S_COUNT:
+			if (!varint(p, &p->n, c))
+				break;
+			if (p->op == OP_LITERAL) {
+				start_op(p);
+			} else if (p->op == OP_FILL) {
+				p->state = S_FILL;
+			} else {
+				p->arg = 0;
+				p->shift = 0;
+				p->state = S_ARG;
+			}
+			break;
+		case S_ARG:
+			if (varint(p, &p->arg, c))
+				start_op(p);
+			break;
+		case S_FILL:
+			p->fill = c;
+			start_op(p);
+			break;
+		case S_LITERAL:
+			put(p, c);
+			if (--p->n == 0)
+				p->state = S_OP;
+			break;
+		}
+	}
+
+	*used = i;
+	return ret;
+}
+
+void patch_page_done(struct patch *p)
+{
+	p->page_len = 0;
+}
+
+int patch_verify(const struct patch *p)
+{
+	return p->state == S_DONE &&
+	       patch_crc32(p->flash, p->new_size) == p->new_crc;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PATCH_H
+#define __PATCH_H
+
+#include <stdint.h>
+
+/*
+ * Streaming decoder for firmware patches made by dfupatch.py.
+ *
+ * A patch rebuilds the new image from pieces of the image that is in
+ * flash now, from earlier parts of the new image (so a patch against
+ * nothing is plain LZ compression), byte fills and literal data:
+ *
+ *	header:	"DPT1", new size, old size, CRC-32 of the old image,
+ *		CRC-32 of the new image (little endian 32 bit each)
+ *	0x00			end
+ *	0x01 n data[n]		literal bytes
+ *	0x02 n delta		n bytes from the old image at the current
+ *				offset + delta (delta zigzag encoded)
+ *	0x03 n dist		n bytes from the new image, dist bytes back
+ *	0x04 n byte		n times byte
+ *
+ * where n, delta and dist are LEB128 varints.
+ *
+ * The new image is built in place of the old one, a flash page at a time:
+ * output collects in page[] and is handed back to the caller to erase
+ * and program when the page is complete. The pages before the current
+ * one therefore already hold the new image and the current one and those
+ * after it the old one, which is what the decoder reads from. Code that
+ * moved towards the start of the image would then have to be sent again
+ * for the first bytes of every page, so the old contents of the last few
+ * pages written are kept in RAM as well; patches that copy old data from
+ * further back than that are rejected.
+ */
+
+#define PATCH_PAGE_SIZE		1024
+#define PATCH_HEADER_SIZE	20
+/* Old pages kept, must match OLD_PAGES in dfupatch.py */
+#define PATCH_OLD_PAGES		4
+
+enum patch_result {
+	PATCH_MORE,		/* all input used, feed more */
+	PATCH_PAGE,		/* write out page[], then patch_page_done() */
+	PATCH_DONE,		/* image complete, see patch_verify() */
+	PATCH_ERROR,		/* bad patch, or not made for this image */
+};
+
+struct patch {
+	const uint8_t *flash;	/* the image, as mapped in memory */
+	uint32_t flash_size;	/* room for it */
+
+	uint8_t page[PATCH_PAGE_SIZE];
+	uint8_t old[PATCH_OLD_PAGES][PATCH_PAGE_SIZE];
+	uint32_t page_offset;	/* of a complete page[] in the image */
+	uint16_t page_len;	/* bytes to write, 0 while filling */
+
+	uint32_t out;		/* bytes of the new image produced */
+	uint32_t new_size, old_size, old_crc, new_crc;
+
+	uint8_t header[PATCH_HEADER_SIZE];
+	uint8_t state;
+	uint8_t op;
+	uint8_t shift;
+	uint8_t fill;
+	uint32_t n;		/* bytes left in the current op */
+	uint32_t arg;
+};
+
+uint32_t patch_crc32(const uint8_t *data, uint32_t len);
+
+void patch_init(struct patch *p, const uint8_t *flash, uint32_t flash_size);
+
+/*
+ * Decode from in[len], *used tells how much of it was consumed. Call again
+ * with the rest after PATCH_PAGE.
+ */
+enum patch_result patch_feed(struct patch *p, const uint8_t *in,
+			     uint16_t len, uint16_t *used);
+
+/* page[] has been written to flash at page_offset */
+void patch_page_done(struct patch *p);
+
+/* After PATCH_DONE: does flash hold the image the patch was made for? */
+int patch_verify(const struct patch *p);
+
+#endif
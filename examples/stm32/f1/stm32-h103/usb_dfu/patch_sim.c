@@ -0,0 +1,153 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of a patch download, built by 'make HOST=1'.
+ *
+ *	patch_sim.host old.bin|- patch.bin new.bin
+ *
+ * The application flash is a plain array holding old.bin (or erased, for
+ * '-'), and behaves like the STM32F1 one: erasing sets a page to 0xff,
+ * and programming a half word that is not erased fails. The patch is fed
+ * to the decoder in 1kB blocks as DFU_DNLOAD would, the pages it hands
+ * back are erased and programmed the way usbdfu.c does, and the result
+ * is compared with new.bin.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patch.h"
+
+#define SIM_BYTES	(56 * 1024)
+#define BLOCK_SIZE	1024
+
+static uint8_t flash[SIM_BYTES];
+static uint8_t image[SIM_BYTES];
+static uint8_t *patch_data;
+static struct patch patch;
+
+static long load(const char *name, uint8_t *buf, long max)
+{
+	FILE *f = fopen(name, "rb");
+	long len;
+
+	if (!f) {
+		perror(name);
+		exit(1);
+	}
+	len = fread(buf, 1, max, f);
+	if (!feof(f) && fgetc(f) != EOF) {
+		fprintf(stderr, "%s: bigger than %ld bytes\n", name, max);
+		exit(1);
+	}
+	fclose(f);
+	return len;
+}
+
+/* Erase and program patch.page[] the way patch_step() does */
+static int write_page(unsigned *programs)
+{
+	uint32_t addr = patch.page_offset;
+	uint16_t i;
+
+	memset(flash + addr, 0xff, PATCH_PAGE_SIZE);
+	for (i = 0; i < patch.page_len; i += 2) {
+		uint16_t data = patch.page[i];
+
+		if (i + 1 < patch.page_len)
+			data |= patch.page[i + 1] << 8;
+		else
+			data |= 0xff00;
+		if (data == 0xffff)
+			continue;
+		if (flash[addr + i] != 0xff || flash[addr + i + 1] != 0xff) {
+			printf("program over 0x%02x%02x at 0x%05x\n",
+			       flash[addr + i + 1], flash[addr + i],
+			       (unsigned)(addr + i));
+			return -1;
+		}
+		flash[addr + i] = data & 0xff;
+		flash[addr + i + 1] = data >> 8;
+		(*programs)++;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	enum patch_result res = PATCH_MORE;
+	unsigned erases = 0, programs = 0;
+	long patch_len, new_len, off;
+
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s old.bin|- patch.bin new.bin\n",
+			argv[0]);
+		return 1;
+	}
+
+	memset(flash, 0xff, sizeof(flash));
+	if (strcmp(argv[1], "-"))
+		load(argv[1], flash, sizeof(flash));
+	new_len = load(argv[3], image, sizeof(image));
+	patch_data = malloc(4 * SIM_BYTES);
+	patch_len = load(argv[2], patch_data, 4 * SIM_BYTES);
+
+	patch_init(&patch, flash, sizeof(flash));
+	for (off = 0; off < patch_len && res != PATCH_DONE; ) {
+		uint16_t len = patch_len - off > BLOCK_SIZE ?
+			       BLOCK_SIZE : patch_len - off;
+		uint16_t fed = 0, used;
+
+		do {
+			res = patch_feed(&patch, patch_data + off + fed,
+					 len - fed, &used);
+			fed += used;
+			if (res == PATCH_PAGE) {
+				if (write_page(&programs))
+					return 1;
+				erases++;
+				patch_page_done(&patch);
+			}
+		} while (res == PATCH_PAGE);
+		if (res == PATCH_ERROR) {
+			printf("patch rejected at block %ld\n",
+			       off / BLOCK_SIZE);
+			return 1;
+		}
+		off += len;
+	}
+
+	if (res != PATCH_DONE) {
+		printf("patch ended early\n");
+		return 1;
+	}
+	if (!patch_verify(&patch)) {
+		printf("CRC of the new image does not match\n");
+		return 1;
+	}
+	if (patch.new_size != new_len || memcmp(flash, image, new_len)) {
+		printf("flash differs from %s\n", argv[3]);
+		return 1;
+	}
+	printf("%ld byte patch, %u byte image: %u blocks, %u erases, "
+	       "%u half words programmed\n", patch_len, (unsigned)new_len,
+	       (unsigned)((patch_len + BLOCK_SIZE - 1) / BLOCK_SIZE),
+	       erases, programs);
+	free(patch_data);
+	return 0;
+}
@@ -22,6 +22,7 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/flash.h>
 #include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/dfu.h>
 
@@ -36,11 +37,35 @@ uint8_t usbd_control_buffer[1024];
 
 static enum dfu_state usbdfu_state = STATE_DFU_IDLE;
 
+/*
+ * Downloaded blocks are queued and programmed from the main loop, a few
+ * half words at a time between calls to usbd_poll(). With two buffers the
+ * host can send the next block while the previous one is being written,
+ * instead of waiting for each block to be programmed before sending the
+ * next.
+ */
+#define PROG_BUFS	2
+/* Half words programmed per prog_step(), about 1.7ms worth */
+#define PROG_CHUNK	32
+
+/* Typical F1 timings (datasheet), until we have measured our own */
+#define HALFWORD_US	53
+#define ERASE_US	20000
+
 static struct {
-	uint8_t buf[sizeof(usbd_control_buffer)];
-	uint16_t len;
+	struct {
+		uint8_t buf[sizeof(usbd_control_buffer)];
+		uint16_t len;
+		uint16_t blocknum;
+	} block[PROG_BUFS];
+	uint8_t head;			/* next block to fill */
+	uint8_t tail;			/* block being programmed */
+	uint16_t done;			/* bytes of block[tail] done so far */
 	uint32_t addr;
-	uint16_t blocknum;
+	enum dfu_status status;
+	/* measured cost of programming a half word and erasing a page */
+	uint32_t halfword_cycles;
+	uint32_t erase_cycles;
 } prog;
 
 const struct usb_device_descriptor dev = {
@@ -113,19 +138,147 @@ static const char *usb_strings[] = {
 	"@Internal Flash   /0x08000000/8*001Ka,56*001Kg",
 };
 
+static uint8_t prog_queued(void)
+{
+	return (uint8_t)(prog.head - prog.tail);
+}
+
+static void prog_reset(void)
+{
+	prog.head = prog.tail = 0;
+	prog.done = 0;
+	prog.status = DFU_STATUS_OK;
+}
+
+static void prog_fail(enum dfu_status status)
+{
+	prog_reset();
+	prog.status = status;
+	usbdfu_state = STATE_DFU_ERROR;
+}
+
+/*
+ * How long, in ms, until the first n queued blocks are programmed. This
+ * is what the host is told to wait before asking again, so it should be
+ * neither much too short (wasted requests) nor too long (an idle link).
+ */
+static uint32_t prog_busy_ms(uint8_t n)
+{
+	uint32_t cycles = 0;
+	uint8_t i;
+
+	for (i = 0; i < n && i < prog_queued(); i++) {
+		uint8_t b = (prog.tail + i) % PROG_BUFS;
+
+		if (prog.block[b].blocknum == 0) {
+			if (prog.block[b].buf[0] == CMD_ERASE)
+				cycles += prog.erase_cycles;
+		} else {
+			uint16_t left = prog.block[b].len;
+
+			if (i == 0)
+				left -= prog.done;
+			cycles += (left / 2) * prog.halfword_cycles;
+		}
+	}
+	return cycles / (rcc_ahb_frequency / 1000) + 1;
+}
+
+/*
+ * Do a bit of the programming work, if there is any. Returns 1 while
+ * there is more to do.
+ */
+static int prog_step(void)
+{
+	uint8_t b = prog.tail % PROG_BUFS;
+	uint8_t *buf = prog.block[b].buf;
+	uint32_t start, n = 0;
+
+	if (!prog_queued())
+		return 0;
+
+	flash_unlock();
+	flash_clear_status_flags();
+	start = dwt_read_cycle_counter();
+
+	if (prog.block[b].blocknum == 0) {
+		switch (buf[0]) {
+		case CMD_ERASE:
+			{
+				uint32_t *dat = (uint32_t *)(buf + 1);
+				flash_erase_page(*dat);
+				prog.erase_cycles =
+					dwt_read_cycle_counter() - start;
+			}
+			break;
+		case CMD_SETADDR:
+			{
+				uint32_t *dat = (uint32_t *)(buf + 1);
+				prog.addr = *dat;
+			}
+			break;
+		}
+		prog.done = prog.block[b].len;
+	} else {
+		uint32_t baseaddr = prog.addr + ((prog.block[b].blocknum - 2) *
+			       dfu_function.wTransferSize);
+		uint16_t end = prog.done + PROG_CHUNK * 2;
+
+		if (end > prog.block[b].len)
+			end = prog.block[b].len;
+		for (; prog.done < end; prog.done += 2) {
+			uint16_t *dat = (uint16_t *)(buf + prog.done);
+
+			/* Erased flash already reads 0xffff */
+			if (*dat == 0xffff)
+				continue;
+			flash_program_half_word(baseaddr + prog.done, *dat);
+			n++;
+		}
+		if (n) {
+			uint32_t per = (dwt_read_cycle_counter() - start) / n;
+
+			prog.halfword_cycles = (3 * prog.halfword_cycles +
+						per) / 4;
+		}
+	}
+
+	if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+		flash_lock();
+		prog_fail(DFU_STATUS_ERR_WRITE);
+		return 0;
+	}
+	flash_lock();
+
+	if (prog.done >= prog.block[b].len) {
+		prog.done = 0;
+		prog.tail++;
+	}
+	return prog_queued() != 0;
+}
+
 static uint8_t usbdfu_getstatus(usbd_device *usbd_dev, uint32_t *bwPollTimeout)
 {
 	(void)usbd_dev;
 
 	switch (usbdfu_state) {
 	case STATE_DFU_DNLOAD_SYNC:
-		usbdfu_state = STATE_DFU_DNBUSY;
-		*bwPollTimeout = 100;
+	case STATE_DFU_DNBUSY:
+		/* Ready for the next block as soon as a buffer is free. */
+		if (prog_queued() < PROG_BUFS) {
+			usbdfu_state = STATE_DFU_DNLOAD_IDLE;
+		} else {
+			usbdfu_state = STATE_DFU_DNBUSY;
+			*bwPollTimeout = prog_busy_ms(1);
+		}
 		return DFU_STATUS_OK;
 	case STATE_DFU_MANIFEST_SYNC:
 		/* Device will reset when read is complete. */
 		usbdfu_state = STATE_DFU_MANIFEST;
+		*bwPollTimeout = prog_busy_ms(PROG_BUFS);
 		return DFU_STATUS_OK;
+	case STATE_DFU_ERROR:
+		return prog.status;
 	default:
 		return DFU_STATUS_OK;
 	}
@@ -133,43 +286,15 @@ static uint8_t usbdfu_getstatus(usbd_device *usbd_dev, uint32_t *bwPollTimeout)
 
 static void usbdfu_getstatus_complete(usbd_device *usbd_dev, struct usb_setup_data *req)
 {
-	int i;
 	(void)req;
 	(void)usbd_dev;
 
 	switch (usbdfu_state) {
-	case STATE_DFU_DNBUSY:
-		flash_unlock();
-		if (prog.blocknum == 0) {
-			switch (prog.buf[0]) {
-			case CMD_ERASE:
-				{
-					uint32_t *dat = (uint32_t *)(prog.buf + 1);
-					flash_erase_page(*dat);
-				}
-				break;
-			case CMD_SETADDR:
-				{
-					uint32_t *dat = (uint32_t *)(prog.buf + 1);
-					prog.addr = *dat;
-				}
-				break;
-			}
-		} else {
-			uint32_t baseaddr = prog.addr + ((prog.blocknum - 2) *
-				       dfu_function.wTransferSize);
-			for (i = 0; i < prog.len; i += 2) {
-				uint16_t *dat = (uint16_t *)(prog.buf + i);
-				flash_program_half_word(baseaddr + i,
-						*dat);
-			}
-		}
-		flash_lock();
-
-		/* Jump straight to dfuDNLOAD-IDLE, skipping dfuDNLOAD-SYNC. */
-		usbdfu_state = STATE_DFU_DNLOAD_IDLE;
-		return;
 	case STATE_DFU_MANIFEST:
+		/* Finish whatever is still queued before going away. */
+		while (prog_step());
+		if (usbdfu_state == STATE_DFU_ERROR)
+			return;
 		/* USB device must detach, we just reset... */
 		scb_reset_system();
 		return; /* Will never return. */
@@ -186,23 +311,35 @@ static enum usbd_request_return_codes usbdfu_control_request(usbd_device *usbd_d
 
 	switch (req->bRequest) {
 	case DFU_DNLOAD:
+		/* A failed write has to be cleared with DFU_CLRSTATUS first */
+		if (usbdfu_state == STATE_DFU_ERROR)
+			return USBD_REQ_NOTSUPP;
 		if ((len == NULL) || (*len == 0)) {
 			usbdfu_state = STATE_DFU_MANIFEST_SYNC;
 		} else {
-			/* Copy download data for use on GET_STATUS. */
-			prog.blocknum = req->wValue;
-			prog.len = *len;
-			memcpy(prog.buf, *buf, *len);
+			uint8_t b = prog.head % PROG_BUFS;
+
+			/* GETSTATUS only says dfuDNLOAD-IDLE with a free buffer */
+			if (prog_queued() == PROG_BUFS)
+				return USBD_REQ_NOTSUPP;
+			/* Queue the download data for the main loop. */
+			prog.block[b].blocknum = req->wValue;
+			prog.block[b].len = *len;
+			memcpy(prog.block[b].buf, *buf, *len);
+			prog.head++;
 			usbdfu_state = STATE_DFU_DNLOAD_SYNC;
 		}
 		return USBD_REQ_HANDLED;
 	case DFU_CLRSTATUS:
 		/* Clear error and return to dfuIDLE. */
-		if (usbdfu_state == STATE_DFU_ERROR)
+		if (usbdfu_state == STATE_DFU_ERROR) {
 			usbdfu_state = STATE_DFU_IDLE;
+			prog.status = DFU_STATUS_OK;
+		}
 		return USBD_REQ_HANDLED;
 	case DFU_ABORT:
-		/* Abort returns to dfuIDLE state. */
+		/* Abort returns to dfuIDLE state, dropping what is queued. */
+		prog_reset();
 		usbdfu_state = STATE_DFU_IDLE;
 		return USBD_REQ_HANDLED;
 	case DFU_UPLOAD:
@@ -263,6 +400,15 @@ int main(void)
 
 	rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE8_72MHZ]);
 
+	/*
+	 * Program and erase times are measured in CPU cycles. They only
+	 * feed the bwPollTimeout estimate, so the bare counter does, and
+	 * prof.c's statistics and report code stay out of the bootloader.
+	 */
+	dwt_enable_cycle_counter();
+	prog.halfword_cycles = HALFWORD_US * (rcc_ahb_frequency / 1000000);
+	prog.erase_cycles = ERASE_US * (rcc_ahb_frequency / 1000000);
+
 	rcc_periph_clock_enable(RCC_GPIOA);
 	rcc_periph_clock_enable(RCC_AFIO);
 
@@ -276,6 +422,8 @@ int main(void)
 	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_2_MHZ,
 		      GPIO_CNF_OUTPUT_PUSHPULL, GPIO15);
 
-	while (1)
+	while (1) {
 		usbd_poll(usbd_dev);
+		prog_step();
+	}
 }
@@ -0,0 +1,192 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/flash.h>
+
+#include "kvstore.h"
+
+/* The last four 2kB pages of the 256kB flash */
+#define STORE_BASE	0x0803e000
+#define STORE_PAGES	4
+
+/* Key 0 counts the resets, the others are free for the console */
+#define KEY_BOOTS	0
+
+int _write(int file, char *ptr, int len);
+
+int kvstore_hw_erase(uint32_t offset)
+{
+	flash_clear_status_flags();
+	flash_erase_page(STORE_BASE + offset);
+	if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+		return -1;
+	}
+	return 0;
+}
+
+int kvstore_hw_program(uint32_t offset, uint32_t data)
+{
+	flash_clear_status_flags();
+	flash_program_word(STORE_BASE + offset, data);
+	if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+		return -1;
+	}
+	return 0;
+}
+
+static void usart_setup(void)
+{
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_AFIO);
+	rcc_periph_clock_enable(RCC_USART1);
+
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ,
+		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_USART1_TX);
+	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT,
+		      GPIO_USART1_RX);
+
+	usart_set_baudrate(USART1, 115200);
+	usart_set_databits(USART1, 8);
+	usart_set_stopbits(USART1, USART_STOPBITS_1);
+	usart_set_parity(USART1, USART_PARITY_NONE);
+	usart_set_mode(USART1, USART_MODE_TX_RX);
+	usart_set_flow_control(USART1, USART_FLOWCONTROL_NONE);
+	usart_enable(USART1);
+}
+
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	if (file == 1) {
+		for (i = 0; i < len; i++) {
+			if (ptr[i] == '\n') {
+				usart_send_blocking(USART1, '\r');
+			}
+			usart_send_blocking(USART1, ptr[i]);
+		}
+		return i;
+	}
+	errno = EIO;
+	return -1;
+}
+
+static void get_line(char *buf, int size)
+{
+	int n = 0;
+	char c;
+
+	for (;;) {
+		c = usart_recv_blocking(USART1);
+		if (c == '\r' || c == '\n') {
+			break;
+		}
+		if (n < size - 1) {
+			buf[n++] = c;
+			usart_send_blocking(USART1, c);
+		}
+	}
+	buf[n] = 0;
+	printf("\n");
+}
+
+static void show_stats(void)
+{
+	const struct kvstore_stats *stats = kvstore_get_stats();
+
+	printf("since boot: %lu writes, %lu unchanged, %lu erases, "
+	       "%lu records moved, %lu torn records found\n",
+	       (unsigned long)stats->writes, (unsigned long)stats->unchanged,
+	       (unsigned long)stats->page_erases,
+	       (unsigned long)stats->gc_copies,
+	       (unsigned long)stats->discarded);
+}
+
+/*
+ *	set <key> <text>
+ *	get <key>
+ *	del <key>
+ *	stats
+ */
+static void command(char *line)
+{
+	char value[KVSTORE_MAX_VALUE + 1];
+	char *arg = strchr(line, ' ');
+	unsigned long key = arg ? strtoul(arg + 1, &arg, 0) : 0;
+	int ret = KVSTORE_EINVAL;
+
+	if (key > 0xfffe) {
+		printf("keys go up to 0xfffe\n");
+		return;
+	}
+	if (!strncmp(line, "set ", 4) && *arg == ' ') {
+		ret = kvstore_set(key, arg + 1, strlen(arg + 1));
+	} else if (!strncmp(line, "get ", 4)) {
+		ret = kvstore_get(key, value, KVSTORE_MAX_VALUE);
+		if (ret >= 0) {
+			value[ret] = 0;
+			printf("%lu = \"%s\"\n", key, value);
+			return;
+		}
+	} else if (!strncmp(line, "del ", 4)) {
+		ret = kvstore_delete(key);
+	} else if (!strcmp(line, "stats")) {
+		show_stats();
+		return;
+	} else {
+		printf("set <key> <text> | get <key> | del <key> | stats\n");
+		return;
+	}
+	printf("%s\n", ret == KVSTORE_OK ? "ok" :
+		       ret == KVSTORE_NOENT ? "no such key" :
+		       ret == KVSTORE_FULL ? "store full" :
+		       ret == KVSTORE_EFLASH ? "flash error" : "bad key or value");
+}
+
+int main(void)
+{
+	char line[KVSTORE_MAX_VALUE + 16];
+	uint32_t boots = 0;
+	int ret;
+
+	rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE25_72MHZ]);
+	usart_setup();
+
+	flash_unlock();
+	ret = kvstore_init((const uint8_t *)STORE_BASE, STORE_PAGES);
+	if (ret) {
+		printf("kvstore_init: %d\n", ret);
+	}
+	kvstore_get(KEY_BOOTS, &boots, sizeof(boots));
+	boots++;
+	kvstore_set(KEY_BOOTS, &boots, sizeof(boots));
+	printf("\nboot %lu\n", (unsigned long)boots);
+	show_stats();
+
+	for (;;) {
+		printf("> ");
+		get_line(line, sizeof(line));
+		command(line);
+	}
+}
@@ -0,0 +1,525 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A log structured key/value store in internal flash.
+ *
+ * Rewriting a value in place would cost a page erase every time. Instead
+ * every set or delete appends a record to the current (head) page:
+ *
+ *	key | length << 16	(length 0x8000 marks a delete)
+ *	value, padded with 0xff to whole words
+ *	CRC-32 of the above
+ *
+ * and the latest record of a key is the one that counts. A RAM index maps
+ * each key to its latest record, so lookups never scan the flash.
+ *
+ * Each page starts with a sequence number, a magic word and a word that
+ * is written once the page swap that started it is complete. The pages
+ * are used round robin and one of them, the one after the head, is
+ * always erased. When the head is full the spare becomes the new head,
+ * the records still current in the oldest page (the one after that) are
+ * copied over, and the oldest page is erased to become the next spare.
+ * Every page is thus erased once per trip around the ring, however the
+ * writes are spread over the keys.
+ *
+ * Power can fail at any point. The header word of a record is written
+ * first, so a torn record still says how long it is and fails its CRC;
+ * the sequence number goes in before the magic word, so a page is only
+ * taken into use once its header is complete. At init, pages without a
+ * valid header are erased, and a page swap that was interrupted is
+ * finished: if the copies were complete the old page is not read at all,
+ * as it may be half erased; if not, it is intact and the copying starts
+ * over where it stopped (or from scratch, when a torn record took the
+ * room needed for the rest).
+ */
+
+#include <string.h>
+#include "kvstore.h"
+
+#define PAGE_MAGIC	0x3156564b	/* "KVV1" */
+#define PAGE_HEADER	12		/* sequence, magic, collected */
+#define PAGE_COLLECTED	8
+#define KEY_NONE	0xffff
+#define LEN_DELETED	0x8000
+#define BLANK		0xffffffff
+
+struct slot {
+	uint16_t key;		/* KEY_NONE when free */
+	uint16_t len;		/* as in the record header */
+	uint32_t offset;	/* of the latest record */
+};
+
+static struct slot slots[KVSTORE_MAX_KEYS];
+/* Flash taken by the records in the index, for the full check */
+static uint32_t live_bytes;
+
+static const uint8_t *store;
+static uint32_t store_pages;
+static uint32_t head;		/* page appended to */
+static uint32_t head_off;	/* next free byte in it */
+static uint32_t head_seq;
+
+static struct kvstore_stats stats;
+
+/* What the callback of the last page_scan() returned, if not 0 */
+static int scan_error;
+/* Bytes of records collect() would have to copy */
+static uint32_t pending;
+
+static uint32_t word_at(uint32_t offset)
+{
+	return *(const uint32_t *)(store + offset);
+}
+
+static uint32_t record_size(uint16_t len)
+{
+	return 8 + (((len & ~LEN_DELETED) + 3) & ~3);
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return crc;
+}
+
+/* CRC of a record header and its padded value */
+static uint32_t record_crc(uint32_t header, const uint8_t *data)
+{
+	uint16_t len = (header >> 16) & ~LEN_DELETED;
+	uint8_t pad = 0xff;
+	uint32_t crc = 0xffffffff;
+
+	crc = crc32_update(crc, (const uint8_t *)&header, 4);
+	crc = crc32_update(crc, data, len);
+	for (; len & 3; len++) {
+		crc = crc32_update(crc, &pad, 1);
+	}
+	return ~crc;
+}
+
+static int page_blank(uint32_t page)
+{
+	uint32_t offset;
+
+	for (offset = 0; offset < KVSTORE_PAGE_SIZE; offset += 4) {
+		if (word_at(page * KVSTORE_PAGE_SIZE + offset) != BLANK) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int page_valid(uint32_t page)
+{
+	return word_at(page * KVSTORE_PAGE_SIZE + 4) == PAGE_MAGIC;
+}
+
+static int erase(uint32_t page)
+{
+	stats.page_erases++;
+	return kvstore_hw_erase(page * KVSTORE_PAGE_SIZE);
+}
+
+static int program(uint32_t offset, uint32_t data)
+{
+	stats.word_programs++;
+	return kvstore_hw_program(offset, data);
+}
+
+static uint32_t slot_of(uint16_t key)
+{
+	return (key * 40503u) & (KVSTORE_MAX_KEYS - 1);
+}
+
+/* The slot holding key, or the free one where it would go; -1 if full */
+static int index_find(uint16_t key)
+{
+	uint32_t i = slot_of(key), n;
+
+	for (n = 0; n < KVSTORE_MAX_KEYS; n++) {
+		if (slots[i].key == key || slots[i].key == KEY_NONE) {
+			return i;
+		}
+		i = (i + 1) & (KVSTORE_MAX_KEYS - 1);
+	}
+	return -1;
+}
+
+/* Linear probing: move later entries of the run up into the hole */
+static void index_remove(uint32_t i)
+{
+	uint32_t j = i, k;
+
+	live_bytes -= record_size(slots[i].len);
+	for (;;) {
+		j = (j + 1) & (KVSTORE_MAX_KEYS - 1);
+		if (slots[j].key == KEY_NONE) {
+			break;
+		}
+		k = slot_of(slots[j].key);
+		/* can the entry at j live at i, i.e. is i in [k, j) ? */
+		if (((j - k) & (KVSTORE_MAX_KEYS - 1)) >=
+		    ((j - i) & (KVSTORE_MAX_KEYS - 1))) {
+			slots[i] = slots[j];
+			i = j;
+		}
+	}
+	slots[i].key = KEY_NONE;
+}
+
+static int index_update(uint16_t key, uint16_t len, uint32_t offset)
+{
+	int i = index_find(key);
+
+	if (i < 0) {
+		return KVSTORE_FULL;
+	}
+	if (slots[i].key == key) {
+		live_bytes -= record_size(slots[i].len);
+	}
+	slots[i].key = key;
+	slots[i].len = len;
+	slots[i].offset = offset;
+	live_bytes += record_size(len);
+	return KVSTORE_OK;
+}
+
+/*
+ * Walk the records of a page, calling fn for each intact one until it
+ * returns an error. Returns the offset in the page after the last
+ * record: where the next one goes.
+ */
+static uint32_t page_scan(uint32_t page,
+			  int (*fn)(uint16_t key, uint16_t len, uint32_t offset))
+{
+	uint32_t base = page * KVSTORE_PAGE_SIZE;
+	uint32_t offset = PAGE_HEADER, header, size;
+	uint16_t key, len;
+
+	scan_error = 0;
+	while (offset + 8 <= KVSTORE_PAGE_SIZE) {
+		header = word_at(base + offset);
+		if (header == BLANK) {
+			break;
+		}
+		key = header & 0xffff;
+		len = header >> 16;
+		size = record_size(len);
+		/*
+		 * A header torn in half, or an interrupted erase: nothing
+		 * after this can be trusted or written over.
+		 */
+		if (key == KEY_NONE ||
+		    (len & ~LEN_DELETED) > KVSTORE_MAX_VALUE ||
+		    offset + size > KVSTORE_PAGE_SIZE) {
+			return KVSTORE_PAGE_SIZE;
+		}
+		if (word_at(base + offset + size - 4) ==
+		    record_crc(header, store + base + offset + 4)) {
+			scan_error = fn(key, len, base + offset);
+			if (scan_error) {
+				return KVSTORE_PAGE_SIZE;
+			}
+		} else {
+			stats.discarded++;
+		}
+		offset += size;
+	}
+
+	/* Appending is only safe if an interrupted erase left no remains */
+	for (size = offset; size < KVSTORE_PAGE_SIZE; size += 4) {
+		if (word_at(base + size) != BLANK) {
+			return KVSTORE_PAGE_SIZE;
+		}
+	}
+	return offset;
+}
+
+static int replay_record(uint16_t key, uint16_t len, uint32_t offset)
+{
+	return index_update(key, len, offset);
+}
+
+static int current(uint16_t key, uint32_t offset)
+{
+	int i = index_find(key);
+
+	return i >= 0 && slots[i].key == key && slots[i].offset == offset;
+}
+
+static int measure_record(uint16_t key, uint16_t len, uint32_t offset)
+{
+	if (current(key, offset) && !(len & LEN_DELETED)) {
+		pending += record_size(len);
+	}
+	return 0;
+}
+
+/* Append a record, the header word first */
+static int append(uint32_t header, const uint8_t *data, uint32_t crc)
+{
+	uint32_t offset = head * KVSTORE_PAGE_SIZE + head_off;
+	uint16_t len = (header >> 16) & ~LEN_DELETED;
+	uint32_t i, word;
+	int ret;
+
+	/* Whatever happens, nothing more goes over a half written record */
+	head_off += record_size(header >> 16);
+
+	ret = program(offset, header);
+	for (i = 0; i < len && !ret; i += 4) {
+		word = BLANK;
+		memcpy(&word, data + i, len - i < 4 ? len - i : 4);
+		ret = program(offset + 4 + i, word);
+	}
+	if (!ret) {
+		ret = program(offset + 4 + ((len + 3) & ~3), crc);
+	}
+	if (ret) {
+		head_off = KVSTORE_PAGE_SIZE;
+		return KVSTORE_EFLASH;
+	}
+	return KVSTORE_OK;
+}
+
+/* Records of the page being collected that are still current */
+static int collect_record(uint16_t key, uint16_t len, uint32_t offset)
+{
+	uint32_t size = record_size(len);
+	int i = index_find(key);
+	int ret;
+
+	if (!current(key, offset)) {
+		return 0;
+	}
+	/* No older record can be left once this page is gone */
+	if (len & LEN_DELETED) {
+		index_remove(i);
+		return 0;
+	}
+	/* Fits: it came from a page no bigger than what is left */
+	slots[i].offset = head * KVSTORE_PAGE_SIZE + head_off;
+	ret = append(word_at(offset), store + offset + 4,
+		     word_at(offset + size - 4));
+	stats.gc_copies++;
+	return ret;
+}
+
+/* Move what is current out of a page into the head and erase it */
+static int collect(uint32_t page)
+{
+	uint32_t mark = head * KVSTORE_PAGE_SIZE + PAGE_COLLECTED;
+
+	if (page_valid(page)) {
+		page_scan(page, collect_record);
+		if (scan_error) {
+			return scan_error;
+		}
+	}
+	/* From here on the old page is not needed, even half erased */
+	if (word_at(mark) == BLANK && program(mark, page)) {
+		return KVSTORE_EFLASH;
+	}
+	if (!page_blank(page) && erase(page)) {
+		return KVSTORE_EFLASH;
+	}
+	return KVSTORE_OK;
+}
+
+/* Sequence number first: the magic word makes the page valid */
+static int start_page(uint32_t page, uint32_t seq)
+{
+	uint32_t offset = page * KVSTORE_PAGE_SIZE;
+
+	if (program(offset, seq) || program(offset + 4, PAGE_MAGIC)) {
+		return KVSTORE_EFLASH;
+	}
+	head = page;
+	head_seq = seq;
+	head_off = PAGE_HEADER;
+	return KVSTORE_OK;
+}
+
+/* The spare page becomes the head, the oldest page the next spare */
+static int advance(void)
+{
+	uint32_t next = (head + 1) % store_pages;
+	int ret;
+
+	ret = start_page(next, head_seq + 1);
+	if (ret) {
+		return ret;
+	}
+	return collect((next + 1) % store_pages);
+}
+
+int kvstore_init(const uint8_t *base, uint32_t pages)
+{
+	uint32_t page, spare, i;
+	int found = 0, collected;
+
+	if (pages < 2) {
+		return KVSTORE_EINVAL;
+	}
+	store = base;
+	store_pages = pages;
+	memset(slots, 0xff, sizeof(slots));
+	live_bytes = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	for (page = 0; page < pages; page++) {
+		if (page_valid(page) && (!found ||
+		    (int32_t)(word_at(page * KVSTORE_PAGE_SIZE) - head_seq) > 0)) {
+			head = page;
+			head_seq = word_at(page * KVSTORE_PAGE_SIZE);
+			found = 1;
+		}
+	}
+
+	/* Pages that are neither in use nor blank are erased */
+	for (page = 0; page < pages; page++) {
+		if (!page_valid(page) && !page_blank(page) && erase(page)) {
+			return KVSTORE_EFLASH;
+		}
+	}
+	if (!found) {
+		return start_page(0, 1);
+	}
+
+	/* Oldest first, so that the latest record of a key wins */
+	spare = (head + 1) % pages;
+	collected = word_at(head * KVSTORE_PAGE_SIZE + PAGE_COLLECTED) != BLANK;
+	for (i = 1; i <= pages; i++) {
+		page = (head + i) % pages;
+		if (page_valid(page) && !(page == spare && collected)) {
+			head_off = page_scan(page, replay_record);
+			if (scan_error) {
+				return scan_error;
+			}
+		}
+	}
+
+	if (collected) {
+		if (!page_blank(spare) && erase(spare)) {
+			return KVSTORE_EFLASH;
+		}
+		return KVSTORE_OK;
+	}
+
+	/* A swap that power failure interrupted while copying */
+	if (page_valid(spare)) {
+		pending = 0;
+		page_scan(spare, measure_record);
+		if (pending > KVSTORE_PAGE_SIZE - head_off) {
+			/* The old page is intact: forget the new one */
+			if (erase(head)) {
+				return KVSTORE_EFLASH;
+			}
+			return kvstore_init(base, pages);
+		}
+	}
+	return collect(spare);
+}
+
+int kvstore_get(uint16_t key, void *buf, uint16_t size)
+{
+	int i = index_find(key);
+	uint16_t len;
+
+	if (i < 0 || slots[i].key != key || (slots[i].len & LEN_DELETED)) {
+		return KVSTORE_NOENT;
+	}
+	len = slots[i].len;
+	memcpy(buf, store + slots[i].offset + 4, len < size ? len : size);
+	return len;
+}
+
+static int write_record(uint16_t key, uint16_t len, const uint8_t *data)
+{
+	uint32_t header = key | ((uint32_t)len << 16);
+	uint32_t size = record_size(len);
+	uint32_t capacity = (store_pages - 1) *
+			    (KVSTORE_PAGE_SIZE - PAGE_HEADER);
+	uint32_t n;
+	int i = index_find(key);
+	int ret;
+
+	if (i < 0) {
+		return KVSTORE_FULL;
+	}
+	/* The old record stays live until the new one is in */
+	if (live_bytes + size > capacity) {
+		return KVSTORE_FULL;
+	}
+	for (n = 0; head_off + size > KVSTORE_PAGE_SIZE; n++) {
+		if (n == store_pages) {
+			return KVSTORE_FULL;
+		}
+		ret = advance();
+		if (ret) {
+			return ret;
+		}
+	}
+
+	n = head * KVSTORE_PAGE_SIZE + head_off;
+	ret = append(header, data, record_crc(header, data));
+	if (ret) {
+		return ret;
+	}
+	stats.writes++;
+	return index_update(key, len, n);
+}
+
+int kvstore_set(uint16_t key, const void *data, uint16_t len)
+{
+	int i;
+
+	if (key == KEY_NONE || len > KVSTORE_MAX_VALUE) {
+		return KVSTORE_EINVAL;
+	}
+	i = index_find(key);
+	/* Counters and calibration are often written back unchanged */
+	if (i >= 0 && slots[i].key == key && slots[i].len == len &&
+	    !memcmp(store + slots[i].offset + 4, data, len)) {
+		stats.unchanged++;
+		return KVSTORE_OK;
+	}
+	return write_record(key, len, data);
+}
+
+int kvstore_delete(uint16_t key)
+{
+	int i = index_find(key);
+
+	if (i < 0 || slots[i].key != key || (slots[i].len & LEN_DELETED)) {
+		return KVSTORE_NOENT;
+	}
+	return write_record(key, LEN_DELETED, NULL);
+}
+
+const struct kvstore_stats *kvstore_get_stats(void)
+{
+	return &stats;
+}
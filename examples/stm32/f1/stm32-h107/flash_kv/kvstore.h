@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __KVSTORE_H
+#define __KVSTORE_H
+
+#include <stdint.h>
+
+#define KVSTORE_PAGE_SIZE	2048
+/* Index slots in RAM, a power of two, 8 bytes each */
+#define KVSTORE_MAX_KEYS	64
+#define KVSTORE_MAX_VALUE	256
+
+#define KVSTORE_OK		0
+#define KVSTORE_NOENT		-1	/* no such key */
+#define KVSTORE_FULL		-2	/* no room for the value, or the key */
+#define KVSTORE_EFLASH		-3	/* erase or program failed */
+#define KVSTORE_EINVAL		-4
+
+struct kvstore_stats {
+	uint32_t writes;		/* records appended for set/delete */
+	uint32_t unchanged;		/* sets skipped, same value */
+	uint32_t page_erases;
+	uint32_t word_programs;
+	uint32_t gc_copies;		/* live records moved to free a page */
+	uint32_t discarded;		/* torn records found at init */
+};
+
+/*
+ * The flash itself, provided by the caller: erase one page, or program
+ * one word that has been erased since it was last programmed. Both
+ * return 0 on success. Offsets are in bytes from the start of the store.
+ */
+int kvstore_hw_erase(uint32_t offset);
+int kvstore_hw_program(uint32_t offset, uint32_t data);
+
+/*
+ * The store is the memory mapped flash at base, pages (at least two)
+ * pages long. Init scans it, rebuilds the index, and finishes whatever
+ * a power failure interrupted; blank or foreign flash is formatted.
+ */
+int kvstore_init(const uint8_t *base, uint32_t pages);
+
+/* Copy up to size bytes of the value, returns its length or NOENT */
+int kvstore_get(uint16_t key, void *buf, uint16_t size);
+/* Keys are 0 to 0xfffe, values up to KVSTORE_MAX_VALUE bytes */
+int kvstore_set(uint16_t key, const void *data, uint16_t len);
+int kvstore_delete(uint16_t key);
+
+const struct kvstore_stats *kvstore_get_stats(void);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the key/value store, built by 'make HOST=1'.
+ *
+ * The flash is a plain array that behaves like the STM32F1 one: erasing
+ * sets a page to 0xff, and programming a word that is not erased fails.
+ * Power can be made to fail on any erase or program: a program then
+ * leaves only the first half word written (the F1 writes words as two
+ * half words), an erase leaves a random half of the page's words erased.
+ * After each failure the store is initialised again, as at the next
+ * boot, and every key must read back either as last acknowledged or, for
+ * the one being written when power failed, as it was going to be.
+ *
+ * Then a benchmark: how many updates a page erase buys for a few
+ * workloads, compared with rewriting a page for every update.
+ */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kvstore.h"
+
+#define SIM_MAX_PAGES	8
+#define SIM_KEYS	40
+
+static uint32_t flash[SIM_MAX_PAGES * KVSTORE_PAGE_SIZE / 4];
+static uint32_t page_erases[SIM_MAX_PAGES];
+static uint32_t sim_pages;
+static int errors;
+
+/* Operations until power fails, 0 for never */
+static uint32_t power_left;
+static jmp_buf power_fail;
+
+/* What the store should hold: length, or -1 for no such key */
+struct shadow {
+	int len;
+	uint8_t data[KVSTORE_MAX_VALUE];
+};
+static struct shadow shadow[SIM_KEYS];
+/* The set or delete in progress, as it would leave its key */
+static int inflight_key = -1;
+static struct shadow inflight;
+
+static int power_tick(void)
+{
+	return power_left && --power_left == 0;
+}
+
+int kvstore_hw_erase(uint32_t offset)
+{
+	uint32_t i, words = KVSTORE_PAGE_SIZE / 4;
+
+	if (power_tick()) {
+		for (i = 0; i < words; i++) {
+			if (rand() & 1) {
+				flash[offset / 4 + i] = 0xffffffff;
+			}
+		}
+		longjmp(power_fail, 1);
+	}
+	memset(&flash[offset / 4], 0xff, KVSTORE_PAGE_SIZE);
+	page_erases[offset / KVSTORE_PAGE_SIZE]++;
+	return 0;
+}
+
+int kvstore_hw_program(uint32_t offset, uint32_t data)
+{
+	if (flash[offset / 4] != 0xffffffff) {
+		printf("program of 0x%08x over 0x%08x at 0x%05x\n",
+		       (unsigned)data, (unsigned)flash[offset / 4],
+		       (unsigned)offset);
+		errors++;
+		return -1;
+	}
+	if (power_tick()) {
+		flash[offset / 4] = data | 0xffff0000;
+		longjmp(power_fail, 1);
+	}
+	flash[offset / 4] = data;
+	return 0;
+}
+
+static int same(int key, const struct shadow *expect)
+{
+	uint8_t buf[KVSTORE_MAX_VALUE];
+	int len = kvstore_get(key, buf, sizeof(buf));
+
+	if (expect->len < 0) {
+		return len == KVSTORE_NOENT;
+	}
+	return len == expect->len && !memcmp(buf, expect->data, len);
+}
+
+static void check(const char *when)
+{
+	int key;
+
+	for (key = 0; key < SIM_KEYS; key++) {
+		if (same(key, &shadow[key])) {
+			continue;
+		}
+		if (key == inflight_key && same(key, &inflight)) {
+			/* it made it after all */
+			shadow[key] = inflight;
+			continue;
+		}
+		printf("%s: key %d reads back wrong\n", when, key);
+		errors++;
+	}
+}
+
+static void mount(void)
+{
+	int ret = kvstore_init((const uint8_t *)flash, sim_pages);
+
+	if (ret) {
+		printf("init failed: %d\n", ret);
+		errors++;
+	}
+}
+
+static void reset(uint32_t pages)
+{
+	int key;
+
+	sim_pages = pages;
+	memset(flash, 0xff, sizeof(flash));
+	memset(page_erases, 0, sizeof(page_erases));
+	for (key = 0; key < SIM_KEYS; key++) {
+		shadow[key].len = -1;
+	}
+	power_left = 0;
+	mount();
+}
+
+/* One random set or delete, as a device would do between reboots */
+static void update(uint32_t n)
+{
+	int key = rand() % SIM_KEYS, i, ret;
+
+	inflight_key = key;
+	if (rand() % 16 == 0) {
+		inflight.len = -1;
+		ret = kvstore_delete(key);
+		if (ret == KVSTORE_NOENT && shadow[key].len < 0) {
+			ret = KVSTORE_OK;
+		}
+	} else {
+		/* mostly counters, some longer calibration blobs */
+		inflight.len = key < 30 ? 4 : 8 + (key * 7) % 90;
+		for (i = 0; i < inflight.len; i++) {
+			inflight.data[i] = n + i * key;
+		}
+		ret = kvstore_set(key, inflight.data, inflight.len);
+	}
+	if (ret) {
+		printf("update %u of key %d failed: %d\n", (unsigned)n, key, ret);
+		errors++;
+	}
+	shadow[key] = inflight;
+	inflight_key = -1;
+}
+
+/*
+ * Every operation in a run of updates, in turn, fails: the store starts
+ * from the same state each time and carries on after the power failure.
+ */
+static void power_fail_sweep(uint32_t pages, uint32_t updates)
+{
+	struct kvstore_stats total;
+	uint32_t ops, fail_at;
+	volatile uint32_t n;	/* kept across longjmp() */
+
+	reset(pages);
+	srand(1);
+	for (n = 0; n < updates; n++) {
+		update(n);
+	}
+	total = *kvstore_get_stats();
+	ops = total.word_programs + total.page_erases;
+
+	for (fail_at = 1; fail_at <= ops; fail_at++) {
+		reset(pages);
+		srand(1);
+		n = 0;
+		power_left = fail_at;
+		if (setjmp(power_fail)) {
+			power_left = 0;
+			mount();
+			check("after power failure");
+			mount();
+			check("after second boot");
+			n++;
+		}
+		for (; n < updates; n++) {
+			update(n);
+		}
+		power_left = 0;
+		check("at the end");
+	}
+	printf("%u pages: power failed at each of %u erase/program "
+	       "operations, %s\n", (unsigned)pages, (unsigned)ops,
+	       errors ? "FAILED" : "recovered every time");
+}
+
+/* Power fails every few hundred operations, for a long time */
+static void power_fail_random(uint32_t pages, uint32_t updates)
+{
+	volatile uint32_t n = 0, failures = 0;
+
+	reset(pages);
+	srand(2);
+	if (setjmp(power_fail)) {
+		failures++;
+		/* sometimes power fails again while the store recovers */
+		if (rand() % 4 == 0) {
+			power_left = 1 + rand() % 40;
+		}
+		mount();
+		power_left = 0;
+		check("after power failure");
+		n++;
+	}
+	while (n < updates) {
+		if (!power_left) {
+			power_left = 1 + rand() % 600;
+		}
+		update(n++);
+	}
+	power_left = 0;
+	mount();
+	check("at the end");
+	printf("%u pages: %u updates, %u power failures, %s\n",
+	       (unsigned)pages, (unsigned)updates, (unsigned)failures,
+	       errors ? "FAILED" : "recovered every time");
+}
+
+static void bench(const char *name, uint32_t pages, int keys, int len,
+		  uint32_t updates)
+{
+	const struct kvstore_stats *stats;
+	uint8_t value[KVSTORE_MAX_VALUE];
+	uint32_t n, max = 0, i;
+
+	reset(pages);
+	for (n = 0; n < updates; n++) {
+		memset(value, 0, sizeof(value));
+		memcpy(value, &n, sizeof(n));
+		if (kvstore_set(n % keys, value, len)) {
+			printf("%s: set failed\n", name);
+			errors++;
+			return;
+		}
+	}
+	stats = kvstore_get_stats();
+	for (i = 0; i < pages; i++) {
+		if (page_erases[i] > max) {
+			max = page_erases[i];
+		}
+	}
+	printf("%-24s %u pages  %7u writes  %5u erases  %6.1f writes/erase"
+	       "  %5u copies  max %u erases/page\n", name, (unsigned)pages,
+	       (unsigned)stats->writes, (unsigned)stats->page_erases,
+	       (double)stats->writes / stats->page_erases,
+	       (unsigned)stats->gc_copies, (unsigned)max);
+}
+
+int main(void)
+{
+	power_fail_sweep(2, 300);
+	power_fail_sweep(4, 300);
+	power_fail_random(2, 100000);
+	power_fail_random(5, 100000);
+
+	/* rewriting a page each time would be 1 write/erase */
+	bench("1 counter", 2, 1, 4, 100000);
+	bench("8 counters", 2, 8, 4, 100000);
+	bench("8 counters", 4, 8, 4, 100000);
+	bench("24 x 64 byte calibration", 2, 24, 64, 20000);
+	bench("24 x 64 byte calibration", 4, 24, 64, 20000);
+	bench("24 x 64 byte calibration", 8, 24, 64, 20000);
+
+	printf("%s\n", errors ? "FAILED" : "OK");
+	return errors ? 1 : 0;
+}
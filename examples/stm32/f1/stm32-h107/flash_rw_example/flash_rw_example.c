@@ -21,6 +21,7 @@
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/flash.h>
+#include <libopencm3/stm32/crc.h>
 
 #define USART_ECHO_EN 1
 #define SEND_BUFFER_SIZE 256
@@ -30,6 +31,10 @@
 #define FLASH_WRONG_DATA_WRITTEN 0x80
 #define RESULT_OK 0
 
+/*pages the last flash_program_data() call rewrote, or found unchanged*/
+static uint16_t flash_pages_written;
+static uint16_t flash_pages_skipped;
+
 /*hardware initialization*/
 static void init_system(void);
 static void init_usart(void);
@@ -37,6 +42,7 @@ static void init_usart(void);
 static void usart_send_string(uint32_t usart, uint8_t *string, uint16_t str_size);
 static void usart_get_string(uint32_t usart, uint8_t *string, uint16_t str_max_size);
 /*flash operations*/
+static uint32_t flash_crc(const uint32_t *data, uint16_t num_words);
 static uint32_t flash_program_data(uint32_t start_address, uint8_t *input_data, uint16_t num_elements);
 static void flash_read_data(uint32_t start_address, uint16_t num_elements, uint8_t *output_data);
 /*local functions to work with strings*/
@@ -61,6 +67,12 @@ int main(void)
 			usart_send_string(USART1, (uint8_t*)"Verification of written data: ", SEND_BUFFER_SIZE);
 			flash_read_data(FLASH_OPERATION_ADDRESS, SEND_BUFFER_SIZE, str_verify);
 			usart_send_string(USART1, str_verify, SEND_BUFFER_SIZE);
+			usart_send_string(USART1, (uint8_t*)"\r\nPages rewritten: ", SEND_BUFFER_SIZE);
+			local_ltoa_hex(flash_pages_written, str_send);
+			usart_send_string(USART1, str_send, SEND_BUFFER_SIZE);
+			usart_send_string(USART1, (uint8_t*)", unchanged: ", SEND_BUFFER_SIZE);
+			local_ltoa_hex(flash_pages_skipped, str_send);
+			usart_send_string(USART1, str_send, SEND_BUFFER_SIZE);
 			break;
 		case FLASH_WRONG_DATA_WRITTEN: /*data read from Flash is different than written data*/
 			usart_send_string(USART1, (uint8_t*)"Wrong data written into flash memory", SEND_BUFFER_SIZE);
@@ -81,6 +93,8 @@ static void init_system(void)
 {
 	/* setup SYSCLK to work with 64Mhz HSI */
 	rcc_clock_setup_pll(&rcc_hsi_configs[RCC_CLOCK_HSI_64MHZ]);
+	/* CRC unit, to compare and verify flash contents */
+	rcc_periph_clock_enable(RCC_CRC);
 	init_usart();
 }
 
@@ -135,44 +149,87 @@ static void usart_get_string(uint32_t usart, uint8_t *out_string, uint16_t str_m
 	}
 }
 
+static uint32_t flash_crc(const uint32_t *data, uint16_t num_words)
+{
+	crc_reset();
+	return crc_calculate_block((uint32_t*)data, num_words);
+}
+
+/*
+ * Program num_elements bytes (a multiple of 4) page by page. A page is
+ * compared with the new data by CRC first and left alone if it already
+ * holds it, which saves both the erase cycle and the time; written pages
+ * are verified by CRC as well. The rest of a page that is rewritten is
+ * erased, as before.
+ */
 static uint32_t flash_program_data(uint32_t start_address, uint8_t *input_data, uint16_t num_elements)
 {
 	uint16_t iter;
 	uint32_t current_address = start_address;
-	uint32_t page_address = start_address;
+	uint32_t end_address = start_address + num_elements;
+	uint32_t page_address, chunk, data_crc;
 	uint32_t flash_status = 0;
 
-	/*check if start_address is in proper range*/
-	if((start_address - FLASH_BASE) >= (FLASH_PAGE_SIZE * (FLASH_PAGE_NUM_MAX+1)))
+	/*check if the whole range is in flash, and made of words*/
+	if((start_address - FLASH_BASE) >= (FLASH_PAGE_SIZE * (FLASH_PAGE_NUM_MAX+1)) ||
+	   (end_address - FLASH_BASE) > (FLASH_PAGE_SIZE * (FLASH_PAGE_NUM_MAX+1)) ||
+	   (start_address % 4) || (num_elements % 4))
 		return 1;
 
-	/*calculate current page address*/
-	if(start_address % FLASH_PAGE_SIZE)
-		page_address -= (start_address % FLASH_PAGE_SIZE);
+	flash_pages_written = 0;
+	flash_pages_skipped = 0;
 
-	flash_unlock();
+	while(current_address < end_address)
+	{
+		/*calculate current page address, and how much of the data goes there*/
+		page_address = current_address - (current_address % FLASH_PAGE_SIZE);
+		chunk = page_address + FLASH_PAGE_SIZE - current_address;
+		if(chunk > end_address - current_address)
+			chunk = end_address - current_address;
 
-	/*Erasing page*/
-	flash_erase_page(page_address);
-	flash_status = flash_get_status_flags();
-	if(flash_status != FLASH_SR_EOP)
-		return flash_status;
+		data_crc = flash_crc((uint32_t*)input_data, chunk / 4);
+		if(flash_crc((uint32_t*)current_address, chunk / 4) == data_crc)
+		{
+			flash_pages_skipped++;
+		}
+		else
+		{
+			flash_unlock();
 
-	/*programming flash memory*/
-	for(iter=0; iter<num_elements; iter += 4)
-	{
-		/*programming word data*/
-		flash_program_word(current_address+iter, *((uint32_t*)(input_data + iter)));
-		flash_status = flash_get_status_flags();
-		if(flash_status != FLASH_SR_EOP)
-			return flash_status;
-
-		/*verify if correct data is programmed*/
-		if(*((uint32_t*)(current_address+iter)) != *((uint32_t*)(input_data + iter)))
-			return FLASH_WRONG_DATA_WRITTEN;
+			/*Erasing page*/
+			flash_erase_page(page_address);
+			flash_status = flash_get_status_flags();
+			if(flash_status != FLASH_SR_EOP)
+			{
+				flash_lock();
+				return flash_status;
+			}
+
+			/*programming flash memory*/
+			for(iter=0; iter<chunk; iter += 4)
+			{
+				/*programming word data*/
+				flash_program_word(current_address+iter, *((uint32_t*)(input_data + iter)));
+				flash_status = flash_get_status_flags();
+				if(flash_status != FLASH_SR_EOP)
+				{
+					flash_lock();
+					return flash_status;
+				}
+			}
+			flash_lock();
+
+			/*verify if correct data is programmed*/
+			if(flash_crc((uint32_t*)current_address, chunk / 4) != data_crc)
+				return FLASH_WRONG_DATA_WRITTEN;
+			flash_pages_written++;
+		}
+
+		current_address += chunk;
+		input_data += chunk;
 	}
 
-	return 0;
+	return RESULT_OK;
 }
 
 static void flash_read_data(uint32_t start_address, uint16_t num_elements, uint8_t *output_data)
@@ -0,0 +1,261 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A block device in internal flash, with a write-back page cache.
+ *
+ * The host reads and writes 512 byte sectors, the flash is erased in
+ * 2kB pages. Writing a sector straight through would cost a page erase
+ * and 1024 half word programs every time, and a file system rewrites its
+ * FAT and directory sectors over and over during a copy.
+ *
+ * So writes only go into a small cache of whole pages, tracking which
+ * sectors of each page have been written. A page goes to flash when its
+ * slot is needed for another page (least recently used first) or on
+ * flashdisk_flush(), which the main loop calls once the host has been
+ * quiet for a while. A sequential copy thus costs one erase per page,
+ * however the host splits it up, and a sector rewritten ten times costs
+ * one write-back.
+ *
+ * Erasing is lazy as well: a page is only erased if one of its half
+ * words has to change from anything but 0xffff. Data that is the same
+ * as what is in flash is not written at all, and data landing on
+ * erased flash is just programmed.
+ *
+ * Reads need no cache of their own: the flash is memory mapped and as
+ * fast to copy from as RAM, so sectors come straight from there unless
+ * the cache holds a newer copy.
+ */
+
+#include <string.h>
+#include "flashdisk.h"
+
+#define ALL_SECTORS	((1 << FLASHDISK_SECTORS_PER_PAGE) - 1)
+
+struct cache_slot {
+	int32_t page;		/* -1 when free */
+	uint8_t valid;		/* sectors of buf that hold data */
+	uint8_t dirty;		/* sectors of buf that flash does not have */
+	uint32_t used;		/* for LRU replacement */
+	uint16_t buf[FLASHDISK_PAGE_SIZE / 2];
+};
+
+static struct cache_slot cache[FLASHDISK_CACHE_PAGES];
+static uint32_t use_clock;
+
+static const uint8_t *disk;
+static uint32_t disk_pages;
+
+static struct flashdisk_stats stats;
+
+static struct cache_slot *cache_find(uint32_t page)
+{
+	int i;
+
+	for (i = 0; i < FLASHDISK_CACHE_PAGES; i++) {
+		if (cache[i].page == (int32_t)page) {
+			return &cache[i];
+		}
+	}
+	return NULL;
+}
+
+static int cache_write_back(struct cache_slot *slot)
+{
+	const uint16_t *flash;
+	uint32_t offset, i;
+	int need_erase = 0, changed = 0;
+	uint8_t sector;
+
+	if (!slot->dirty) {
+		return 0;
+	}
+
+	offset = slot->page * FLASHDISK_PAGE_SIZE;
+	flash = (const uint16_t *)(disk + offset);
+
+	/* The sectors the host did not write keep what flash has */
+	for (sector = 0; sector < FLASHDISK_SECTORS_PER_PAGE; sector++) {
+		if (!(slot->valid & (1 << sector))) {
+			memcpy((uint8_t *)slot->buf +
+			       sector * FLASHDISK_SECTOR_SIZE,
+			       disk + offset + sector * FLASHDISK_SECTOR_SIZE,
+			       FLASHDISK_SECTOR_SIZE);
+		}
+	}
+	slot->valid = ALL_SECTORS;
+
+	/* A half word can only be programmed once after an erase */
+	for (i = 0; i < FLASHDISK_PAGE_SIZE / 2; i++) {
+		if (flash[i] != slot->buf[i]) {
+			changed = 1;
+			if (flash[i] != 0xffff) {
+				need_erase = 1;
+				break;
+			}
+		}
+	}
+
+	if (changed) {
+		if (need_erase) {
+			if (flashdisk_hw_erase(offset)) {
+				return -1;
+			}
+			stats.page_erases++;
+		} else {
+			stats.clean_flushes++;
+		}
+		for (i = 0; i < FLASHDISK_PAGE_SIZE / 2; i++) {
+			if (slot->buf[i] == flash[i]) {
+				continue;
+			}
+			if (flashdisk_hw_program(offset + i * 2,
+						 slot->buf[i])) {
+				return -1;
+			}
+			stats.halfword_programs++;
+		}
+		stats.page_flushes++;
+	}
+	slot->dirty = 0;
+	return changed;
+}
+
+/* The slot for page, making room for it if it is not cached yet */
+static struct cache_slot *cache_get(uint32_t page)
+{
+	struct cache_slot *slot = cache_find(page);
+	int i;
+
+	if (slot) {
+		return slot;
+	}
+
+	slot = &cache[0];
+	for (i = 0; i < FLASHDISK_CACHE_PAGES; i++) {
+		if (cache[i].page < 0) {
+			slot = &cache[i];
+			break;
+		}
+		if (cache[i].used < slot->used) {
+			slot = &cache[i];
+		}
+	}
+	if (cache_write_back(slot) < 0) {
+		return NULL;
+	}
+	slot->page = page;
+	slot->valid = 0;
+	slot->dirty = 0;
+	return slot;
+}
+
+void flashdisk_init(const uint8_t *base, uint32_t pages)
+{
+	int i;
+
+	disk = base;
+	disk_pages = pages;
+	for (i = 0; i < FLASHDISK_CACHE_PAGES; i++) {
+		cache[i].page = -1;
+		cache[i].valid = 0;
+		cache[i].dirty = 0;
+	}
+	memset(&stats, 0, sizeof(stats));
+}
+
+int flashdisk_read(uint32_t lba, uint8_t *copy_to)
+{
+	uint32_t page = lba / FLASHDISK_SECTORS_PER_PAGE;
+	uint8_t sector = lba % FLASHDISK_SECTORS_PER_PAGE;
+	struct cache_slot *slot;
+
+	if (page >= disk_pages) {
+		return -1;
+	}
+
+	slot = cache_find(page);
+	if (slot && (slot->valid & (1 << sector))) {
+		memcpy(copy_to,
+		       (uint8_t *)slot->buf + sector * FLASHDISK_SECTOR_SIZE,
+		       FLASHDISK_SECTOR_SIZE);
+	} else {
+		memcpy(copy_to, disk + lba * FLASHDISK_SECTOR_SIZE,
+		       FLASHDISK_SECTOR_SIZE);
+	}
+	stats.sector_reads++;
+	return 0;
+}
+
+int flashdisk_write(uint32_t lba, const uint8_t *copy_from)
+{
+	uint32_t page = lba / FLASHDISK_SECTORS_PER_PAGE;
+	uint8_t sector = lba % FLASHDISK_SECTORS_PER_PAGE;
+	struct cache_slot *slot;
+
+	if (page >= disk_pages) {
+		return -1;
+	}
+
+	slot = cache_get(page);
+	if (!slot) {
+		return -1;
+	}
+	memcpy((uint8_t *)slot->buf + sector * FLASHDISK_SECTOR_SIZE,
+	       copy_from, FLASHDISK_SECTOR_SIZE);
+	slot->valid |= 1 << sector;
+	slot->dirty |= 1 << sector;
+	slot->used = ++use_clock;
+	stats.sector_writes++;
+	return 0;
+}
+
+int flashdisk_blocks(void)
+{
+	return disk_pages * FLASHDISK_SECTORS_PER_PAGE;
+}
+
+int flashdisk_flush(void)
+{
+	int i, n = 0, ret;
+
+	for (i = 0; i < FLASHDISK_CACHE_PAGES; i++) {
+		ret = cache_write_back(&cache[i]);
+		if (ret < 0) {
+			return ret;
+		}
+		n += ret;
+	}
+	return n;
+}
+
+int flashdisk_dirty(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < FLASHDISK_CACHE_PAGES; i++) {
+		if (cache[i].dirty) {
+			n++;
+		}
+	}
+	return n;
+}
+
+const struct flashdisk_stats *flashdisk_get_stats(void)
+{
+	return &stats;
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FLASHDISK_H
+#define __FLASHDISK_H
+
+#include <stdint.h>
+
+#define FLASHDISK_SECTOR_SIZE	512
+#define FLASHDISK_PAGE_SIZE	2048
+#define FLASHDISK_SECTORS_PER_PAGE \
+	(FLASHDISK_PAGE_SIZE / FLASHDISK_SECTOR_SIZE)
+
+/* Pages held in RAM, each costs FLASHDISK_PAGE_SIZE bytes */
+#define FLASHDISK_CACHE_PAGES	8
+
+struct flashdisk_stats {
+	uint32_t sector_reads;
+	uint32_t sector_writes;
+	uint32_t page_erases;
+	uint32_t halfword_programs;
+	uint32_t page_flushes;		/* dirty pages written back */
+	uint32_t clean_flushes;		/* ... of which needed no erase */
+};
+
+/*
+ * The flash itself, provided by the caller: erase one page, or program
+ * one half word in a page that has been erased since it was last
+ * programmed. Both return 0 on success. Offsets are in bytes from the
+ * start of the disk.
+ */
+int flashdisk_hw_erase(uint32_t offset);
+int flashdisk_hw_program(uint32_t offset, uint16_t data);
+
+/*
+ * The disk is the memory mapped flash at base, pages pages long. Reads
+ * come straight from there unless the sector has a newer copy in the
+ * cache.
+ */
+void flashdisk_init(const uint8_t *base, uint32_t pages);
+
+/* Callbacks for usb_msc_init() */
+int flashdisk_read(uint32_t lba, uint8_t *copy_to);
+int flashdisk_write(uint32_t lba, const uint8_t *copy_from);
+int flashdisk_blocks(void);
+
+/* Write back every dirty page, returns the number of pages written */
+int flashdisk_flush(void);
+/* Number of cached pages that have not been written back yet */
+int flashdisk_dirty(void);
+
+const struct flashdisk_stats *flashdisk_get_stats(void);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of the flash disk, built by 'make HOST=1'.
+ *
+ * The flash is a plain array that behaves like the STM32F1 one: erasing
+ * sets a page to 0xff, and programming a half word that is not erased
+ * fails (PGERR on the real thing). A few host-like write patterns are run
+ * through the cache, every sector is checked against a shadow copy of
+ * what the host wrote, and the erase counts are compared with writing
+ * every sector straight through (one erase per sector written).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flashdisk.h"
+
+#define SIM_PAGES	64
+#define SIM_SECTORS	(SIM_PAGES * FLASHDISK_SECTORS_PER_PAGE)
+#define SIM_BYTES	(SIM_PAGES * FLASHDISK_PAGE_SIZE)
+
+static uint16_t flash[SIM_BYTES / 2];
+static uint8_t shadow[SIM_BYTES];
+static uint32_t page_erases[SIM_PAGES];
+static int errors;
+
+int flashdisk_hw_erase(uint32_t offset)
+{
+	memset((uint8_t *)flash + offset, 0xff, FLASHDISK_PAGE_SIZE);
+	page_erases[offset / FLASHDISK_PAGE_SIZE]++;
+	return 0;
+}
+
+int flashdisk_hw_program(uint32_t offset, uint16_t data)
+{
+	if (flash[offset / 2] != 0xffff) {
+		printf("program of 0x%04x over 0x%04x at 0x%05x\n",
+		       data, flash[offset / 2], (unsigned)offset);
+		errors++;
+		return -1;
+	}
+	flash[offset / 2] = data;
+	return 0;
+}
+
+static void host_write(uint32_t lba, uint32_t seed)
+{
+	uint8_t buf[FLASHDISK_SECTOR_SIZE];
+	uint32_t i;
+
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = (seed * 2654435761u + i * 40503u) >> 13;
+	}
+	if (flashdisk_write(lba, buf)) {
+		printf("write of sector %u failed\n", (unsigned)lba);
+		errors++;
+	}
+	memcpy(shadow + lba * FLASHDISK_SECTOR_SIZE, buf, sizeof(buf));
+}
+
+static void check_reads(const char *when)
+{
+	uint8_t buf[FLASHDISK_SECTOR_SIZE];
+	uint32_t lba;
+
+	for (lba = 0; lba < SIM_SECTORS; lba++) {
+		flashdisk_read(lba, buf);
+		if (memcmp(buf, shadow + lba * FLASHDISK_SECTOR_SIZE,
+			   sizeof(buf))) {
+			printf("%s: sector %u reads back wrong\n", when,
+			       (unsigned)lba);
+			errors++;
+			return;
+		}
+	}
+}
+
+/*
+ * A file system copying a file: data clusters in 8kB runs, each followed
+ * by an update of both FAT copies and the directory entry.
+ */
+static void copy_file(uint32_t seed)
+{
+	uint32_t lba, first = 40, sectors = 160;
+
+	for (lba = 0; lba < sectors; lba++) {
+		host_write(first + lba, seed + lba);
+		if (lba % 16 == 15 || lba == sectors - 1) {
+			host_write(1, seed + 1000 + lba);
+			host_write(5, seed + 2000 + lba);
+			host_write(9, seed + 3000 + lba);
+		}
+	}
+}
+
+static void random_writes(uint32_t seed)
+{
+	uint32_t n;
+
+	srand(seed);
+	for (n = 0; n < 2000; n++) {
+		host_write(rand() % SIM_SECTORS, seed + n);
+	}
+}
+
+static void run(const char *name, void (*workload)(uint32_t), uint32_t seed)
+{
+	struct flashdisk_stats before = *flashdisk_get_stats();
+	const struct flashdisk_stats *after;
+	uint32_t writes, erases, programs, max = 0;
+	int i;
+
+	memset(page_erases, 0, sizeof(page_erases));
+	workload(seed);
+	check_reads("before flush");
+	flashdisk_flush();
+	check_reads("after flush");
+	if (memcmp(flash, shadow, SIM_BYTES)) {
+		printf("%s: flash differs from what was written\n", name);
+		errors++;
+	}
+
+	after = flashdisk_get_stats();
+	writes = after->sector_writes - before.sector_writes;
+	erases = after->page_erases - before.page_erases;
+	programs = after->halfword_programs - before.halfword_programs;
+	for (i = 0; i < SIM_PAGES; i++) {
+		if (page_erases[i] > max) {
+			max = page_erases[i];
+		}
+	}
+	printf("%-14s %6u sectors  %5u erases (%u uncached)  "
+	       "%6u programs  max %u erases/page\n", name,
+	       (unsigned)writes, (unsigned)erases, (unsigned)writes,
+	       (unsigned)programs, (unsigned)max);
+}
+
+int main(void)
+{
+	memset(flash, 0xff, sizeof(flash));
+	memset(shadow, 0xff, sizeof(shadow));
+	flashdisk_init((const uint8_t *)flash, SIM_PAGES);
+
+	run("copy (blank)", copy_file, 1);
+	run("copy (again)", copy_file, 2);
+	run("copy (same)", copy_file, 2);
+	run("random", random_writes, 3);
+
+	printf("%s\n", errors ? "FAILED" : "OK");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/flash.h>
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/msc.h>
+
+#include "flashdisk.h"
+
+/*
+ * The upper 128kB of the 256kB flash hold the disk, the program has to fit
+ * in the lower half.
+ */
+#define DISK_BASE	0x08020000
+#define DISK_PAGES	64
+
+/* Write the cache back once the host has been quiet for this long */
+#define FLUSH_IDLE_MS	250
+
+static const struct usb_device_descriptor dev_descr = {
+	.bLength = USB_DT_DEVICE_SIZE,
+	.bDescriptorType = USB_DT_DEVICE,
+	.bcdUSB = 0x0110,
+	.bDeviceClass = 0,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = 64,
+	.idVendor = 0x0483,
+	.idProduct = 0x5741,
+	.bcdDevice = 0x0200,
+	.iManufacturer = 1,
+	.iProduct = 2,
+	.iSerialNumber = 3,
+	.bNumConfigurations = 1,
+};
+
+static const struct usb_endpoint_descriptor msc_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x01,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+	.bInterval = 0,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = 0x82,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+	.bInterval = 0,
+}};
+
+static const struct usb_interface_descriptor msc_iface[] = {{
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 0,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = USB_CLASS_MSC,
+	.bInterfaceSubClass = USB_MSC_SUBCLASS_SCSI,
+	.bInterfaceProtocol = USB_MSC_PROTOCOL_BBB,
+	.iInterface = 0,
+	.endpoint = msc_endp,
+	.extra = NULL,
+	.extralen = 0
+}};
+
+static const struct usb_interface ifaces[] = {{
+	.num_altsetting = 1,
+	.altsetting = msc_iface,
+}};
+
+static const struct usb_config_descriptor config_descr = {
+	.bLength = USB_DT_CONFIGURATION_SIZE,
+	.bDescriptorType = USB_DT_CONFIGURATION,
+	.wTotalLength = 0,
+	.bNumInterfaces = 1,
+	.bConfigurationValue = 1,
+	.iConfiguration = 0,
+	.bmAttributes = 0x80,
+	.bMaxPower = 0x32,
+	.interface = ifaces,
+};
+
+static const char *usb_strings[] = {
+	"Black Sphere Technologies",
+	"MSC Flash Demo",
+	"DEMO",
+};
+
+static usbd_device *msc_dev;
+/* Buffer to be used for control requests. */
+static uint8_t usbd_control_buffer[128];
+
+static uint32_t flush_after;
+
+/* milliseconds since boot */
+static volatile uint32_t system_millis;
+
+void sys_tick_handler(void)
+{
+	system_millis++;
+}
+
+int flashdisk_hw_erase(uint32_t offset)
+{
+	flash_clear_status_flags();
+	flash_erase_page(DISK_BASE + offset);
+	if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+		return -1;
+	}
+	return 0;
+}
+
+int flashdisk_hw_program(uint32_t offset, uint16_t data)
+{
+	flash_clear_status_flags();
+	flash_program_half_word(DISK_BASE + offset, data);
+	if (flash_get_status_flags() & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR)) {
+		return -1;
+	}
+	return 0;
+}
+
+static int msc_write(uint32_t lba, const uint8_t *copy_from)
+{
+	flush_after = system_millis + FLUSH_IDLE_MS;
+	return flashdisk_write(lba, copy_from);
+}
+
+int main(void)
+{
+	rcc_clock_setup_pll(&rcc_hse_configs[RCC_CLOCK_HSE25_72MHZ]);
+
+	/* 1ms ticks for the write-back timer */
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(72000 - 1);
+	systick_interrupt_enable();
+	systick_counter_enable();
+
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_OTGFS);
+
+	flash_unlock();
+	flashdisk_init((const uint8_t *)DISK_BASE, DISK_PAGES);
+
+	msc_dev = usbd_init(&stm32f107_usb_driver, &dev_descr, &config_descr,
+			    usb_strings, 3,
+			    usbd_control_buffer, sizeof(usbd_control_buffer));
+
+	usb_msc_init(msc_dev, 0x82, 64, 0x01, 64, "VendorID", "ProductID",
+		"0.00", flashdisk_blocks(), flashdisk_read, msc_write);
+
+	for (;;) {
+		usbd_poll(msc_dev);
+		/*
+		 * MSC has no "I am done" from the host short of an eject, so
+		 * pages go to flash after a pause in the writes. Unplugging
+		 * within FLUSH_IDLE_MS of the last write loses them.
+		 */
+		if (flashdisk_dirty() &&
+		    (int32_t)(system_millis - flush_after) >= 0) {
+			flashdisk_flush();
+		}
+	}
+}
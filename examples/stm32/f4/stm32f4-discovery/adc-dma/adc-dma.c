@@ -0,0 +1,237 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/usart.h>
+#include "adc_stream.h"
+#include "dsp.h"
+
+#define LED_DISCO_GREEN_PORT GPIOD
+#define LED_DISCO_GREEN_PIN GPIO12
+
+#define USART_CONSOLE USART2
+
+/* PA1, PB0, PB1 and PC2, which the discovery board leaves free */
+static const uint8_t channels[] = { 1, 8, 9, 12 };
+#define NCHANNELS	sizeof(channels)
+
+/* 4 channels at 25kHz is 100k samples per second, in blocks of 8ms */
+#define RATE		25000
+#define FRAMES		200
+#define REPORT_BLOCKS	(RATE / FRAMES)
+
+static uint16_t samples[2 * FRAMES * NCHANNELS];
+
+static struct dsp_pipeline dsp;
+
+struct channel_summary {
+	uint16_t min, max;	/* Over the second */
+	uint16_t mean, rms;	/* Over the last DSP_RMS_BLOCKS blocks */
+	int16_t filtered;	/* Last output of the decimation filters */
+};
+
+/* Filled by the block callback, a second's worth at a time */
+static struct channel_summary acc[NCHANNELS];
+static uint32_t acc_blocks, acc_first_seq;
+static volatile struct channel_summary report[NCHANNELS];
+static volatile uint32_t report_first_seq;
+static volatile uint32_t report_cycles[DSP_STAGES];
+static volatile int report_ready;
+
+int _write(int file, char *ptr, int len);
+
+static void clock_setup(void)
+{
+	rcc_clock_setup_pll(&rcc_hse_8mhz_3v3[RCC_CLOCK_3V3_168MHZ]);
+	/* Enable GPIOD clock for LED & USARTs. */
+	rcc_periph_clock_enable(RCC_GPIOD);
+	rcc_periph_clock_enable(RCC_GPIOA);
+
+	/* Enable clocks for USART2. */
+	rcc_periph_clock_enable(RCC_USART2);
+}
+
+static void usart_setup(void)
+{
+	/* Setup GPIO pins for USART2 transmit. */
+	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO2);
+
+	/* Setup USART2 TX pin as alternate function. */
+	gpio_set_af(GPIOA, GPIO_AF7, GPIO2);
+
+	usart_set_baudrate(USART_CONSOLE, 115200);
+	usart_set_databits(USART_CONSOLE, 8);
+	usart_set_stopbits(USART_CONSOLE, USART_STOPBITS_1);
+	usart_set_mode(USART_CONSOLE, USART_MODE_TX);
+	usart_set_parity(USART_CONSOLE, USART_PARITY_NONE);
+	usart_set_flow_control(USART_CONSOLE, USART_FLOWCONTROL_NONE);
+
+	/* Finally enable the USART. */
+	usart_enable(USART_CONSOLE);
+}
+
+/**
+ * Use USART_CONSOLE as a console.
+ * This is a syscall for newlib
+ * @param file
+ * @param ptr
+ * @param len
+ * @return
+ */
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	if (file == STDOUT_FILENO || file == STDERR_FILENO) {
+		for (i = 0; i < len; i++) {
+			if (ptr[i] == '\n') {
+				usart_send_blocking(USART_CONSOLE, '\r');
+			}
+			usart_send_blocking(USART_CONSOLE, ptr[i]);
+		}
+		return i;
+	}
+	errno = EIO;
+	return -1;
+}
+
+/*
+ * Runs in the DMA interrupt every 8ms, with the other half of the buffer
+ * filling meanwhile. It only has to keep up with the blocks, not with
+ * the samples.
+ */
+static void block(const uint16_t *s, uint32_t frames, uint32_t seq)
+{
+	const struct dsp_channel *ch;
+	uint32_t c;
+
+	(void)frames;
+	dsp_process(&dsp, s);
+
+	if (!acc_blocks) {
+		for (c = 0; c < NCHANNELS; c++) {
+			acc[c].min = 0xffff;
+			acc[c].max = 0;
+		}
+		acc_first_seq = seq;
+	}
+	for (c = 0; c < NCHANNELS; c++) {
+		ch = &dsp.ch[c];
+		if (ch->min < acc[c].min) {
+			acc[c].min = ch->min;
+		}
+		if (ch->max > acc[c].max) {
+			acc[c].max = ch->max;
+		}
+	}
+	if (++acc_blocks == REPORT_BLOCKS) {
+		/* If the last one has not been printed yet, drop this one */
+		if (!report_ready) {
+			for (c = 0; c < NCHANNELS; c++) {
+				ch = &dsp.ch[c];
+				acc[c].mean = ch->mean;
+				acc[c].rms = ch->rms;
+				acc[c].filtered = ch->out[FRAMES / DSP_DECIMATION - 1];
+				report[c] = acc[c];
+			}
+			for (c = 0; c < DSP_STAGES; c++) {
+				report_cycles[c] = dsp.stage[c].total;
+			}
+			report_first_seq = acc_first_seq;
+			report_ready = 1;
+		}
+		for (c = 0; c < DSP_STAGES; c++) {
+			prof_reset(&dsp.stage[c]);
+		}
+		acc_blocks = 0;
+	}
+}
+
+int main(void)
+{
+	struct adc_stream_config config = {
+		.channels = channels,
+		.nchannels = NCHANNELS,
+		.sample_time = ADC_SMPR_SMP_15CYC,
+		.rate = RATE,
+		.buffer = samples,
+		.frames = FRAMES,
+		.block = block,
+	};
+	const volatile struct adc_stream_stats *stats;
+	uint32_t rate, c, total, tenths;
+
+	clock_setup();
+	usart_setup();
+
+	/* green led for ticking */
+	gpio_mode_setup(LED_DISCO_GREEN_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+			LED_DISCO_GREEN_PIN);
+
+	prof_init();
+	dsp_init(&dsp, NCHANNELS, FRAMES);
+	if (adc_stream_start(&config) != ADC_STREAM_OK) {
+		printf("can't sample that fast\n");
+		while (1);
+	}
+	rate = adc_stream_rate_mhz();
+	printf("%u channels at %u.%03u Hz, %u samples/s\n",
+	       (unsigned)NCHANNELS, (unsigned)(rate / 1000),
+	       (unsigned)(rate % 1000), (unsigned)(rate / 1000 * NCHANNELS));
+	stats = adc_stream_get_stats();
+
+	while (1) {
+		while (!report_ready) {
+			__asm__("wfi");
+		}
+		/* The block number says when the second started */
+		printf("t=%lums blocks %lu late %lu restarts %lu\n",
+		       (unsigned long)report_first_seq * (FRAMES * 1000 / RATE),
+		       (unsigned long)stats->blocks,
+		       (unsigned long)stats->late,
+		       (unsigned long)stats->restarts);
+		for (c = 0; c < NCHANNELS; c++) {
+			printf("  ch%-2u min %4u max %4u mean %4u rms %4u "
+			       "filtered %4d\n", channels[c],
+			       report[c].min, report[c].max, report[c].mean,
+			       report[c].rms, report[c].filtered);
+		}
+		/* A second's worth of samples went through the stages */
+		printf("  cycles/sample");
+		total = 0;
+		for (c = 0; c < DSP_STAGES; c++) {
+			tenths = report_cycles[c] / (RATE * NCHANNELS / 10);
+			printf(" %s %lu.%lu", dsp_stage_name(c),
+			       (unsigned long)tenths / 10,
+			       (unsigned long)tenths % 10);
+			total += report_cycles[c];
+		}
+		printf(", %lu%% cpu\n",
+		       (unsigned long)(total / (rcc_ahb_frequency / 100)));
+		report_ready = 0;
+
+		/* LED on/off */
+		gpio_toggle(LED_DISCO_GREEN_PORT, LED_DISCO_GREEN_PIN);
+	}
+
+	return 0;
+}
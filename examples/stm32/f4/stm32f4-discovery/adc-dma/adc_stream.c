@@ -0,0 +1,278 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+#include "adc_stream.h"
+
+/* ADC1 requests go to DMA2 stream 0 channel 0 (or stream 4) */
+#define ADC_DMA		DMA2
+#define ADC_DMA_STREAM	DMA_STREAM0
+
+/* ADC clock cycles for each ADC_SMPR_SMP_xxx, a 12 bit conversion adds 12 */
+static const uint16_t sample_cycles[8] = {
+	3, 15, 28, 56, 84, 112, 144, 480
+};
+#define CONVERSION_CYCLES	12
+
+static struct adc_stream_config stream;
+static uint8_t channels[ADC_STREAM_MAX_CHANNELS];
+static uint32_t block_samples;		/* Samples in half the buffer */
+static uint32_t period;			/* Timer ticks per frame */
+static uint32_t seq;
+static volatile struct adc_stream_stats stats;
+
+/* TIM2 is on APB1, which is divided down, so its clock runs at twice APB1 */
+static uint32_t timer_clock(void)
+{
+	return rcc_apb1_frequency * 2;
+}
+
+/* ADCPRE is set to 4 below, which keeps it under 36MHz from any APB2 clock */
+static uint32_t adc_clock(void)
+{
+	return rcc_apb2_frequency / 4;
+}
+
+static void channel_setup(uint8_t channel)
+{
+	if (channel < 8) {
+		rcc_periph_clock_enable(RCC_GPIOA);
+		gpio_mode_setup(GPIOA, GPIO_MODE_ANALOG, GPIO_PUPD_NONE,
+				1 << channel);
+	} else if (channel < 10) {
+		rcc_periph_clock_enable(RCC_GPIOB);
+		gpio_mode_setup(GPIOB, GPIO_MODE_ANALOG, GPIO_PUPD_NONE,
+				1 << (channel - 8));
+	} else if (channel < 16) {
+		rcc_periph_clock_enable(RCC_GPIOC);
+		gpio_mode_setup(GPIOC, GPIO_MODE_ANALOG, GPIO_PUPD_NONE,
+				1 << (channel - 10));
+	} else {
+		adc_enable_temperature_sensor();
+	}
+}
+
+static void adc_setup(void)
+{
+	adc_power_off(ADC1);
+	adc_set_clk_prescale(ADC_CCR_ADCPRE_BY4);
+	adc_set_right_aligned(ADC1);
+	/* Every trigger converts the whole sequence once */
+	adc_enable_scan_mode(ADC1);
+	adc_set_single_conversion_mode(ADC1);
+	adc_set_sample_time_on_all_channels(ADC1, stream.sample_time);
+	adc_set_regular_sequence(ADC1, stream.nchannels, channels);
+	adc_enable_external_trigger_regular(ADC1, ADC_CR2_EXTSEL_TIM2_TRGO,
+					    ADC_CR2_EXTEN_RISING_EDGE);
+	/* Keep requesting DMA after the last transfer, for circular mode */
+	adc_set_dma_continue(ADC1);
+	adc_enable_overrun_interrupt(ADC1);
+	adc_power_on(ADC1);
+}
+
+static void dma_start(void)
+{
+	dma_stream_reset(ADC_DMA, ADC_DMA_STREAM);
+	dma_channel_select(ADC_DMA, ADC_DMA_STREAM, DMA_SxCR_CHSEL_0);
+	dma_set_priority(ADC_DMA, ADC_DMA_STREAM, DMA_SxCR_PL_VERY_HIGH);
+	dma_set_transfer_mode(ADC_DMA, ADC_DMA_STREAM,
+			      DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+	dma_set_peripheral_size(ADC_DMA, ADC_DMA_STREAM, DMA_SxCR_PSIZE_16BIT);
+	dma_set_memory_size(ADC_DMA, ADC_DMA_STREAM, DMA_SxCR_MSIZE_16BIT);
+	dma_enable_memory_increment_mode(ADC_DMA, ADC_DMA_STREAM);
+	dma_enable_circular_mode(ADC_DMA, ADC_DMA_STREAM);
+	dma_set_peripheral_address(ADC_DMA, ADC_DMA_STREAM,
+				   (uint32_t)&ADC_DR(ADC1));
+	dma_set_memory_address(ADC_DMA, ADC_DMA_STREAM,
+			       (uint32_t)stream.buffer);
+	dma_set_number_of_data(ADC_DMA, ADC_DMA_STREAM, 2 * block_samples);
+	dma_enable_half_transfer_interrupt(ADC_DMA, ADC_DMA_STREAM);
+	dma_enable_transfer_complete_interrupt(ADC_DMA, ADC_DMA_STREAM);
+	dma_enable_stream(ADC_DMA, ADC_DMA_STREAM);
+
+	adc_enable_dma(ADC1);
+}
+
+static void timer_setup(void)
+{
+	rcc_periph_reset_pulse(RST_TIM2);
+	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT,
+		       TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIM2, 0);
+	/* TIM2 is 32 bit, so any rate we accept fits without a prescaler */
+	timer_set_period(TIM2, period - 1);
+	/* The update event is the trigger output, one scan per period */
+	timer_set_master_mode(TIM2, TIM_CR2_MMS_UPDATE);
+}
+
+int adc_stream_start(const struct adc_stream_config *config)
+{
+	uint32_t scan_cycles, i;
+
+	if (!config->block || !config->nchannels ||
+	    config->nchannels > ADC_STREAM_MAX_CHANNELS ||
+	    config->sample_time > 7 || !config->rate || !config->frames ||
+	    2 * config->frames * config->nchannels > 0xffff) {
+		return ADC_STREAM_EINVAL;
+	}
+	for (i = 0; i < config->nchannels; i++) {
+		if (config->channels[i] > 17) {
+			return ADC_STREAM_EINVAL;
+		}
+	}
+
+	/* The whole scan has to be over before the next trigger */
+	scan_cycles = config->nchannels *
+		(sample_cycles[config->sample_time] + CONVERSION_CYCLES);
+	if ((uint64_t)config->rate * scan_cycles >= adc_clock() ||
+	    config->rate > timer_clock() / 2) {
+		return ADC_STREAM_EINVAL;
+	}
+
+	adc_stream_stop();
+
+	stream = *config;
+	for (i = 0; i < config->nchannels; i++) {
+		channels[i] = config->channels[i];
+	}
+	stream.channels = channels;
+	block_samples = config->frames * config->nchannels;
+	period = (timer_clock() + config->rate / 2) / config->rate;
+	seq = 0;
+	stats.blocks = 0;
+	stats.late = 0;
+	stats.restarts = 0;
+
+	rcc_periph_clock_enable(RCC_ADC1);
+	rcc_periph_clock_enable(RCC_DMA2);
+	rcc_periph_clock_enable(RCC_TIM2);
+	for (i = 0; i < stream.nchannels; i++) {
+		channel_setup(channels[i]);
+	}
+	adc_setup();
+	dma_start();
+	timer_setup();
+
+	/* Same priority, so a restart never cuts into a block callback */
+	nvic_set_priority(NVIC_DMA2_STREAM0_IRQ, 0x40);
+	nvic_set_priority(NVIC_ADC_IRQ, 0x40);
+	nvic_enable_irq(NVIC_DMA2_STREAM0_IRQ);
+	nvic_enable_irq(NVIC_ADC_IRQ);
+
+	timer_enable_counter(TIM2);
+
+	return ADC_STREAM_OK;
+}
+
+void adc_stream_stop(void)
+{
+	if (!stream.block) {
+		return;
+	}
+	timer_disable_counter(TIM2);
+	nvic_disable_irq(NVIC_DMA2_STREAM0_IRQ);
+	nvic_disable_irq(NVIC_ADC_IRQ);
+	adc_disable_dma(ADC1);
+	dma_stream_reset(ADC_DMA, ADC_DMA_STREAM);
+	adc_power_off(ADC1);
+	stream.block = 0;
+}
+
+uint32_t adc_stream_rate_mhz(void)
+{
+	if (!period) {
+		return 0;
+	}
+	return ((uint64_t)timer_clock() * 1000 + period / 2) / period;
+}
+
+const volatile struct adc_stream_stats *adc_stream_get_stats(void)
+{
+	return &stats;
+}
+
+/* Which half of the buffer the DMA is filling right now */
+static uint32_t dma_half(void)
+{
+	return DMA_SNDTR(ADC_DMA, ADC_DMA_STREAM) > block_samples ? 0 : 1;
+}
+
+/*
+ * Each time the DMA crosses from one half of the buffer into the other,
+ * the half it left is handed to the callback. Both flags being set means
+ * the interrupt came too late to see one crossing, and the block it
+ * missed has already been overwritten: it is skipped, but still counted
+ * in seq so the timing of the following blocks stays right. A callback
+ * that takes longer than a block is caught afterwards, the DMA is then
+ * back in the half it was reading.
+ */
+void dma2_stream0_isr(void)
+{
+	uint32_t flags = 0, half;
+
+	if (dma_get_interrupt_flag(ADC_DMA, ADC_DMA_STREAM, DMA_HTIF)) {
+		flags |= DMA_HTIF;
+	}
+	if (dma_get_interrupt_flag(ADC_DMA, ADC_DMA_STREAM, DMA_TCIF)) {
+		flags |= DMA_TCIF;
+	}
+	if (!flags) {
+		return;
+	}
+	dma_clear_interrupt_flags(ADC_DMA, ADC_DMA_STREAM, flags);
+
+	if (flags == (DMA_HTIF | DMA_TCIF)) {
+		stats.late++;
+		seq++;
+	}
+	half = dma_half() ^ 1;
+
+	stream.block(stream.buffer + half * block_samples, stream.frames, seq);
+	seq++;
+	stats.blocks++;
+
+	if (dma_half() == half) {
+		stats.late++;
+	}
+}
+
+/*
+ * The ADC overruns when a result is not read before the next one is
+ * ready, which with DMA only happens if the bus is hogged for a whole
+ * conversion. The ADC then stops asking for DMA, and the order of the
+ * channels in the buffer can no longer be trusted: start over from the
+ * first channel of the first half.
+ */
+void adc_isr(void)
+{
+	if (!adc_get_overrun_flag(ADC1)) {
+		return;
+	}
+	timer_disable_counter(TIM2);
+	adc_disable_dma(ADC1);
+	adc_clear_overrun_flag(ADC1);
+	dma_start();
+	timer_set_counter(TIM2, 0);
+	timer_enable_counter(TIM2);
+	seq = 0;
+	stats.restarts++;
+}
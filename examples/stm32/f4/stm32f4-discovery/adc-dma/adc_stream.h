@@ -0,0 +1,70 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ADC_STREAM_H
+#define __ADC_STREAM_H
+
+#include <stdint.h>
+
+/*
+ * Continuous sampling of several ADC1 channels.
+ *
+ * TIM2 triggers a scan of all the channels at a fixed rate, and DMA2
+ * stream 0 moves the results into a circular buffer made of two halves.
+ * Whenever a half is full, the block callback gets it while the other
+ * half fills; the CPU is not involved in the individual samples.
+ *
+ * A frame is one sample of every channel, in the order given. Frame n of
+ * the block with sequence number seq was triggered
+ * (seq * frames + n) * 1000 / adc_stream_rate_mhz() seconds after the
+ * start, or after the last restart: those begin again from seq 0 and are
+ * counted in stats.restarts.
+ */
+
+#define ADC_STREAM_MAX_CHANNELS	16
+
+#define ADC_STREAM_OK		0
+#define ADC_STREAM_EINVAL	-1	/* Bad channel, size or rate */
+
+/* Called from the DMA interrupt with each completed half buffer */
+typedef void (*adc_stream_block_cb)(const uint16_t *samples,
+				    uint32_t frames, uint32_t seq);
+
+struct adc_stream_config {
+	const uint8_t *channels;	/* 0..15 pins, 16 temp., 17 Vrefint */
+	uint8_t nchannels;
+	uint8_t sample_time;		/* ADC_SMPR_SMP_xxx, all channels */
+	uint32_t rate;			/* Frames per second */
+	uint16_t *buffer;		/* 2 * frames * nchannels samples */
+	uint32_t frames;		/* Frames per block (half buffer) */
+	adc_stream_block_cb block;
+};
+
+struct adc_stream_stats {
+	uint32_t blocks;	/* Blocks handed to the callback */
+	uint32_t late;		/* Blocks overwritten before the callback
+				   was done with them, or skipped */
+	uint32_t restarts;	/* ADC overruns, the stream was restarted */
+};
+
+int adc_stream_start(const struct adc_stream_config *config);
+void adc_stream_stop(void);
+/* Actual frame rate in mHz, the timer period is a whole number of ticks */
+uint32_t adc_stream_rate_mhz(void);
+const volatile struct adc_stream_stats *adc_stream_get_stats(void);
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "dsp.h"
+
+/*
+ * Low pass for the second decimation, in Q15: a Blackman windowed sinc
+ * with its cutoff at 0.21 of the CIC output rate. Flat to 0.1, -17dB at
+ * the new Nyquist frequency and below -75dB from 0.35 up, so nothing
+ * aliases into the passband.
+ */
+const int16_t dsp_fir_coeffs[DSP_FIR_TAPS] = {
+	3, 24, -2, -141, -127, 372, 689, -457, -2148, -554, 6020, 12705,
+	12705, 6020, -554, -2148, -457, 689, 372, -127, -141, -2, 24, 3
+};
+
+/* The coefficients in reverse, two to a word, to line up with the data */
+static uint32_t fir_pairs[DSP_FIR_TAPS / 2];
+
+/*
+ * Dual 16 bit helpers. The samples are stored as 16 bit values, so two
+ * neighbours are loaded as one word: lane 0 (bits 15:0) the first, lane
+ * 1 (bits 31:16) the second.
+ */
+#if defined(__ARM_FEATURE_DSP)
+/* lo * lo + hi * hi + acc */
+static inline int32_t dsp_smlad(uint32_t a, uint32_t b, int32_t acc)
+{
+	int32_t r;
+
+	__asm__("smlad %0, %1, %2, %3" : "=r" (r) : "r" (a), "r" (b), "r" (acc));
+	return r;
+}
+
+/* lo * lo + hi * hi + acc, with a 64 bit accumulator */
+static inline uint64_t dsp_smlald(uint32_t a, uint32_t b, uint64_t acc)
+{
+	__asm__("smlald %Q0, %R0, %1, %2" : "+r" (acc) : "r" (a), "r" (b));
+	return acc;
+}
+
+/* Unsigned maximum and minimum of each lane */
+static inline uint32_t dsp_umax16(uint32_t a, uint32_t b)
+{
+	uint32_t r;
+
+	__asm__("usub16 %0, %1, %2\n\t"
+		"sel %0, %1, %2" : "=&r" (r) : "r" (a), "r" (b) : "cc");
+	return r;
+}
+
+static inline uint32_t dsp_umin16(uint32_t a, uint32_t b)
+{
+	uint32_t r;
+
+	__asm__("usub16 %0, %1, %2\n\t"
+		"sel %0, %2, %1" : "=&r" (r) : "r" (a), "r" (b) : "cc");
+	return r;
+}
+#else
+static inline int32_t dsp_smlad(uint32_t a, uint32_t b, int32_t acc)
+{
+	return (int16_t)a * (int16_t)b +
+	       (int16_t)(a >> 16) * (int16_t)(b >> 16) + acc;
+}
+
+static inline uint64_t dsp_smlald(uint32_t a, uint32_t b, uint64_t acc)
+{
+	return acc + (int64_t)((int16_t)a * (int16_t)b) +
+	       (int64_t)((int16_t)(a >> 16) * (int16_t)(b >> 16));
+}
+
+static inline uint32_t dsp_umax16(uint32_t a, uint32_t b)
+{
+	return (((a & 0xffff) >= (b & 0xffff) ? a : b) & 0xffff) |
+	       (((a >> 16) >= (b >> 16) ? a : b) & 0xffff0000);
+}
+
+static inline uint32_t dsp_umin16(uint32_t a, uint32_t b)
+{
+	return (((a & 0xffff) >= (b & 0xffff) ? b : a) & 0xffff) |
+	       (((a >> 16) >= (b >> 16) ? b : a) & 0xffff0000);
+}
+#endif
+
+static inline uint32_t load_pair(const int16_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t r = 0, bit = (uint64_t)1 << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return r;
+}
+
+static void split(const struct dsp_pipeline *p, const uint16_t *s,
+		  int16_t *x)
+{
+	uint32_t i, n = p->nchannels;
+
+	for (i = 0; i < p->frames; i++, s += n) {
+		x[i] = *s;
+	}
+}
+
+static void minmax(const struct dsp_pipeline *p, const int16_t *x,
+		   struct dsp_channel *ch)
+{
+	uint32_t mn = 0xffffffff, mx = 0, v, i;
+
+	for (i = 0; i < p->frames; i += 2) {
+		v = load_pair(&x[i]);
+		mn = dsp_umin16(mn, v);
+		mx = dsp_umax16(mx, v);
+	}
+	mn = dsp_umin16(mn, mn >> 16);
+	mx = dsp_umax16(mx, mx >> 16);
+	ch->min = mn;
+	ch->max = mx;
+}
+
+static void rms(const struct dsp_pipeline *p, const int16_t *x,
+		struct dsp_channel *ch)
+{
+	uint32_t slot = p->blocks % DSP_RMS_BLOCKS, n, v, i;
+	uint32_t sum = 0;
+	uint64_t square = 0;
+
+	for (i = 0; i < p->frames; i += 2) {
+		v = load_pair(&x[i]);
+		sum = dsp_smlad(v, 0x00010001, sum);
+		square = dsp_smlald(v, v, square);
+	}
+
+	ch->sum += sum - ch->sums[slot];
+	ch->square += square - ch->squares[slot];
+	ch->sums[slot] = sum;
+	ch->squares[slot] = square;
+
+	n = p->blocks < DSP_RMS_BLOCKS ? p->blocks + 1 : DSP_RMS_BLOCKS;
+	n *= p->frames;
+	ch->mean = (ch->sum + n / 2) / n;
+	ch->rms = isqrt64((ch->square + n / 2) / n);
+}
+
+/*
+ * The integrators run at the input rate, the combs at the output rate.
+ * The gain is DSP_CIC_RATE ^ DSP_CIC_ORDER, a power of two, and is
+ * shifted out so the output has the same scale as the input.
+ */
+static void cic(const struct dsp_pipeline *p, const int16_t *x,
+		struct dsp_channel *ch)
+{
+	uint32_t i0 = ch->integ[0], i1 = ch->integ[1], i2 = ch->integ[2];
+	uint32_t v, d, i;
+	int16_t *out = &ch->fir[DSP_FIR_TAPS - 1];
+	const uint32_t shift = DSP_CIC_ORDER * DSP_CIC_SHIFT;
+
+	for (i = 0; i < p->frames; i++) {
+		i0 += x[i];
+		i1 += i0;
+		i2 += i1;
+		if ((i & (DSP_CIC_RATE - 1)) != DSP_CIC_RATE - 1) {
+			continue;
+		}
+		v = i2;
+		d = v - ch->comb[0];
+		ch->comb[0] = v;
+		v = d;
+		d = v - ch->comb[1];
+		ch->comb[1] = v;
+		v = d;
+		d = v - ch->comb[2];
+		ch->comb[2] = v;
+		*out++ = ((int32_t)d + (1 << (shift - 1))) >> shift;
+	}
+	ch->integ[0] = i0;
+	ch->integ[1] = i1;
+	ch->integ[2] = i2;
+}
+
+/*
+ * Every second output of the FIR filter, over the history and this
+ * block's CIC output. Both the data and the coefficient pairs are word
+ * aligned, so each SMLAD does two taps.
+ */
+static void fir(const struct dsp_pipeline *p, struct dsp_channel *ch)
+{
+	uint32_t n = p->frames / DSP_CIC_RATE, j, k;
+	const int16_t *w;
+	int32_t acc;
+
+	for (j = 0; j < n / 2; j++) {
+		w = &ch->fir[2 * j];
+		acc = 1 << 14;
+		for (k = 0; k < DSP_FIR_TAPS / 2; k++) {
+			acc = dsp_smlad(load_pair(&w[2 * k]), fir_pairs[k], acc);
+		}
+		ch->out[j] = acc >> 15;
+	}
+	memmove(ch->fir, &ch->fir[n], (DSP_FIR_TAPS - 1) * sizeof(ch->fir[0]));
+}
+
+int dsp_init(struct dsp_pipeline *p, uint32_t nchannels, uint32_t frames)
+{
+	uint32_t k;
+
+	if (!nchannels || nchannels > DSP_MAX_CHANNELS || !frames ||
+	    frames > DSP_MAX_FRAMES || frames % DSP_DECIMATION) {
+		return -1;
+	}
+	memset(p, 0, sizeof(*p));
+	p->nchannels = nchannels;
+	p->frames = frames;
+
+	for (k = 0; k < DSP_FIR_TAPS / 2; k++) {
+		fir_pairs[k] =
+			(uint16_t)dsp_fir_coeffs[DSP_FIR_TAPS - 1 - 2 * k] |
+			(uint32_t)(uint16_t)dsp_fir_coeffs[DSP_FIR_TAPS - 2 - 2 * k]
+				<< 16;
+	}
+
+	for (k = 0; k < DSP_STAGES; k++) {
+		p->stage[k].name = dsp_stage_name(k);
+		prof_reset(&p->stage[k]);
+	}
+	return 0;
+}
+
+void dsp_process(struct dsp_pipeline *p, const uint16_t *samples)
+{
+	struct dsp_channel *ch;
+	uint32_t c, s, t[DSP_STAGES + 1];
+
+	for (c = 0; c < p->nchannels; c++) {
+		ch = &p->ch[c];
+		t[0] = prof_now();
+		split(p, samples + c, p->x);
+		t[1] = prof_now();
+		minmax(p, p->x, ch);
+		t[2] = prof_now();
+		rms(p, p->x, ch);
+		t[3] = prof_now();
+		cic(p, p->x, ch);
+		t[4] = prof_now();
+		fir(p, ch);
+		t[5] = prof_now();
+
+		for (s = 0; s < DSP_STAGES; s++) {
+			prof_record(&p->stage[s], t[s + 1] - t[s]);
+		}
+	}
+	p->blocks++;
+}
+
+const char *dsp_stage_name(enum dsp_stage stage)
+{
+	static const char *const names[DSP_STAGES] = {
+		"split", "minmax", "rms", "cic", "fir"
+	};
+
+	return stage < DSP_STAGES ? names[stage] : "?";
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DSP_H
+#define __DSP_H
+
+#include <stdint.h>
+#include "prof.h"
+
+/*
+ * Block processing for the interleaved 12 bit sample blocks that
+ * adc_stream delivers. Per channel, every block goes through:
+ *
+ *   split	deinterleave into a contiguous buffer
+ *   minmax	minimum and maximum of the block
+ *   rms	mean and RMS over the last DSP_RMS_BLOCKS blocks
+ *   cic	3rd order CIC filter, decimating by DSP_CIC_RATE
+ *   fir	low pass FIR filter, decimating by 2 more
+ *
+ * The stages use the Cortex-M4 dual 16 bit instructions where the DSP
+ * extension is there, and plain C otherwise; both give the same results
+ * to the bit.
+ *
+ * Each stage of each channel is timed with the profiler in prof.c, so
+ * prof_init() has to be called first.
+ */
+
+#define DSP_MAX_CHANNELS	4
+#define DSP_MAX_FRAMES		256
+#define DSP_CIC_ORDER		3
+#define DSP_CIC_SHIFT		2
+#define DSP_CIC_RATE		(1 << DSP_CIC_SHIFT)
+#define DSP_FIR_TAPS		24
+#define DSP_DECIMATION		(DSP_CIC_RATE * 2)
+#define DSP_RMS_BLOCKS		16
+
+enum dsp_stage {
+	DSP_SPLIT,
+	DSP_MINMAX,
+	DSP_RMS,
+	DSP_CIC,
+	DSP_FIR,
+	DSP_STAGES
+};
+
+struct dsp_channel {
+	/* Results of the last block */
+	uint16_t min, max;
+	uint16_t mean, rms;
+	int16_t out[DSP_MAX_FRAMES / DSP_DECIMATION];
+
+	/* State */
+	uint32_t integ[DSP_CIC_ORDER];	/* Wrap around is fine for a CIC */
+	uint32_t comb[DSP_CIC_ORDER];
+	uint32_t sums[DSP_RMS_BLOCKS];
+	uint64_t squares[DSP_RMS_BLOCKS];
+	uint32_t sum;
+	uint64_t square;
+	/* FIR history followed by this block's CIC output, word aligned */
+	int16_t fir[DSP_FIR_TAPS - 1 + DSP_MAX_FRAMES / DSP_CIC_RATE + 1]
+		__attribute__((aligned(4)));
+};
+
+struct dsp_pipeline {
+	uint32_t nchannels;
+	uint32_t frames;
+	uint32_t blocks;
+	/* Time spent in each stage, per channel and block */
+	struct prof_stat stage[DSP_STAGES];
+	int16_t x[DSP_MAX_FRAMES] __attribute__((aligned(4)));
+	struct dsp_channel ch[DSP_MAX_CHANNELS];
+};
+
+/* frames has to be a multiple of DSP_DECIMATION, returns 0 or -1 */
+int dsp_init(struct dsp_pipeline *p, uint32_t nchannels, uint32_t frames);
+void dsp_process(struct dsp_pipeline *p, const uint16_t *samples);
+const char *dsp_stage_name(enum dsp_stage stage);
+
+extern const int16_t dsp_fir_coeffs[DSP_FIR_TAPS];
+
+#endif
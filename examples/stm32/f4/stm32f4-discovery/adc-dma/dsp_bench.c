@@ -0,0 +1,214 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host check and benchmark of the DSP pipeline, built by 'make HOST=1'.
+ *
+ * Four test channels (a constant, a 100Hz tone in the passband, a 2.9kHz
+ * tone that the decimation has to remove, and full scale noise) go
+ * through dsp_process() a block at a time, as they would from the ADC at
+ * 25kHz. Every result is compared with a straightforward implementation
+ * of the same filters over the whole signal: the CIC as three moving
+ * sums, the FIR as a plain convolution. Then the stages are timed, and
+ * the profiler's report shows how the time per channel and block spreads.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsp.h"
+
+#define NCH		4
+#define FRAMES		200
+#define RATE		25000
+#define BLOCKS		250
+#define LEN		(BLOCKS * FRAMES)
+#define BENCH_BLOCKS	20000
+#define PI		3.14159265358979323846
+
+static uint16_t input[LEN * NCH];
+static int errors;
+
+static void generate(void)
+{
+	uint32_t i, seed = 1;
+	double t;
+
+	for (i = 0; i < LEN; i++) {
+		t = (double)i / RATE;
+		input[i * NCH + 0] = 1000;
+		input[i * NCH + 1] = 2048 + lround(1500 * sin(2 * PI * 100 * t));
+		input[i * NCH + 2] = 2048 + lround(1500 * sin(2 * PI * 2900 * t));
+		seed = seed * 1103515245 + 12345;
+		input[i * NCH + 3] = (seed >> 16) & 0xfff;
+	}
+}
+
+/* The CIC output of channel c: three moving sums of DSP_CIC_RATE */
+static void reference_cic(int c, int32_t *out)
+{
+	static int64_t a[LEN], b[LEN];
+	int64_t s;
+	uint32_t i, shift = DSP_CIC_ORDER * DSP_CIC_SHIFT;
+	int j;
+
+	for (i = 0; i < LEN; i++) {
+		for (s = 0, j = 0; j < DSP_CIC_RATE && j <= (int)i; j++) {
+			s += input[(i - j) * NCH + c];
+		}
+		a[i] = s;
+	}
+	for (i = 0; i < LEN; i++) {
+		for (s = 0, j = 0; j < DSP_CIC_RATE && j <= (int)i; j++) {
+			s += a[i - j];
+		}
+		b[i] = s;
+	}
+	for (i = DSP_CIC_RATE - 1; i < LEN; i += DSP_CIC_RATE) {
+		for (s = 0, j = 0; j < DSP_CIC_RATE && j <= (int)i; j++) {
+			s += b[i - j];
+		}
+		out[i / DSP_CIC_RATE] = (s + (1 << (shift - 1))) >> shift;
+	}
+}
+
+/* Every second output of the FIR filter over the CIC output */
+static int32_t reference_fir(const int32_t *x, uint32_t n)
+{
+	int32_t acc = 1 << 14;
+	int k;
+
+	for (k = 0; k < DSP_FIR_TAPS && k <= (int)n; k++) {
+		acc += dsp_fir_coeffs[k] * x[n - k];
+	}
+	return acc >> 15;
+}
+
+static void check(void)
+{
+	static struct dsp_pipeline p;
+	static int32_t cic[LEN / DSP_CIC_RATE];
+	static int16_t out[NCH][LEN / DSP_DECIMATION];
+	uint32_t b, c, i, first, n, mn, mx;
+	uint64_t sum, square;
+	const uint32_t nout = FRAMES / DSP_DECIMATION;
+
+	dsp_init(&p, NCH, FRAMES);
+	for (b = 0; b < BLOCKS; b++) {
+		dsp_process(&p, &input[b * FRAMES * NCH]);
+		for (c = 0; c < NCH; c++) {
+			const struct dsp_channel *ch = &p.ch[c];
+
+			memcpy(&out[c][b * nout], ch->out, sizeof(ch->out[0]) * nout);
+
+			mn = 0xffff;
+			mx = 0;
+			for (i = b * FRAMES; i < (b + 1) * FRAMES; i++) {
+				if (input[i * NCH + c] < mn) {
+					mn = input[i * NCH + c];
+				}
+				if (input[i * NCH + c] > mx) {
+					mx = input[i * NCH + c];
+				}
+			}
+			first = b < DSP_RMS_BLOCKS ? 0 : b + 1 - DSP_RMS_BLOCKS;
+			sum = 0;
+			square = 0;
+			for (i = first * FRAMES; i < (b + 1) * FRAMES; i++) {
+				sum += input[i * NCH + c];
+				square += input[i * NCH + c] * input[i * NCH + c];
+			}
+			n = (b + 1 - first) * FRAMES;
+			if (ch->min != mn || ch->max != mx ||
+			    ch->mean != (sum + n / 2) / n ||
+			    ch->rms != (uint32_t)sqrt((double)((square + n / 2) / n))) {
+				printf("block %u ch%u: min %u max %u mean %u rms %u, "
+				       "expected %u %u %u %u\n", b, c, ch->min,
+				       ch->max, ch->mean, ch->rms, mn, mx,
+				       (unsigned)((sum + n / 2) / n),
+				       (unsigned)sqrt((double)((square + n / 2) / n)));
+				errors++;
+			}
+		}
+	}
+
+	for (c = 0; c < NCH; c++) {
+		reference_cic(c, cic);
+		for (i = 0; i < LEN / DSP_DECIMATION; i++) {
+			if (out[c][i] != reference_fir(cic, 2 * i)) {
+				printf("ch%u output %u: %d, expected %d\n", c, i,
+				       out[c][i], reference_fir(cic, 2 * i));
+				errors++;
+			}
+		}
+	}
+
+	/* How much of the tones is left, once the filters have settled */
+	for (c = 1; c <= 2; c++) {
+		mn = 0xffff;
+		mx = 0;
+		for (i = LEN / DSP_DECIMATION / 2; i < LEN / DSP_DECIMATION; i++) {
+			if ((uint32_t)out[c][i] < mn) {
+				mn = out[c][i];
+			}
+			if ((uint32_t)out[c][i] > mx) {
+				mx = out[c][i];
+			}
+		}
+		printf("%s tone: output %4u..%4u, gain %6.1fdB\n",
+		       c == 1 ? "100Hz " : "2.9kHz", mn, mx,
+		       20 * log10((mx - mn + 1) / 3000.0));
+	}
+	printf("%u blocks of %u frames x %u channels checked against the "
+	       "reference: %s\n", BLOCKS, FRAMES, NCH,
+	       errors ? "MISMATCH" : "identical");
+}
+
+static void bench(void)
+{
+	static struct dsp_pipeline p;
+	struct prof_stat *stages[DSP_STAGES + 1];
+	uint64_t total = 0;
+	uint32_t b, s;
+	double samples = (double)BENCH_BLOCKS * FRAMES * NCH;
+
+	dsp_init(&p, NCH, FRAMES);
+	for (b = 0; b < BENCH_BLOCKS; b++) {
+		dsp_process(&p, &input[(b % BLOCKS) * FRAMES * NCH]);
+	}
+	for (s = 0; s < DSP_STAGES; s++) {
+		printf("%-8s %6.2f ns/sample\n", dsp_stage_name(s),
+		       p.stage[s].total / samples);
+		total += p.stage[s].total;
+		stages[s] = &p.stage[s];
+	}
+	printf("%-8s %6.2f ns/sample, %.1fM samples/s\n", "total",
+	       total / samples, samples / total * 1e3);
+
+	stages[DSP_STAGES] = NULL;
+	prof_report(stages, prof_swo_puts);
+}
+
+int main(void)
+{
+	prof_init();
+	generate();
+	check();
+	bench();
+	return errors ? 1 : 0;
+}
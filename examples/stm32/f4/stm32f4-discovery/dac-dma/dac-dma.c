@@ -17,18 +17,22 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
-#include <libopencm3/stm32/timer.h>
-#include <libopencm3/cm3/nvic.h>
-#include <libopencm3/stm32/dac.h>
-#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/usart.h>
+#include "wavegen.h"
 
-/* Timer 2 count period, 16 microseconds for a 72MHz APB2 clock */
-#define PERIOD 1152
+#define USART_CONSOLE USART2
 
-/* Globals */
-uint8_t waveform[256];
+/* 1024 samples at 256kHz, so a sine with 4 cycles in the table is 1kHz */
+#define DEFAULT_RATE	256000
+
+int _write(int file, char *ptr, int len);
 
 /*--------------------------------------------------------------------*/
 static void clock_setup(void)
@@ -37,121 +41,166 @@ static void clock_setup(void)
 }
 
 /*--------------------------------------------------------------------*/
-static void gpio_setup(void)
+static void usart_setup(void)
 {
-	/* Port A and C are on AHB1 */
 	rcc_periph_clock_enable(RCC_GPIOA);
-	rcc_periph_clock_enable(RCC_GPIOC);
-	/* Set the digital test output on PC1 */
-	gpio_mode_setup(GPIOC, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO1);
-	gpio_set_output_options(GPIOC, GPIO_OTYPE_PP, GPIO_OSPEED_2MHZ, GPIO1);
-	/* Set PA4 for DAC channel 1 to analogue, ignoring drive mode. */
-	gpio_mode_setup(GPIOA, GPIO_MODE_ANALOG, GPIO_PUPD_NONE, GPIO4);
+	rcc_periph_clock_enable(RCC_USART2);
+
+	/* PA2 transmits and PA3 receives, on USART2 */
+	gpio_mode_setup(GPIOA, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO2 | GPIO3);
+	gpio_set_af(GPIOA, GPIO_AF7, GPIO2 | GPIO3);
+
+	usart_set_baudrate(USART_CONSOLE, 115200);
+	usart_set_databits(USART_CONSOLE, 8);
+	usart_set_stopbits(USART_CONSOLE, USART_STOPBITS_1);
+	usart_set_mode(USART_CONSOLE, USART_MODE_TX_RX);
+	usart_set_parity(USART_CONSOLE, USART_PARITY_NONE);
+	usart_set_flow_control(USART_CONSOLE, USART_FLOWCONTROL_NONE);
+	usart_enable(USART_CONSOLE);
 }
 
-/*--------------------------------------------------------------------*/
-static void timer_setup(void)
+int _write(int file, char *ptr, int len)
 {
-	/* Enable TIM2 clock. */
-	rcc_periph_clock_enable(RCC_TIM2);
-	rcc_periph_reset_pulse(RST_TIM2);
-	/* Timer global mode: - No divider, Alignment edge, Direction up */
-	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT,
-		       TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
-	timer_continuous_mode(TIM2);
-	timer_set_period(TIM2, PERIOD);
-	timer_disable_oc_output(TIM2, TIM_OC2 | TIM_OC3 | TIM_OC4);
-	timer_enable_oc_output(TIM2, TIM_OC1);
-	timer_disable_oc_clear(TIM2, TIM_OC1);
-	timer_disable_oc_preload(TIM2, TIM_OC1);
-	timer_set_oc_slow_mode(TIM2, TIM_OC1);
-	timer_set_oc_mode(TIM2, TIM_OC1, TIM_OCM_TOGGLE);
-	timer_set_oc_value(TIM2, TIM_OC1, 500);
-	timer_disable_preload(TIM2);
-	/* Set the timer trigger output (for the DAC) to the channel 1 output
-	   compare */
-	timer_set_master_mode(TIM2, TIM_CR2_MMS_COMPARE_OC1REF);
-	timer_enable_counter(TIM2);
+	int i;
+
+	if (file == STDOUT_FILENO || file == STDERR_FILENO) {
+		for (i = 0; i < len; i++) {
+			if (ptr[i] == '\n') {
+				usart_send_blocking(USART_CONSOLE, '\r');
+			}
+			usart_send_blocking(USART_CONSOLE, ptr[i]);
+		}
+		return i;
+	}
+	errno = EIO;
+	return -1;
 }
 
-/*--------------------------------------------------------------------*/
-static void dma_setup(void)
+static void get_line(char *buf, int size)
 {
-	/* DAC channel 1 uses DMA controller 1 Stream 5 Channel 7. */
-	/* Enable DMA1 clock and IRQ */
-	rcc_periph_clock_enable(RCC_DMA1);
-	nvic_enable_irq(NVIC_DMA1_STREAM5_IRQ);
-	dma_stream_reset(DMA1, DMA_STREAM5);
-	dma_set_priority(DMA1, DMA_STREAM5, DMA_SxCR_PL_LOW);
-	dma_set_memory_size(DMA1, DMA_STREAM5, DMA_SxCR_MSIZE_8BIT);
-	dma_set_peripheral_size(DMA1, DMA_STREAM5, DMA_SxCR_PSIZE_8BIT);
-	dma_enable_memory_increment_mode(DMA1, DMA_STREAM5);
-	dma_enable_circular_mode(DMA1, DMA_STREAM5);
-	dma_set_transfer_mode(DMA1, DMA_STREAM5,
-				DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
-	/* The register to target is the DAC1 8-bit right justified data
-	   register */
-	dma_set_peripheral_address(DMA1, DMA_STREAM5, (uint32_t) &DAC_DHR8R1(DAC1));
-	/* The array v[] is filled with the waveform data to be output */
-	dma_set_memory_address(DMA1, DMA_STREAM5, (uint32_t) waveform);
-	dma_set_number_of_data(DMA1, DMA_STREAM5, 256);
-	dma_enable_transfer_complete_interrupt(DMA1, DMA_STREAM5);
-	dma_channel_select(DMA1, DMA_STREAM5, DMA_SxCR_CHSEL_7);
-	dma_enable_stream(DMA1, DMA_STREAM5);
+	int n = 0;
+	char c;
+
+	for (;;) {
+		c = usart_recv_blocking(USART_CONSOLE);
+		if (c == '\r' || c == '\n') {
+			break;
+		}
+		if (n < size - 1) {
+			buf[n++] = c;
+			usart_send_blocking(USART_CONSOLE, c);
+		}
+	}
+	buf[n] = 0;
+	printf("\n");
 }
 
-/*--------------------------------------------------------------------*/
-static void dac_setup(void)
+static void show(void)
 {
-	/* Enable the DAC clock on APB1 */
-	rcc_periph_clock_enable(RCC_DAC);
-	/* Setup the DAC channel 1, with timer 2 as trigger source.
-	 * Assume the DAC has woken up by the time the first transfer occurs */
-	dac_trigger_enable(DAC1, DAC_CHANNEL1);
-	dac_set_trigger_source(DAC1, DAC_CR_TSEL1_T2);
-	dac_dma_enable(DAC1, DAC_CHANNEL1);
-	dac_enable(DAC1, DAC_CHANNEL1);
+	uint32_t rate = wave_rate_mhz();
+	uint32_t table = rate / WAVE_SAMPLES;
+
+	printf("%lu.%03lu samples/s, table repeats at %lu.%03lu Hz, "
+	       "%lu swaps\n", (unsigned long)(rate / 1000),
+	       (unsigned long)(rate % 1000), (unsigned long)(table / 1000),
+	       (unsigned long)(table % 1000), (unsigned long)wave_swaps());
 }
 
-/*--------------------------------------------------------------------*/
-/* The ISR simply provides a test output for a CRO trigger */
+static void usage(void)
+{
+	printf("rate <Hz>                  sample rate\n"
+	       "freq <Hz>                  rate for one table per period\n"
+	       "sine <ch> <cycles> <amp> [<offset> [<degrees>]]\n"
+	       "sweep <ch> <from> <to> <amp> [<offset>]\n"
+	       "noise <ch> <amp> [<offset>]\n"
+	       "dc <ch> <value>\n"
+	       "show\n"
+	       "<ch> is 1 or 2, cycles are per table of %d samples, "
+	       "levels 0..%d\n", WAVE_SAMPLES, WAVE_MAX);
+}
 
-void dma1_stream5_isr(void)
+/*
+ * The rate commands retune the timer right away. The others change one
+ * channel of the table being edited and swap it in at the start of the
+ * next pass, the other channel carries on as it was.
+ */
+static void command(char *line)
 {
-	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_TCIF)) {
-		dma_clear_interrupt_flags(DMA1, DMA_STREAM5, DMA_TCIF);
-		/* Toggle PC1 just to keep aware of activity and frequency. */
-		gpio_toggle(GPIOC, GPIO1);
+	unsigned long a[5] = { 0, 0, 0, (WAVE_MAX + 1) / 2, 0 };
+	char *p = strchr(line, ' ');
+	enum wave_channel ch;
+	uint32_t *table;
+	int n = 0;
+
+	while (p && n < 5) {
+		a[n++] = strtoul(p, &p, 0);
+		if (*p != ' ') {
+			break;
+		}
+	}
+
+	if (!strncmp(line, "rate ", 5) && n == 1) {
+		wave_set_rate(a[0]);
+		show();
+		return;
+	} else if (!strncmp(line, "freq ", 5) && n == 1) {
+		wave_set_rate(a[0] * WAVE_SAMPLES);
+		show();
+		return;
+	} else if (!strcmp(line, "show")) {
+		show();
+		return;
+	}
+
+	if (n < 2 || (a[0] != 1 && a[0] != 2)) {
+		usage();
+		return;
+	}
+	ch = a[0] == 1 ? WAVE_CH1 : WAVE_CH2;
+	table = wave_edit();
+
+	if (!strncmp(line, "sine ", 5) && n >= 3 && a[1] < WAVE_SAMPLES / 2) {
+		wave_sine(table, ch, a[1], a[2], a[3],
+			  (uint32_t)((a[4] % 360) * (0x100000000ull / 360)));
+	} else if (!strncmp(line, "sweep ", 6) && n >= 4 &&
+		   a[1] < WAVE_SAMPLES / 2 && a[2] < WAVE_SAMPLES / 2) {
+		wave_sweep(table, ch, a[1], a[2], a[3],
+			   n > 4 ? a[4] : (WAVE_MAX + 1) / 2);
+	} else if (!strncmp(line, "noise ", 6)) {
+		wave_noise(table, ch, a[1], n > 2 ? a[2] : (WAVE_MAX + 1) / 2);
+	} else if (!strncmp(line, "dc ", 3)) {
+		wave_dc(table, ch, a[1]);
+	} else {
+		usage();
+		return;
 	}
+	wave_commit();
+	printf("ok\n");
 }
 
 /*--------------------------------------------------------------------*/
 int main(void)
 {
-	/* Fill the array with funky waveform data */
-	/* This is for dual channel 8-bit right aligned */
-	uint16_t i, x;
-	for (i = 0; i < 256; i++) {
-		if (i < 10) {
-			x = 10;
-		} else if (i < 121) {
-			x = 10 + ((i*i) >> 7);
-		} else if (i < 170) {
-			x = i/2;
-		} else if (i < 246) {
-			x = i + (80 - i/2);
-		} else {
-			x = 10;
-		}
-		waveform[i] = x;
-	}
+	char line[80];
+	uint32_t *table;
+
 	clock_setup();
-	gpio_setup();
-	timer_setup();
-	dma_setup();
-	dac_setup();
+	usart_setup();
+	wave_init(DEFAULT_RATE);
 
-	while (1);
+	/* Quadrature 1kHz sines, a circle on a scope in XY mode */
+	table = wave_edit();
+	wave_sine(table, WAVE_CH1, 4, 2000, 2048, 0);
+	wave_sine(table, WAVE_CH2, 4, 2000, 2048, 0x40000000);
+	wave_commit();
+
+	printf("\nwaveform generator, 'help' for the commands\n");
+	show();
+	while (1) {
+		printf("> ");
+		get_line(line, sizeof(line));
+		command(line);
+	}
 
 	return 0;
 }
@@ -0,0 +1,299 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dac.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/f4/rng.h>
+#include <libopencm3/cm3/nvic.h>
+#include "wavegen.h"
+
+#define HALF		(WAVE_SAMPLES / 2)
+
+/* The table the DMA plays, and the one being edited */
+static uint32_t play[WAVE_SAMPLES];
+static uint32_t next[WAVE_SAMPLES];
+
+enum {
+	SWAP_IDLE,
+	SWAP_REQUESTED,		/* Waiting for the DMA to enter the 2nd half */
+	SWAP_HALF,		/* 1st half copied, waiting for the wrap */
+};
+static volatile uint32_t swap;
+static volatile uint32_t swaps;
+static uint32_t period;
+
+/* TIM2 is on APB1, which is divided down, so its clock runs at twice APB1 */
+static uint32_t timer_clock(void)
+{
+	return rcc_apb1_frequency * 2;
+}
+
+static void timer_setup(void)
+{
+	rcc_periph_reset_pulse(RST_TIM2);
+	timer_set_mode(TIM2, TIM_CR1_CKD_CK_INT,
+		       TIM_CR1_CMS_EDGE, TIM_CR1_DIR_UP);
+	timer_set_prescaler(TIM2, 0);
+	/* A new period only takes effect at the next update event */
+	timer_enable_preload(TIM2);
+	timer_set_period(TIM2, period - 1);
+	/* The update event triggers both DAC channels */
+	timer_set_master_mode(TIM2, TIM_CR2_MMS_UPDATE);
+}
+
+static void dma_setup(void)
+{
+	/* DAC channel 1 uses DMA controller 1 Stream 5 Channel 7. */
+	nvic_enable_irq(NVIC_DMA1_STREAM5_IRQ);
+	dma_stream_reset(DMA1, DMA_STREAM5);
+	dma_set_priority(DMA1, DMA_STREAM5, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(DMA1, DMA_STREAM5, DMA_SxCR_MSIZE_32BIT);
+	dma_set_peripheral_size(DMA1, DMA_STREAM5, DMA_SxCR_PSIZE_32BIT);
+	dma_enable_memory_increment_mode(DMA1, DMA_STREAM5);
+	dma_enable_circular_mode(DMA1, DMA_STREAM5);
+	dma_set_transfer_mode(DMA1, DMA_STREAM5,
+				DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	/* Both channels at once, through the dual 12 bit data register */
+	dma_set_peripheral_address(DMA1, DMA_STREAM5,
+				   (uint32_t)&DAC_DHR12RD(DAC1));
+	dma_set_memory_address(DMA1, DMA_STREAM5, (uint32_t)play);
+	dma_set_number_of_data(DMA1, DMA_STREAM5, WAVE_SAMPLES);
+	dma_enable_half_transfer_interrupt(DMA1, DMA_STREAM5);
+	dma_enable_transfer_complete_interrupt(DMA1, DMA_STREAM5);
+	dma_channel_select(DMA1, DMA_STREAM5, DMA_SxCR_CHSEL_7);
+	dma_enable_stream(DMA1, DMA_STREAM5);
+}
+
+static void dac_setup(void)
+{
+	/* Both channels on the timer 2 trigger, channel 1 asks for the DMA */
+	dac_trigger_enable(DAC1, DAC_CHANNEL_BOTH);
+	dac_set_trigger_source(DAC1, DAC_CR_TSEL1_T2 | DAC_CR_TSEL2_T2);
+	dac_dma_enable(DAC1, DAC_CHANNEL1);
+	dac_enable(DAC1, DAC_CHANNEL_BOTH);
+}
+
+void wave_init(uint32_t rate)
+{
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_GPIOC);
+	rcc_periph_clock_enable(RCC_DMA1);
+	rcc_periph_clock_enable(RCC_DAC);
+	rcc_periph_clock_enable(RCC_TIM2);
+	rcc_periph_clock_enable(RCC_RNG);
+	RNG_CR |= RNG_CR_RNGEN;
+
+	/* The digital test output on PC1, toggled once per table */
+	gpio_mode_setup(GPIOC, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, GPIO1);
+	gpio_set_output_options(GPIOC, GPIO_OTYPE_PP, GPIO_OSPEED_2MHZ, GPIO1);
+	/* PA4 and PA5 for DAC channels 1 and 2, analogue. */
+	gpio_mode_setup(GPIOA, GPIO_MODE_ANALOG, GPIO_PUPD_NONE,
+			GPIO4 | GPIO5);
+
+	/* Start at mid scale, until there is something to play */
+	wave_dc(play, WAVE_CH1, (WAVE_MAX + 1) / 2);
+	wave_dc(play, WAVE_CH2, (WAVE_MAX + 1) / 2);
+	memcpy(next, play, sizeof(next));
+
+	wave_set_rate(rate);
+	timer_setup();
+	dma_setup();
+	dac_setup();
+	timer_enable_counter(TIM2);
+}
+
+uint32_t wave_set_rate(uint32_t rate)
+{
+	uint32_t min = timer_clock() / WAVE_MAX_RATE;
+
+	period = rate ? (timer_clock() + rate / 2) / rate : 0;
+	if (period < min) {
+		period = min;
+	}
+	/* TIM2 is 32 bit, so no prescaler is needed for any rate */
+	timer_set_period(TIM2, period - 1);
+	return wave_rate_mhz();
+}
+
+uint32_t wave_rate_mhz(void)
+{
+	return ((uint64_t)timer_clock() * 1000 + period / 2) / period;
+}
+
+uint32_t *wave_edit(void)
+{
+	while (swap != SWAP_IDLE);
+	return next;
+}
+
+void wave_commit(void)
+{
+	swap = SWAP_REQUESTED;
+}
+
+uint32_t wave_swaps(void)
+{
+	return swaps;
+}
+
+/*
+ * The first half of the new table goes in while the DMA plays the second
+ * half of the old one, and the second half once it has wrapped around to
+ * the first. Copying half a table takes a few microseconds, far less
+ * than playing it. If the interrupt was so late that both flags are set,
+ * it can't tell where the DMA is and leaves the swap for the next pass.
+ */
+void dma1_stream5_isr(void)
+{
+	uint32_t flags = 0;
+
+	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_HTIF)) {
+		flags |= DMA_HTIF;
+	}
+	if (dma_get_interrupt_flag(DMA1, DMA_STREAM5, DMA_TCIF)) {
+		flags |= DMA_TCIF;
+	}
+	dma_clear_interrupt_flags(DMA1, DMA_STREAM5, flags);
+
+	if (flags == DMA_HTIF && swap == SWAP_REQUESTED) {
+		memcpy(play, next, HALF * sizeof(play[0]));
+		swap = SWAP_HALF;
+	} else if (flags == DMA_TCIF && swap == SWAP_HALF) {
+		memcpy(&play[HALF], &next[HALF], HALF * sizeof(play[0]));
+		swap = SWAP_IDLE;
+		swaps++;
+	} else if (flags == (DMA_HTIF | DMA_TCIF) && swap == SWAP_HALF) {
+		swap = SWAP_REQUESTED;
+	}
+
+	if (flags & DMA_TCIF) {
+		/* Toggle PC1 just to keep aware of activity and frequency. */
+		gpio_toggle(GPIOC, GPIO1);
+	}
+}
+
+/*
+ * Fixed point sine: the phase picks the quadrant and a position t in it,
+ * and sin(t * pi / 2) comes from an odd 5th order polynomial in Q15,
+ * fitted to stay within 6/32767 of the real thing (a third of a 12 bit
+ * step) and to reach exactly 32767 at the peak.
+ */
+int16_t wave_sin(uint32_t phase)
+{
+	int32_t t, t2, r;
+
+	t = (phase >> 15) & 0x7fff;
+	if (phase & 0x40000000) {
+		t = 0x8000 - t;
+	}
+	t2 = (t * t) >> 15;
+	r = 2363;
+	r = -21062 + ((r * t2) >> 15);
+	r = 51466 + ((r * t2) >> 15);
+	r = (r * t) >> 15;
+	return phase & 0x80000000 ? -r : r;
+}
+
+static void put(uint32_t *table, enum wave_channel ch, uint32_t i, int32_t v)
+{
+	if (v < 0) {
+		v = 0;
+	} else if (v > WAVE_MAX) {
+		v = WAVE_MAX;
+	}
+	table[i] = (table[i] & ~(0xffffu << ch)) | ((uint32_t)v << ch);
+}
+
+void wave_dc(uint32_t *table, enum wave_channel ch, uint16_t value)
+{
+	uint32_t i;
+
+	for (i = 0; i < WAVE_SAMPLES; i++) {
+		put(table, ch, i, value);
+	}
+}
+
+/* cycles whole periods in the table, starting at phase */
+void wave_sine(uint32_t *table, enum wave_channel ch, uint32_t cycles,
+	       uint16_t amplitude, uint16_t offset, uint32_t phase)
+{
+	uint32_t step = cycles << (32 - WAVE_SHIFT), i;
+
+	for (i = 0; i < WAVE_SAMPLES; i++, phase += step) {
+		put(table, ch, i, offset + ((wave_sin(phase) * amplitude) >> 15));
+	}
+}
+
+/*
+ * A sweep from 'from' to 'to' cycles per table and back again, the
+ * frequency rising linearly over the first half and falling over the
+ * second, so the table repeats without a jump in either frequency or
+ * phase. The phase adds up to (from + to) / 2 turns over the table, so
+ * 'to' is raised by one if needed to make that a whole number.
+ */
+void wave_sweep(uint32_t *table, enum wave_channel ch, uint32_t from,
+		uint32_t to, uint16_t amplitude, uint16_t offset)
+{
+	uint32_t phase = 0, i, k;
+
+	if ((from + to) & 1) {
+		to++;
+	}
+	for (i = 0; i < WAVE_SAMPLES; i++) {
+		put(table, ch, i, offset + ((wave_sin(phase) * amplitude) >> 15));
+		/* step = (from + (to - from) * k / HALF) turns / WAVE_SAMPLES */
+		k = i < HALF ? i : WAVE_SAMPLES - i;
+		phase += (uint32_t)((int32_t)(from * HALF) +
+				    (int32_t)(to - from) * (int32_t)k)
+			 << (33 - 2 * WAVE_SHIFT);
+	}
+}
+
+static uint32_t rng_read(void)
+{
+	while (!(RNG_SR & RNG_SR_DRDY)) {
+		/* A seed error needs the RNG restarted */
+		if (RNG_SR & RNG_SR_SEIS) {
+			RNG_SR &= ~RNG_SR_SEIS;
+			RNG_CR &= ~RNG_CR_RNGEN;
+			RNG_CR |= RNG_CR_RNGEN;
+		}
+	}
+	return RNG_DR;
+}
+
+/* Uniform noise of +-amplitude around offset, from the hardware RNG */
+void wave_noise(uint32_t *table, enum wave_channel ch, uint16_t amplitude,
+		uint16_t offset)
+{
+	uint32_t r = 0, i;
+	int32_t n;
+
+	for (i = 0; i < WAVE_SAMPLES; i++) {
+		if (!(i & 1)) {
+			r = rng_read();
+		} else {
+			r >>= 16;
+		}
+		n = (int32_t)(r & 0xffff) - 0x8000;
+		put(table, ch, i, offset + ((n * amplitude) >> 15));
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WAVEGEN_H
+#define __WAVEGEN_H
+
+#include <stdint.h>
+
+/*
+ * Two channel waveform generator on DAC1.
+ *
+ * A table holds WAVE_SAMPLES samples for both channels, packed the way
+ * the dual 12 bit data register takes them (channel 1 in bits 11:0,
+ * channel 2 in bits 27:16). TIM2 triggers both channels at the sample
+ * rate and DMA1 stream 5 plays the table round and round.
+ *
+ * Changes are made to a second table (wave_edit()) and swapped in by
+ * wave_commit() at the start of the next pass through the table, half
+ * at a time from the half and full transfer interrupts, so the output
+ * never mixes the two. The sample rate is changed by reloading the timer
+ * period, which takes effect at the next trigger; the DMA keeps running.
+ */
+
+#define WAVE_SHIFT	10
+#define WAVE_SAMPLES	(1 << WAVE_SHIFT)
+#define WAVE_MAX	4095
+#define WAVE_MAX_RATE	1000000		/* What the DAC settles to */
+
+enum wave_channel {
+	WAVE_CH1 = 0,
+	WAVE_CH2 = 16,
+};
+
+void wave_init(uint32_t rate);
+/* Returns the actual rate in mHz, the period is a whole number of ticks */
+uint32_t wave_set_rate(uint32_t rate);
+uint32_t wave_rate_mhz(void);
+/* The table to change, waits for a swap in progress */
+uint32_t *wave_edit(void);
+void wave_commit(void);
+uint32_t wave_swaps(void);
+
+/* Sine in Q15 for a 32 bit phase, 0x40000000 is a quarter turn */
+int16_t wave_sin(uint32_t phase);
+
+/* Table generators, each fills one channel of a table */
+void wave_dc(uint32_t *table, enum wave_channel ch, uint16_t value);
+void wave_sine(uint32_t *table, enum wave_channel ch, uint32_t cycles,
+	       uint16_t amplitude, uint16_t offset, uint32_t phase);
+void wave_sweep(uint32_t *table, enum wave_channel ch, uint32_t from,
+		uint32_t to, uint16_t amplitude, uint16_t offset);
+void wave_noise(uint32_t *table, enum wave_channel ch, uint16_t amplitude,
+		uint16_t offset);
+
+#endif
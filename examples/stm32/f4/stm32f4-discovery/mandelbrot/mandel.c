@@ -22,6 +22,18 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
+#include "prof.h"
+
+/* Frames between two profile reports */
+#define REPORT_FRAMES	8
+
+static PROF_STAT(prof_compute, "row compute");
+static PROF_STAT(prof_output, "row output");
+static PROF_STAT(prof_frame, "frame");
+
+static struct prof_stat *const prof_stats[] = {
+	&prof_compute, &prof_output, &prof_frame, NULL
+};
 
 static void clock_setup(void)
 {
@@ -88,29 +100,68 @@ static int iterate(float px, float py)
 
 static void mandel(float cX, float cY, float scale)
 {
+	char row[100];
 	int x, y;
 	for (x = -60; x < 60; x++) {
-		for (y = -50; y < 50; y++) {
-			int i = iterate(cX + x*scale, cY + y*scale);
-			usart_send_blocking(USART2, color[i]);
+		PROF_SCOPE(&prof_compute) {
+			for (y = -50; y < 50; y++) {
+				int i = iterate(cX + x*scale, cY + y*scale);
+				row[y + 50] = color[i];
+			}
 		}
-		usart_send_blocking(USART2, '\r');
-		usart_send_blocking(USART2, '\n');
+		PROF_SCOPE(&prof_output) {
+			for (y = 0; y < 100; y++) {
+				usart_send_blocking(USART2, row[y]);
+			}
+			usart_send_blocking(USART2, '\r');
+			usart_send_blocking(USART2, '\n');
+		}
+	}
+}
+
+static void report_puts(const char *s)
+{
+#ifdef HOST_BUILD
+	/* The USART goes nowhere on the host */
+	prof_swo_puts(s);
+#endif
+	while (*s) {
+		if (*s == '\n') {
+			usart_send_blocking(USART2, '\r');
+		}
+		usart_send_blocking(USART2, *s++);
 	}
 }
 
 int main(void)
 {
 	float scale = 0.25f, centerX = -0.5f, centerY = 0.0f;
+	int frame = 0, i;
 
 	clock_setup();
 	gpio_setup();
 	usart_setup();
+	prof_init();
 
 	while (1) {
 		/* Blink the LED (PD12) on the board with each fractal drawn. */
 		gpio_toggle(GPIOD, GPIO12);		/* LED on/off */
-		mandel(centerX, centerY, scale);	/* draw mandelbrot */
+		PROF_SCOPE(&prof_frame) {
+			/* draw mandelbrot */
+			mandel(centerX, centerY, scale);
+		}
+
+		/* Report, and start over, every few frames. */
+		if (++frame % REPORT_FRAMES == 0) {
+			prof_report(prof_stats, report_puts);
+			for (i = 0; prof_stats[i]; i++) {
+				prof_reset(prof_stats[i]);
+			}
+#ifdef HOST_BUILD
+			/* One report is all a CI run needs. */
+			return 0;
+#endif
+		}
 
 		/* Change scale and center */
 		centerX += 0.175f * scale;
@@ -23,6 +23,17 @@
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/cdc.h>
 #include <libopencm3/cm3/scb.h>
+#include "prof.h"
+
+/* Seconds between two profile reports */
+#define REPORT_SECONDS	5
+
+static PROF_STAT(prof_poll, "usbd_poll");
+static PROF_STAT(prof_echo, "rx echo");
+
+static struct prof_stat *const prof_stats[] = {
+	&prof_poll, &prof_echo, NULL
+};
 
 static const struct usb_device_descriptor dev = {
 	.bLength = USB_DT_DEVICE_SIZE,
@@ -198,12 +209,14 @@ static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
 	(void)ep;
 
+	uint32_t t0 = prof_now();
 	char buf[64];
 	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
 
 	if (len) {
 		while (usbd_ep_write_packet(usbd_dev, 0x82, buf, len) == 0);
 	}
+	prof_record(&prof_echo, prof_now() - t0);
 }
 
 static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
@@ -225,6 +238,8 @@ static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
 int main(void)
 {
 	usbd_device *usbd_dev;
+	uint32_t t0, last_report;
+	int i;
 
 	rcc_clock_setup_pll(&rcc_hse_8mhz_3v3[RCC_CLOCK_3V3_168MHZ]);
 
@@ -240,7 +255,20 @@ int main(void)
 
 	usbd_register_set_config_callback(usbd_dev, cdcacm_set_config);
 
+	prof_init();
+	last_report = prof_now();
 	while (1) {
+		t0 = prof_now();
 		usbd_poll(usbd_dev);
+		prof_record(&prof_poll, prof_now() - t0);
+
+		/* Out on SWO, if the debugger has set it up. */
+		if (prof_now() - last_report >= REPORT_SECONDS * prof_hz()) {
+			prof_report(prof_stats, prof_swo_puts);
+			for (i = 0; prof_stats[i]; i++) {
+				prof_reset(prof_stats[i]);
+			}
+			last_report = prof_now();
+		}
 	}
 }
@@ -0,0 +1,505 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host simulation of serial.c, built by 'make HOST=1'.
+ *
+ * The Makefile wraps usbd_ep_read_packet(), usbd_ep_write_packet(),
+ * usbd_ep_nak_set() and dma_enable_stream() at link time, and this file
+ * plays the USB host and controller, both DMA streams and the wire, a
+ * step at a time:
+ *
+ *  - The host writes a known byte stream in OUT packets of 1 to 64
+ *    bytes, and reads IN packets with pauses long enough to fill the
+ *    receive buffer several times over.
+ *  - Reading an OUT packet arms the endpoint again unless it is set to
+ *    NAK, and the next packet may come in before a NAK set afterwards.
+ *  - The TX stream sends a few bytes each step and then sets TCIF, often
+ *    with FEIF as the hardware does; the RX stream fills the circular
+ *    buffer, and its interrupt sometimes runs only after the main loop.
+ *
+ * First TX is looped back to RX and RTS to CTS. Everything the host
+ * writes has to come back to it in order, with no overrun and no byte
+ * lost. Then RX is flooded by a sender that ignores RTS, with an
+ * occasional ORE: now the host may miss data, but only as much as the
+ * bridge says it dropped and only after an overrun was reported, and it
+ * must never get a byte twice, out of order, or from an older lap of
+ * the buffer. What goes out on TX has to be the host's data throughout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/usb/cdc.h>
+#include "serial.h"
+
+#define TX_STREAM	DMA_STREAM6
+#define RX_STREAM	DMA_STREAM1
+#define RX_BUF_MAX	4096
+#define STREAM_FLAGS	(DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | DMA_FEIF)
+
+void __real_dma_enable_stream(uint32_t dma, uint8_t stream);
+
+uint16_t __wrap_usbd_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+				    void *buf, uint16_t len);
+uint16_t __wrap_usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+				     const void *buf, uint16_t len);
+void __wrap_usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr,
+			    uint8_t nak);
+void __wrap_dma_enable_stream(uint32_t dma, uint8_t stream);
+
+/* The host */
+static uint32_t host_out;		/* bytes put into OUT packets */
+static uint32_t host_out_end;		/* how many to write */
+static uint32_t host_in;		/* next stream position expected */
+static uint32_t host_gaps;		/* bytes skipped in the IN stream */
+static uint32_t host_notified;		/* overruns reported to it */
+static uint32_t host_pause;		/* steps left not reading */
+static uint32_t seen_overruns;
+
+/* The USB controller */
+static int ep_armed = 1, ep_nak;
+static uint8_t pending[SERIAL_PACKET_SIZE];
+static uint16_t pending_len;
+static int pending_read;
+static int in_busy, notify_busy;
+
+/* The DMA streams and the wire */
+static uint32_t tx_len0;		/* NDTR when the TX stream started */
+static uint32_t tx_sent;		/* bytes out of TX so far */
+static uint32_t rx_len0;
+static uint32_t rx_in;			/* bytes into the RX buffer so far */
+static uint32_t rx_pos[RX_BUF_MAX];	/* stream position of each byte */
+static int rx_irq_late;
+static int rts_off, rts_offs;
+static uint32_t ore_events;
+static int ore_seen_clear;		/* serial_poll() ran with no ORE */
+
+static int errors;
+
+enum wire { LOOPBACK, FLOOD, QUIET };
+
+static uint8_t stream_byte(uint32_t pos)
+{
+	return (pos * 2654435761u) >> 24;
+}
+
+/*
+ * The address registers only hold the low 32 bits of an address, the
+ * buffers are in serial.c's bss, which shares its upper bits with ours.
+ */
+static uint8_t *dma_buffer(uint32_t m0ar)
+{
+	uintptr_t high = (uintptr_t)rx_pos & ~(uintptr_t)0xffffffff;
+
+	return (uint8_t *)(high | m0ar);
+}
+
+static uint32_t *isr_reg(uint8_t stream)
+{
+	return stream < 4 ? (uint32_t *)&DMA_LISR(DMA2) :
+			    (uint32_t *)&DMA_HISR(DMA2);
+}
+
+/* LIFCR/HIFCR are write one to clear */
+static void apply_flag_clears(void)
+{
+	DMA_LISR(DMA2) &= ~DMA_LIFCR(DMA2);
+	DMA_LIFCR(DMA2) = 0;
+	DMA_HISR(DMA2) &= ~DMA_HIFCR(DMA2);
+	DMA_HIFCR(DMA2) = 0;
+}
+
+static uint32_t stream_flags(uint8_t stream)
+{
+	return (*isr_reg(stream) >> DMA_ISR_OFFSET(stream)) & STREAM_FLAGS;
+}
+
+static void set_flags(uint8_t stream, uint32_t flags)
+{
+	*isr_reg(stream) |= flags << DMA_ISR_OFFSET(stream);
+}
+
+void __wrap_dma_enable_stream(uint32_t dma, uint8_t stream)
+{
+	apply_flag_clears();
+	if (stream_flags(stream)) {
+		printf("stream %u enabled with flags 0x%02x set\n", stream,
+		       stream_flags(stream));
+		errors++;
+	}
+	if (stream == TX_STREAM) {
+		tx_len0 = DMA_SNDTR(dma, stream);
+	} else {
+		rx_len0 = DMA_SNDTR(dma, stream);
+	}
+	__real_dma_enable_stream(dma, stream);
+}
+
+static void new_packet(void)
+{
+	uint16_t i;
+
+	pending_len = 1 + rand() % SERIAL_PACKET_SIZE;
+	if (pending_len > host_out_end - host_out) {
+		pending_len = host_out_end - host_out;
+	}
+	for (i = 0; i < pending_len; i++) {
+		pending[i] = stream_byte(host_out++);
+	}
+	ep_armed = 0;
+}
+
+uint16_t __wrap_usbd_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+				    void *buf, uint16_t len)
+{
+	(void)usbd_dev;
+
+	if (addr != SERIAL_EP_OUT || len < pending_len) {
+		printf("bad read of endpoint 0x%02x\n", addr);
+		errors++;
+	}
+	memcpy(buf, pending, pending_len);
+	len = pending_len;
+	pending_len = 0;
+	pending_read = 1;
+	ep_armed = !ep_nak;
+	return len;
+}
+
+void __wrap_usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr,
+			    uint8_t nak)
+{
+	(void)usbd_dev;
+	(void)addr;
+
+	/* A packet can come in right before the NAK takes effect */
+	if (nak && ep_armed && !pending_len && host_out < host_out_end &&
+	    rand() % 2) {
+		new_packet();
+	}
+	ep_nak = nak;
+	ep_armed = !nak && !pending_len;
+}
+
+static void host_check_in(const uint8_t *buf, uint16_t len)
+{
+	const uint8_t *base = dma_buffer(DMA_SM0AR(DMA2, RX_STREAM));
+	uint32_t i = buf - base, first, k;
+
+	if (buf < base || i + len > rx_len0) {
+		printf("IN packet from outside the RX buffer\n");
+		errors++;
+		return;
+	}
+	first = rx_pos[i];
+	for (k = 0; k < len; k++) {
+		if (rx_pos[i + k] != first + k ||
+		    buf[k] != stream_byte(first + k)) {
+			printf("IN packet at %u is not one piece of the stream\n",
+			       host_in);
+			errors++;
+			return;
+		}
+	}
+	if (first < host_in) {
+		printf("IN data at %u again, expected %u\n", first, host_in);
+		errors++;
+	} else if (first > host_in) {
+		if (serial_stats.rx_overruns == seen_overruns) {
+			printf("%u bytes skipped at %u, with no overrun\n",
+			       first - host_in, host_in);
+			errors++;
+		}
+		host_gaps += first - host_in;
+	}
+	seen_overruns = serial_stats.rx_overruns;
+	host_in = first + len;
+}
+
+uint16_t __wrap_usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+				     const void *buf, uint16_t len)
+{
+	const uint8_t *p = buf;
+
+	(void)usbd_dev;
+
+	if (addr == SERIAL_EP_NOTIFY) {
+		if (notify_busy) {
+			return 0;
+		}
+		if (len != 10 || p[0] != 0xA1 ||
+		    p[1] != USB_CDC_NOTIFY_SERIAL_STATE || p[8] != 1 << 6) {
+			printf("bad notification\n");
+			errors++;
+		}
+		host_notified++;
+		notify_busy = 1;
+		return len;
+	}
+	if (addr != SERIAL_EP_IN || len == 0 || len > SERIAL_PACKET_SIZE) {
+		printf("bad write of %u bytes to endpoint 0x%02x\n", len, addr);
+		errors++;
+		return 0;
+	}
+	if (in_busy) {
+		return 0;
+	}
+	host_check_in(p, len);
+	in_busy = 1;
+	return len;
+}
+
+static void usb_step(void)
+{
+	int i;
+
+	if (!pending_len && ep_armed && host_out < host_out_end) {
+		new_packet();
+	}
+	if (pending_len) {
+		pending_read = 0;
+		serial_out_cb(NULL, SERIAL_EP_OUT);
+		if (!pending_read) {
+			printf("OUT packet at %u left unread\n",
+			       host_out - pending_len);
+			errors++;
+			pending_len = 0;
+		}
+	}
+
+	/* Every so often the host stops reading for a while */
+	if (host_pause) {
+		host_pause--;
+		return;
+	}
+	if (rand() % 200 == 0) {
+		host_pause = rand() % 300;
+	}
+	for (i = 0; i < 2 && in_busy; i++) {
+		in_busy = 0;
+		serial_in_cb(NULL, SERIAL_EP_IN);
+	}
+	notify_busy = 0;
+}
+
+static int rx_irq_pending(void)
+{
+	uint32_t cr = DMA_SCR(DMA2, RX_STREAM), flags = stream_flags(RX_STREAM);
+
+	return ((flags & DMA_HTIF) && (cr & DMA_SxCR_HTIE)) ||
+	       ((flags & DMA_TCIF) && (cr & DMA_SxCR_TCIE));
+}
+
+static void rx_byte(uint8_t *buf, uint8_t b)
+{
+	uint32_t left = DMA_SNDTR(DMA2, RX_STREAM);
+	uint32_t i = rx_len0 - left;
+
+	buf[i] = b;
+	rx_pos[i] = rx_in++;
+	/* SR then DR clears ORE, serial_poll() has read SR since */
+	USART_SR(USART6) &= ~USART_SR_ORE;
+
+	if (--left == rx_len0 / 2) {
+		set_flags(RX_STREAM, DMA_HTIF);
+	} else if (left == 0) {
+		set_flags(RX_STREAM, DMA_TCIF);
+		left = rx_len0;
+	}
+	DMA_SNDTR(DMA2, RX_STREAM) = left;
+	if (rx_irq_pending() && !rx_irq_late) {
+		rx_irq_late = rand() % 3 == 0;
+		if (!rx_irq_late) {
+			dma2_stream1_isr();
+			apply_flag_clears();
+		}
+	}
+}
+
+static void tx_done(void)
+{
+	DMA_SCR(DMA2, TX_STREAM) &= ~DMA_SxCR_EN;
+	set_flags(TX_STREAM, rand() % 2 ? DMA_TCIF | DMA_FEIF : DMA_TCIF);
+	if (DMA_SCR(DMA2, TX_STREAM) & DMA_SxCR_TCIE) {
+		dma2_stream6_isr();
+		apply_flag_clears();
+	}
+}
+
+/* Up to n bytes out of TX, and into RX as the wire is connected */
+static void wire_step(uint32_t n, enum wire wire)
+{
+	uint8_t *rx = dma_buffer(DMA_SM0AR(DMA2, RX_STREAM));
+	const uint8_t *tx;
+	uint32_t left, b;
+
+	while (n-- && (DMA_SCR(DMA2, TX_STREAM) & DMA_SxCR_EN)) {
+		tx = dma_buffer(DMA_SM0AR(DMA2, TX_STREAM));
+		left = DMA_SNDTR(DMA2, TX_STREAM);
+		b = tx[tx_len0 - left];
+		if (b != stream_byte(tx_sent)) {
+			printf("TX byte %u is 0x%02x, should be 0x%02x\n",
+			       tx_sent, b, stream_byte(tx_sent));
+			errors++;
+		}
+		tx_sent++;
+		if (wire == LOOPBACK) {
+			rx_byte(rx, b);
+		}
+		DMA_SNDTR(DMA2, TX_STREAM) = --left;
+		if (left == 0) {
+			tx_done();
+		}
+	}
+
+	if (wire != FLOOD) {
+		return;
+	}
+	/*
+	 * A sender that takes no notice of RTS, and now and then an ORE. Two
+	 * of them with no poll in between look like one to the bridge, so
+	 * only set it again once the bridge has seen it clear.
+	 */
+	for (n = rand() % 96; n; n--) {
+		rx_byte(rx, stream_byte(rx_in));
+	}
+	if (ore_seen_clear && rand() % 500 == 0) {
+		USART_SR(USART6) |= USART_SR_ORE;
+		ore_seen_clear = 0;
+		ore_events++;
+	}
+}
+
+static void step(enum wire wire)
+{
+	usb_step();
+	wire_step(rand() % 96, wire);
+	serial_poll(NULL);
+	if (!(USART_SR(USART6) & USART_SR_ORE)) {
+		ore_seen_clear = 1;
+	}
+
+	/* RTS (PC8) is written through BSRR, and looped back to CTS (PC9) */
+	if (GPIO_BSRR(GPIOC) & GPIO8) {
+		rts_off = 1;
+		rts_offs++;
+	} else if (GPIO_BSRR(GPIOC) & (GPIO8 << 16)) {
+		rts_off = 0;
+	}
+	GPIO_BSRR(GPIOC) = 0;
+	if (wire == LOOPBACK && rts_off) {
+		GPIO_IDR(GPIOC) |= GPIO9;
+	} else {
+		GPIO_IDR(GPIOC) &= ~GPIO9;
+	}
+
+	if (rx_irq_late) {
+		rx_irq_late = 0;
+		dma2_stream1_isr();
+		apply_flag_clears();
+	}
+}
+
+/*
+ * Until the host has written all and the bridge has nothing left. The
+ * bytes dropped last are only seen as a gap when more data comes.
+ */
+static void drain(enum wire wire)
+{
+	uint32_t i;
+
+	for (i = 0; i < 10000000; i++) {
+		if (host_out == host_out_end && !pending_len &&
+		    tx_sent == host_out &&
+		    rx_in - host_in == serial_stats.rx_dropped - host_gaps &&
+		    !(DMA_SCR(DMA2, TX_STREAM) & DMA_SxCR_EN) &&
+		    host_notified == serial_stats.rx_overruns +
+				     serial_stats.usart_overruns) {
+			host_gaps += rx_in - host_in;
+			host_in = rx_in;
+			return;
+		}
+		step(wire);
+	}
+	printf("stuck: %u of %u written, %u sent, %u of %u read\n",
+	       host_out, host_out_end, tx_sent, host_in, rx_in);
+	errors++;
+}
+
+static void report(const char *name)
+{
+	printf("%-9s %9u %9u %6u %9u %10u %6u\n", name, tx_sent, rx_in,
+	       rts_offs, serial_stats.rx_overruns, serial_stats.rx_dropped,
+	       serial_stats.usart_overruns);
+}
+
+int main(void)
+{
+	uint32_t i;
+
+	serial_setup();
+	apply_flag_clears();
+	if (DMA_SNDTR(DMA2, RX_STREAM) > RX_BUF_MAX) {
+		printf("RX buffer larger than the simulation's\n");
+		return 1;
+	}
+
+	printf("%-9s %9s %9s %6s %9s %10s %6s\n", "", "TX bytes", "RX bytes",
+	       "RTS", "overruns", "dropped", "ORE");
+
+	host_out_end = 4 << 20;
+	drain(LOOPBACK);
+	report("loopback");
+	if (serial_stats.rx_overruns || host_gaps || !rts_offs) {
+		printf("loopback: expected flow control and no overruns\n");
+		errors++;
+	}
+
+	host_out_end += 1 << 20;
+	for (i = 0; i < 200000; i++) {
+		step(FLOOD);
+	}
+	drain(QUIET);
+	report("flood");
+	if (!serial_stats.rx_overruns || ore_events == 0) {
+		printf("flood: expected overruns\n");
+		errors++;
+	}
+	if (host_gaps != serial_stats.rx_dropped) {
+		printf("flood: %u bytes missing, %u reported dropped\n",
+		       host_gaps, serial_stats.rx_dropped);
+		errors++;
+	}
+	if (serial_stats.usart_overruns != ore_events) {
+		printf("flood: %u ORE, %u counted\n", ore_events,
+		       serial_stats.usart_overruns);
+		errors++;
+	}
+	if (serial_stats.out_dropped) {
+		printf("%u OUT packets dropped\n", serial_stats.out_dropped);
+		errors++;
+	}
+
+	printf("%s\n", errors ? "FAILED" : "no byte lost unreported, "
+	       "repeated or out of order");
+	return errors ? 1 : 0;
+}
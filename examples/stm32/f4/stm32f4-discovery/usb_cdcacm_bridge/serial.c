@@ -0,0 +1,417 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/usb/cdc.h>
+#include "serial.h"
+
+/*
+ * The USART side of the bridge.
+ *
+ * Host to USART: every OUT packet is read from the USB FIFO straight
+ * into one of OUT_SLOTS packet buffers, and USART6 TX DMA sends the
+ * buffers in order right out of the same memory, no other copy is
+ * made. While all buffers are waiting to be sent the OUT endpoint is
+ * set to NAK, so the host simply retries later and nothing is lost;
+ * the main loop opens it again as soon as the DMA has freed a buffer.
+ * The NAK is set before the packet that takes the last buffer is read,
+ * as the read arms the endpoint for the next one otherwise.
+ *
+ * USART to host: USART6 RX DMA runs in circular mode over in_buf, and
+ * IN packets are written to the USB FIFO directly from there, up to 64
+ * bytes at a time, from the IN completion callback or the main loop,
+ * whichever finds the endpoint free first. The half transfer and
+ * transfer complete interrupts count the halves of in_buf filled, which
+ * with the DMA's position in it gives the bytes received so far; set
+ * against the bytes handed to the host, that is what is waiting.
+ *
+ * When half of in_buf is waiting RTS goes off, and on again when only a
+ * quarter is. USART6's own RTS and CTS pins are on port G, which the
+ * 100 pin STM32F407 of this board does not have, so both are plain
+ * GPIOs here: RTS is driven from the main loop, and CTS is looked at
+ * before each packet buffer is sent. The other side then gets up to a
+ * packet more after it turned CTS off, where the USART would stop
+ * after the current byte.
+ * If the other side sends on regardless and the host falls so far
+ * behind that the DMA is about to write over what is waiting, all of it
+ * is dropped; an overrun in the USART itself (ORE) loses a byte too.
+ * Either way the host gets a SERIAL_STATE notification with bOverRun
+ * set, Linux counts those in the overrun field of TIOCGICOUNT. CTS is
+ * pulled down, so the bridge sends when it is left open.
+ *
+ * USART6 (PC6 TX, PC7 RX, PC8 RTS, PC9 CTS) hangs off the 84MHz APB2
+ * and reaches 10.5 Mbaud with 8 times oversampling, about 1MB/s in each
+ * direction.
+ */
+#define BRIDGE_USART		USART6
+#define BRIDGE_DMA		DMA2
+#define BRIDGE_TX_STREAM	DMA_STREAM6
+#define BRIDGE_RX_STREAM	DMA_STREAM1
+#define BRIDGE_DMA_CHANNEL	DMA_SxCR_CHSEL_5
+#define BRIDGE_DMA_FLAGS	(DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | \
+				 DMA_FEIF)
+#define BRIDGE_FLOW_PORT	GPIOC
+#define BRIDGE_RTS		GPIO8
+#define BRIDGE_CTS		GPIO9
+
+#define PACKET_SIZE	SERIAL_PACKET_SIZE
+#define OUT_SLOTS	8		/* Power of two */
+#define IN_BUF_SIZE	2048		/* Power of two */
+#define IN_HALF		(IN_BUF_SIZE / 2)
+#define IN_RTS_OFF	(IN_BUF_SIZE / 2)
+#define IN_RTS_ON	(IN_BUF_SIZE / 4)
+
+/* bOverRun in the UART state of a SERIAL_STATE notification */
+#define SERIAL_STATE_OVERRUN	(1 << 6)
+
+struct serial_stats serial_stats;
+
+static uint8_t out_slot[OUT_SLOTS][PACKET_SIZE];
+static uint16_t out_len[OUT_SLOTS];
+static volatile uint32_t out_head;	/* written by the USB callback */
+static volatile uint32_t out_tail;	/* written by the DMA interrupt */
+static volatile int out_busy;
+static int out_nak;
+
+static uint8_t in_buf[IN_BUF_SIZE];
+static volatile uint32_t in_halves;	/* written by the DMA interrupt */
+static uint32_t in_sent;		/* bytes handed to the host */
+static int in_rts_off;
+static int in_ore;
+
+/* Overruns the host has not been told about yet */
+static uint32_t notify_overruns;
+
+/* USARTDIV in 1/16ths, or 1/8ths above what 16x oversampling can do */
+void serial_set_baudrate(uint32_t baud)
+{
+	uint32_t div = (rcc_apb2_frequency + baud / 2) / baud;
+
+	usart_disable(BRIDGE_USART);
+	if (baud > rcc_apb2_frequency / 16) {
+		USART_CR1(BRIDGE_USART) |= USART_CR1_OVER8;
+		USART_BRR(BRIDGE_USART) = ((div & ~7) << 1) | (div & 7);
+	} else {
+		USART_CR1(BRIDGE_USART) &= ~USART_CR1_OVER8;
+		USART_BRR(BRIDGE_USART) = div;
+	}
+	usart_enable(BRIDGE_USART);
+}
+
+/*
+ * Send the oldest waiting packet buffer, the stream is idle. With CTS
+ * off it waits instead, for serial_poll() to call out_start() again.
+ */
+static void out_dma_next(void)
+{
+	uint32_t n = out_tail & (OUT_SLOTS - 1);
+
+	if (gpio_get(BRIDGE_FLOW_PORT, BRIDGE_CTS)) {
+		out_busy = 0;
+		return;
+	}
+	dma_set_memory_address(BRIDGE_DMA, BRIDGE_TX_STREAM,
+			       (uint32_t)out_slot[n]);
+	dma_set_number_of_data(BRIDGE_DMA, BRIDGE_TX_STREAM, out_len[n]);
+	dma_enable_stream(BRIDGE_DMA, BRIDGE_TX_STREAM);
+}
+
+/*
+ * The interrupt clears out_busy when it runs out of packets, so check
+ * and start with it masked.
+ */
+static void out_start(void)
+{
+	nvic_disable_irq(NVIC_DMA2_STREAM6_IRQ);
+	if (!out_busy && out_tail != out_head) {
+		out_busy = 1;
+		out_dma_next();
+	}
+	nvic_enable_irq(NVIC_DMA2_STREAM6_IRQ);
+}
+
+void dma2_stream6_isr(void)
+{
+	if (!dma_get_interrupt_flag(BRIDGE_DMA, BRIDGE_TX_STREAM,
+				    DMA_TCIF | DMA_TEIF)) {
+		return;
+	}
+	/*
+	 * EN may only be set again once all of the stream's flags are
+	 * clear, FEIF is often set along with TCIF. After a transfer
+	 * error the rest of that packet is lost, go on with the next.
+	 */
+	dma_clear_interrupt_flags(BRIDGE_DMA, BRIDGE_TX_STREAM,
+				  BRIDGE_DMA_FLAGS);
+
+	out_tail++;
+	if (out_tail != out_head) {
+		out_dma_next();
+	} else {
+		out_busy = 0;
+	}
+}
+
+void serial_out_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	uint32_t n = out_head & (OUT_SLOTS - 1);
+
+	(void)ep;
+
+	/*
+	 * The endpoint NAKs while every buffer is in use, so this does not
+	 * happen. Should a packet come anyway, it is left unread (and
+	 * dropped by the driver) rather than written over one being sent.
+	 */
+	if (out_head - out_tail == OUT_SLOTS) {
+		usbd_ep_nak_set(usbd_dev, SERIAL_EP_OUT, 1);
+		out_nak = 1;
+		serial_stats.out_dropped++;
+		return;
+	}
+
+	/* This packet takes the last buffer, hold the host off first */
+	if (out_head - out_tail == OUT_SLOTS - 1) {
+		usbd_ep_nak_set(usbd_dev, SERIAL_EP_OUT, 1);
+		out_nak = 1;
+	}
+
+	out_len[n] = usbd_ep_read_packet(usbd_dev, SERIAL_EP_OUT, out_slot[n],
+					 PACKET_SIZE);
+	if (out_len[n] == 0) {
+		return;
+	}
+	out_head++;
+	out_start();
+}
+
+/* Half transfer and transfer complete: one more half of in_buf filled */
+void dma2_stream1_isr(void)
+{
+	if (!dma_get_interrupt_flag(BRIDGE_DMA, BRIDGE_RX_STREAM,
+				    DMA_HTIF | DMA_TCIF)) {
+		return;
+	}
+	dma_clear_interrupt_flags(BRIDGE_DMA, BRIDGE_RX_STREAM,
+				  BRIDGE_DMA_FLAGS);
+	in_halves++;
+}
+
+/*
+ * Bytes the RX DMA has written to in_buf since the start. The count of
+ * halves and the position are read again if the interrupt came in
+ * between; a position already in the next half means its interrupt is
+ * still pending. It is never a whole half late.
+ */
+static uint32_t in_written(void)
+{
+	uint32_t halves, pos;
+
+	do {
+		halves = in_halves;
+		pos = IN_BUF_SIZE - DMA_SNDTR(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	} while (halves != in_halves);
+
+	pos &= IN_BUF_SIZE - 1;
+	if (pos / IN_HALF != (halves & 1)) {
+		halves++;
+	}
+	return halves * IN_HALF + pos % IN_HALF;
+}
+
+static void in_overrun(uint32_t written)
+{
+	serial_stats.rx_overruns++;
+	serial_stats.rx_dropped += written - in_sent;
+	in_sent = written;
+	notify_overruns++;
+}
+
+/*
+ * Write the next piece of received data to the IN endpoint, if there
+ * is any and the endpoint is free.
+ */
+static void in_send(usbd_device *usbd_dev)
+{
+	uint32_t written = in_written();
+	uint32_t pos = in_sent & (IN_BUF_SIZE - 1);
+	uint32_t len = written - in_sent;
+
+	/*
+	 * The oldest bytes are about to be written over, or already are.
+	 * A packet's worth of margin keeps the DMA off the bytes while
+	 * they are copied to the FIFO.
+	 */
+	if (len > IN_BUF_SIZE - PACKET_SIZE) {
+		in_overrun(written);
+		return;
+	}
+	if (len == 0) {
+		return;
+	}
+
+	/* only up to the end of the buffer, the rest comes next time */
+	if (len > IN_BUF_SIZE - pos) {
+		len = IN_BUF_SIZE - pos;
+	}
+	if (len > PACKET_SIZE) {
+		len = PACKET_SIZE;
+	}
+	if (usbd_ep_write_packet(usbd_dev, SERIAL_EP_IN, &in_buf[pos],
+				 len) == 0) {
+		return;			/* still busy with the last one */
+	}
+	in_sent += len;
+}
+
+void serial_in_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	(void)ep;
+
+	in_send(usbd_dev);
+}
+
+static void in_flow_control(void)
+{
+	uint32_t waiting = in_written() - in_sent;
+
+	if (!in_rts_off && waiting >= IN_RTS_OFF) {
+		gpio_set(BRIDGE_FLOW_PORT, BRIDGE_RTS);
+		in_rts_off = 1;
+	} else if (in_rts_off && waiting <= IN_RTS_ON) {
+		gpio_clear(BRIDGE_FLOW_PORT, BRIDGE_RTS);
+		in_rts_off = 0;
+	}
+}
+
+/*
+ * ORE is cleared by reading SR and then DR, and the next read of DR is
+ * the DMA's. Until then it stays set, count it once.
+ */
+static void in_check_usart(void)
+{
+	int ore = (USART_SR(BRIDGE_USART) & USART_SR_ORE) != 0;
+
+	if (ore && !in_ore) {
+		serial_stats.usart_overruns++;
+		notify_overruns++;
+	}
+	in_ore = ore;
+}
+
+static void notify_send(usbd_device *usbd_dev)
+{
+	uint8_t buf[sizeof(struct usb_cdc_notification) + 2];
+	struct usb_cdc_notification *notif = (void *)buf;
+
+	if (!notify_overruns) {
+		return;
+	}
+	notif->bmRequestType = 0xA1;
+	notif->bNotification = USB_CDC_NOTIFY_SERIAL_STATE;
+	notif->wValue = 0;
+	notif->wIndex = 0;
+	notif->wLength = 2;
+	buf[sizeof(*notif)] = SERIAL_STATE_OVERRUN;
+	buf[sizeof(*notif) + 1] = 0;
+	if (usbd_ep_write_packet(usbd_dev, SERIAL_EP_NOTIFY, buf,
+				 sizeof(buf)) != 0) {
+		notify_overruns--;
+	}
+}
+
+void serial_poll(usbd_device *usbd_dev)
+{
+	/* The DMA has freed a packet buffer, accept OUT data again */
+	if (out_nak && (out_head - out_tail < OUT_SLOTS)) {
+		out_nak = 0;
+		usbd_ep_nak_set(usbd_dev, SERIAL_EP_OUT, 0);
+	}
+	/* Packets held back while CTS was off */
+	out_start();
+
+	in_check_usart();
+	in_send(usbd_dev);
+	in_flow_control();
+	notify_send(usbd_dev);
+}
+
+void serial_setup(void)
+{
+	rcc_periph_clock_enable(RCC_GPIOC);
+	rcc_periph_clock_enable(RCC_USART6);
+	rcc_periph_clock_enable(RCC_DMA2);
+
+	gpio_mode_setup(GPIOC, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO6 | GPIO7);
+	gpio_set_af(GPIOC, GPIO_AF8, GPIO6 | GPIO7);
+
+	/* RTS on, ready to receive */
+	gpio_clear(BRIDGE_FLOW_PORT, BRIDGE_RTS);
+	gpio_mode_setup(BRIDGE_FLOW_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE,
+			BRIDGE_RTS);
+	gpio_mode_setup(BRIDGE_FLOW_PORT, GPIO_MODE_INPUT, GPIO_PUPD_PULLDOWN,
+			BRIDGE_CTS);
+
+	usart_set_databits(BRIDGE_USART, 8);
+	usart_set_stopbits(BRIDGE_USART, USART_STOPBITS_1);
+	usart_set_mode(BRIDGE_USART, USART_MODE_TX_RX);
+	usart_set_parity(BRIDGE_USART, USART_PARITY_NONE);
+	usart_set_flow_control(BRIDGE_USART, USART_FLOWCONTROL_NONE);
+	usart_enable_tx_dma(BRIDGE_USART);
+	usart_enable_rx_dma(BRIDGE_USART);
+	serial_set_baudrate(115200);
+
+	/* Transmit, one packet buffer per transfer, see out_dma_next() */
+	dma_stream_reset(BRIDGE_DMA, BRIDGE_TX_STREAM);
+	dma_channel_select(BRIDGE_DMA, BRIDGE_TX_STREAM, BRIDGE_DMA_CHANNEL);
+	dma_set_priority(BRIDGE_DMA, BRIDGE_TX_STREAM, DMA_SxCR_PL_HIGH);
+	dma_set_memory_size(BRIDGE_DMA, BRIDGE_TX_STREAM, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(BRIDGE_DMA, BRIDGE_TX_STREAM,
+				DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(BRIDGE_DMA, BRIDGE_TX_STREAM);
+	dma_set_transfer_mode(BRIDGE_DMA, BRIDGE_TX_STREAM,
+			      DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	dma_set_peripheral_address(BRIDGE_DMA, BRIDGE_TX_STREAM,
+				   (uint32_t)&USART_DR(BRIDGE_USART));
+	dma_enable_transfer_complete_interrupt(BRIDGE_DMA, BRIDGE_TX_STREAM);
+	dma_enable_transfer_error_interrupt(BRIDGE_DMA, BRIDGE_TX_STREAM);
+	nvic_enable_irq(NVIC_DMA2_STREAM6_IRQ);
+
+	/* Receive, circular and never stopped, see in_written() */
+	dma_stream_reset(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	dma_channel_select(BRIDGE_DMA, BRIDGE_RX_STREAM, BRIDGE_DMA_CHANNEL);
+	dma_set_priority(BRIDGE_DMA, BRIDGE_RX_STREAM, DMA_SxCR_PL_VERY_HIGH);
+	dma_set_memory_size(BRIDGE_DMA, BRIDGE_RX_STREAM, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(BRIDGE_DMA, BRIDGE_RX_STREAM,
+				DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	dma_enable_circular_mode(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	dma_set_transfer_mode(BRIDGE_DMA, BRIDGE_RX_STREAM,
+			      DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+	dma_set_peripheral_address(BRIDGE_DMA, BRIDGE_RX_STREAM,
+				   (uint32_t)&USART_DR(BRIDGE_USART));
+	dma_set_memory_address(BRIDGE_DMA, BRIDGE_RX_STREAM, (uint32_t)in_buf);
+	dma_set_number_of_data(BRIDGE_DMA, BRIDGE_RX_STREAM, IN_BUF_SIZE);
+	dma_enable_half_transfer_interrupt(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	dma_enable_transfer_complete_interrupt(BRIDGE_DMA, BRIDGE_RX_STREAM);
+	nvic_enable_irq(NVIC_DMA2_STREAM1_IRQ);
+	dma_enable_stream(BRIDGE_DMA, BRIDGE_RX_STREAM);
+}
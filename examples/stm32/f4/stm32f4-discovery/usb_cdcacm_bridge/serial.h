@@ -0,0 +1,51 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+#include <stdint.h>
+#include <libopencm3/usb/usbd.h>
+
+/* The endpoints of the CDC-ACM data and communication interfaces */
+#define SERIAL_EP_OUT		0x01
+#define SERIAL_EP_IN		0x82
+#define SERIAL_EP_NOTIFY	0x83
+#define SERIAL_PACKET_SIZE	64
+
+/* Data lost on the way, none of it is ever sent on as if it were not */
+struct serial_stats {
+	uint32_t rx_overruns;	/* the host fell a whole buffer behind */
+	uint32_t rx_dropped;	/* bytes thrown away for that */
+	uint32_t usart_overruns; /* ORE, the DMA missed a received byte */
+	uint32_t out_dropped;	/* packets from the host with no buffer */
+};
+
+extern struct serial_stats serial_stats;
+
+void serial_setup(void);
+/* The USART format is always 8N1, only the rate can be set */
+void serial_set_baudrate(uint32_t baud);
+
+/* Callbacks for SERIAL_EP_OUT and SERIAL_EP_IN */
+void serial_out_cb(usbd_device *usbd_dev, uint8_t ep);
+void serial_in_cb(usbd_device *usbd_dev, uint8_t ep);
+
+/* Call from the main loop, after usbd_poll() */
+void serial_poll(usbd_device *usbd_dev);
+
+#endif
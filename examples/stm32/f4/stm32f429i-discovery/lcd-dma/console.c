@@ -35,18 +35,17 @@
 #include <libopencm3/cm3/cortex.h>
 #include "clock.h"
 #include "console.h"
+#include "ring.h"
 
 
-/* This is a ring buffer to holding characters as they are typed
- * it maintains both the place to put the next character received
- * from the UART, and the place where the last character was
- * read by the program. See the README file for a discussion of
- * the failure semantics.
+/* This is a ring buffer to holding characters as they are typed,
+ * the interrupt handler puts them in and console_getc() takes them
+ * out (see ring.h). When it is full new characters are dropped, see
+ * the README file for a discussion of the failure semantics.
  */
-#define RECV_BUF_SIZE	128		/* Arbitrary buffer size */
-char recv_buf[RECV_BUF_SIZE];
-static volatile int recv_ndx_nxt;	/* Next place to store */
-static volatile int recv_ndx_cur;	/* Next place to read */
+#define RECV_BUF_SIZE	128		/* Arbitrary, but a power of two */
+static uint8_t recv_buf[RECV_BUF_SIZE];
+static struct ring recv_ring = { recv_buf, RECV_BUF_SIZE, 0, 0 };
 
 /* For interrupt handling we add a new function which is called
  * when receive interrupts happen. The name (usart1_isr) is created
@@ -62,23 +61,20 @@ static volatile int recv_ndx_cur;	/* Next place to read */
 void usart1_isr(void)
 {
 	uint32_t	reg;
-	int			i;
+	uint8_t		c;
 
 	do {
 		reg = USART_SR(CONSOLE_UART);
 		if (reg & USART_SR_RXNE) {
-			recv_buf[recv_ndx_nxt] = USART_DR(CONSOLE_UART);
+			c = USART_DR(CONSOLE_UART);
 #ifdef RESET_ON_CTRLC
 			/* Check for "reset" */
-			if (recv_buf[recv_ndx_nxt] == '\003') {
+			if (c == '\003') {
 				scb_reset_system();
 			}
 #endif
-			/* Check for "overrun" */
-			i = (recv_ndx_nxt + 1) % RECV_BUF_SIZE;
-			if (i != recv_ndx_cur) {
-				recv_ndx_nxt = i;
-			}
+			/* On "overrun" the character is dropped */
+			(void) ring_write_ch(&recv_ring, c);
 		}
 	} while ((reg & USART_SR_RXNE) != 0);
 				/* can read back-to-back interrupts */
@@ -111,13 +107,10 @@ void console_putc(char c)
  */
 char console_getc(int wait)
 {
-	char		c = 0;
+	uint8_t		c = 0;
 
-	while ((wait != 0) && (recv_ndx_cur == recv_ndx_nxt));
-	if (recv_ndx_cur != recv_ndx_nxt) {
-		c = recv_buf[recv_ndx_cur];
-		recv_ndx_cur = (recv_ndx_cur + 1) % RECV_BUF_SIZE;
-	}
+	while ((wait != 0) && RING_EMPTY(&recv_ring));
+	(void) ring_read_ch(&recv_ring, &c);
 	return c;
 }
 
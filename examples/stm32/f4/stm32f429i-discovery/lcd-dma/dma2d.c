@@ -0,0 +1,167 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * DMA2D (Chrom-ART) backend for the gfx library.
+ *
+ * The DMA2D engine can fill a rectangle with a constant color, and can
+ * blend a foreground image over a background while converting between
+ * pixel formats. The gfx library hands us rectangle fills and 1 bit per
+ * pixel bitmaps (text is turned into those as well); fills are issued
+ * directly, bitmaps are expanded into an 8 bit alpha (A8) mask which
+ * the DMA2D blends over the frame buffer in the requested color.
+ *
+ * Only one transfer is in flight at a time. Each operation waits for
+ * the previous one just before it programs the engine, so the CPU can
+ * already prepare the next mask while the DMA2D is busy; there are two
+ * mask buffers for this reason. The pixel function waits for the
+ * engine too, so CPU and DMA2D drawing never race; with nothing started
+ * since the last wait that is a single test of a flag, not two register
+ * reads per pixel.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libopencm3/stm32/rcc.h>
+#include "gfx.h"
+#include "dma2d.h"
+
+/* Largest bitmap handled by the DMA2D, bigger ones are drawn by the CPU */
+#define MASK_BYTES	4096
+
+static uint32_t *fb;
+static int fb_width;
+
+static uint8_t mask[2][MASK_BYTES];
+static int mask_ndx;
+
+/* A transfer was started and not waited for yet */
+static bool busy;
+
+/* gfx colors are RGB565, the frame buffer is ARGB8888 */
+static uint32_t
+rgb565_to_rgb888(uint16_t c)
+{
+	uint32_t r = (c >> 11) & 0x1f;
+	uint32_t g = (c >> 5) & 0x3f;
+	uint32_t b = c & 0x1f;
+
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return (r << 16) | (g << 8) | b;
+}
+
+void
+dma2d_wait(void)
+{
+	if (!busy) {
+		return;
+	}
+	busy = false;
+	while (DMA2D_CR & DMA2D_CR_START);
+	if (DMA2D_ISR & (DMA2D_ISR_TEIF | DMA2D_ISR_CEIF)) {
+		/* a bad address or configuration, drop it and carry on */
+		DMA2D_IFCR = DMA2D_IFCR_CTEIF | DMA2D_IFCR_CCEIF;
+	}
+	DMA2D_IFCR = DMA2D_IFCR_CTCIF;
+}
+
+static void
+dma2d_draw_pixel(int x, int y, uint16_t color)
+{
+	dma2d_wait();
+	fb[x + y * fb_width] = 0xff000000 | rgb565_to_rgb888(color);
+}
+
+/* One register-to-memory transfer fills the whole rectangle */
+static void
+dma2d_fill_rect(int x, int y, int w, int h, uint16_t color)
+{
+	dma2d_wait();
+	DMA2D_OPFCCR = DMA2D_CM_ARGB8888;
+	DMA2D_OCOLR = 0xff000000 | rgb565_to_rgb888(color);
+	DMA2D_OMAR = (uint32_t)(fb + x + y * fb_width);
+	DMA2D_OOR = fb_width - w;
+	DMA2D_NLR = (w << DMA2D_NLR_PL_SHIFT) | h;
+	DMA2D_CR = DMA2D_CR_MODE_R2M | DMA2D_CR_START;
+	busy = true;
+}
+
+/*
+ * Expand the bitmap into an A8 mask (0x00 or 0xff per pixel) and blend
+ * the color through it onto the frame buffer.
+ */
+static void
+dma2d_draw_bitmap(int x, int y, const uint8_t *bitmap, int w, int h,
+		  uint16_t color)
+{
+	int i, j, byte_width = (w + 7) / 8;
+	uint8_t *m, bits = 0;
+
+	if (w * h > MASK_BYTES) {
+		for (j = 0; j < h; j++) {
+			for (i = 0; i < w; i++) {
+				if (bitmap[j * byte_width + i / 8] &
+				    (0x80 >> (i & 7))) {
+					dma2d_draw_pixel(x + i, y + j, color);
+				}
+			}
+		}
+		return;
+	}
+
+	/* the other buffer may still be read by the transfer in flight */
+	mask_ndx ^= 1;
+	m = mask[mask_ndx];
+	for (j = 0; j < h; j++) {
+		for (i = 0; i < w; i++) {
+			if ((i & 7) == 0) {
+				bits = bitmap[j * byte_width + i / 8];
+			}
+			*m++ = (bits & 0x80) ? 0xff : 0x00;
+			bits <<= 1;
+		}
+	}
+
+	dma2d_wait();
+	DMA2D_FGMAR = (uint32_t)mask[mask_ndx];
+	DMA2D_FGOR = 0;
+	DMA2D_FGPFCCR = DMA2D_CM_A8;
+	DMA2D_FGCOLR = rgb565_to_rgb888(color);
+	DMA2D_BGMAR = (uint32_t)(fb + x + y * fb_width);
+	DMA2D_BGOR = fb_width - w;
+	DMA2D_BGPFCCR = DMA2D_CM_ARGB8888;
+	DMA2D_OPFCCR = DMA2D_CM_ARGB8888;
+	DMA2D_OMAR = (uint32_t)(fb + x + y * fb_width);
+	DMA2D_OOR = fb_width - w;
+	DMA2D_NLR = (w << DMA2D_NLR_PL_SHIFT) | h;
+	DMA2D_CR = DMA2D_CR_MODE_M2M_BLEND | DMA2D_CR_START;
+	busy = true;
+}
+
+void
+dma2d_gfx_init(uint32_t *frame_buffer, int width, int height)
+{
+	rcc_periph_clock_enable(RCC_DMA2D);
+
+	fb = frame_buffer;
+	fb_width = width;
+
+	gfx_init(dma2d_draw_pixel, width, height);
+	gfx_set_accel(dma2d_fill_rect, dma2d_draw_bitmap);
+}
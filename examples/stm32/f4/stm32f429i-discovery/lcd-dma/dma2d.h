@@ -0,0 +1,81 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DMA2D_H
+#define __DMA2D_H
+
+#include <stdint.h>
+#include <libopencm3/cm3/common.h>
+
+/*
+ * DMA2D (Chrom-ART accelerator) registers, RM0090 section 11.
+ * libopencm3 has no definitions for this block yet.
+ */
+#define DMA2D_BASE		0x4002B000
+
+#define DMA2D_CR		MMIO32(DMA2D_BASE + 0x00)
+#define DMA2D_ISR		MMIO32(DMA2D_BASE + 0x04)
+#define DMA2D_IFCR		MMIO32(DMA2D_BASE + 0x08)
+#define DMA2D_FGMAR		MMIO32(DMA2D_BASE + 0x0C)
+#define DMA2D_FGOR		MMIO32(DMA2D_BASE + 0x10)
+#define DMA2D_BGMAR		MMIO32(DMA2D_BASE + 0x14)
+#define DMA2D_BGOR		MMIO32(DMA2D_BASE + 0x18)
+#define DMA2D_FGPFCCR		MMIO32(DMA2D_BASE + 0x1C)
+#define DMA2D_FGCOLR		MMIO32(DMA2D_BASE + 0x20)
+#define DMA2D_BGPFCCR		MMIO32(DMA2D_BASE + 0x24)
+#define DMA2D_BGCOLR		MMIO32(DMA2D_BASE + 0x28)
+#define DMA2D_OPFCCR		MMIO32(DMA2D_BASE + 0x34)
+#define DMA2D_OCOLR		MMIO32(DMA2D_BASE + 0x38)
+#define DMA2D_OMAR		MMIO32(DMA2D_BASE + 0x3C)
+#define DMA2D_OOR		MMIO32(DMA2D_BASE + 0x40)
+#define DMA2D_NLR		MMIO32(DMA2D_BASE + 0x44)
+
+#define DMA2D_CR_START		(1 << 0)
+#define DMA2D_CR_MODE_M2M	(0 << 16)
+#define DMA2D_CR_MODE_M2M_PFC	(1 << 16)
+#define DMA2D_CR_MODE_M2M_BLEND	(2 << 16)
+#define DMA2D_CR_MODE_R2M	(3 << 16)
+
+#define DMA2D_ISR_TEIF		(1 << 0)
+#define DMA2D_ISR_TCIF		(1 << 1)
+#define DMA2D_ISR_CEIF		(1 << 5)
+
+#define DMA2D_IFCR_CTEIF	(1 << 0)
+#define DMA2D_IFCR_CTCIF	(1 << 1)
+#define DMA2D_IFCR_CCEIF	(1 << 5)
+
+/* Color modes, for the CM field of the xPFCCR registers */
+#define DMA2D_CM_ARGB8888	0x0
+#define DMA2D_CM_RGB888		0x1
+#define DMA2D_CM_RGB565		0x2
+#define DMA2D_CM_A8		0x9
+
+#define DMA2D_NLR_PL_SHIFT	16
+
+/*
+ * A gfx backend that draws into an ARGB8888 frame buffer, such as
+ * LTDC layer 1 in this example. Rectangle fills become a single
+ * register-to-memory transfer; bitmaps and text are expanded into an
+ * A8 mask which the DMA2D blends over the frame buffer in the text
+ * color. Everything else still goes through the pixel function.
+ */
+void dma2d_gfx_init(uint32_t *frame_buffer, int width, int height);
+
+/* Wait for the transfer in flight, if any, to finish */
+void dma2d_wait(void);
+
+#endif
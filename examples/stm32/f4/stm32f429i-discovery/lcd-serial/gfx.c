@@ -70,6 +70,33 @@ gfx_init(void (*pixel_func)(int, int, uint16_t), int width, int height)
 	__gfx_state.textbgcolor = 0xFFFF;
 	__gfx_state.wrap      = true;
 	__gfx_state.drawpixel = pixel_func;
+	__gfx_state.fillrect  = NULL;
+	__gfx_state.drawbitmap = NULL;
+}
+
+/*
+ * Hand rectangle fills and 1 bit per pixel bitmaps (which includes
+ * text) to a hardware assisted backend. Either may be NULL, in which
+ * case everything is drawn through the pixel function as before.
+ */
+void
+gfx_set_accel(void (*fillrect)(int, int, int, int, uint16_t),
+	      void (*drawbitmap)(int, int, const uint8_t *, int, int, uint16_t))
+{
+	__gfx_state.fillrect   = fillrect;
+	__gfx_state.drawbitmap = drawbitmap;
+}
+
+/*
+ * Is the rectangle entirely on screen? Anything that is not gets drawn
+ * through the clipping pixel path instead of the accelerator.
+ */
+static int
+gfx_onscreen(int x, int y, int w, int h)
+{
+	return (x >= 0) && (y >= 0) && (w > 0) && (h > 0) &&
+	       (x + w <= __gfx_state._width) &&
+	       (y + h <= __gfx_state._height);
 }
 
 /* Draw a circle outline */
@@ -240,22 +267,49 @@ void gfx_drawRect(int16_t x, int16_t y,
 void gfx_drawFastVLine(int16_t x, int16_t y,
 		       int16_t h, uint16_t color)
 {
-	/* Update in subclasses if desired! */
+	if (__gfx_state.fillrect && gfx_onscreen(x, y, 1, h)) {
+		(__gfx_state.fillrect)(x, y, 1, h, color);
+		return;
+	}
 	gfx_drawLine(x, y, x, y + h - 1, color);
 }
 
 void gfx_drawFastHLine(int16_t x, int16_t y,
 		       int16_t w, uint16_t color)
 {
-	/* Update in subclasses if desired! */
+	if (__gfx_state.fillrect && gfx_onscreen(x, y, w, 1)) {
+		(__gfx_state.fillrect)(x, y, w, 1, color);
+		return;
+	}
 	gfx_drawLine(x, y, x + w - 1, y, color);
 }
 
 void gfx_fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
 		  uint16_t color)
 {
-	/* Update in subclasses if desired! */
 	int16_t i;
+
+	if (__gfx_state.fillrect) {
+		/* clip, so that a partly visible rectangle is still one fill */
+		if (x < 0) {
+			w += x;
+			x = 0;
+		}
+		if (y < 0) {
+			h += y;
+			y = 0;
+		}
+		if (x + w > __gfx_state._width) {
+			w = __gfx_state._width - x;
+		}
+		if (y + h > __gfx_state._height) {
+			h = __gfx_state._height - y;
+		}
+		if ((w > 0) && (h > 0)) {
+			(__gfx_state.fillrect)(x, y, w, h, color);
+		}
+		return;
+	}
 	for (i = x; i < x + w; i++) {
 		gfx_drawFastVLine(i, y, h, color);
 	}
@@ -403,6 +457,10 @@ void gfx_drawBitmap(int16_t x, int16_t y,
 {
 	int16_t i, j, byteWidth = (w + 7) / 8;
 
+	if (__gfx_state.drawbitmap && gfx_onscreen(x, y, w, h)) {
+		(__gfx_state.drawbitmap)(x, y, bitmap, w, h, color);
+		return;
+	}
 	for (j = 0; j < h; j++) {
 		for (i = 0; i < w; i++) {
 			if (pgm_read_byte(bitmap + j * byteWidth + i / 8) &
@@ -442,6 +500,56 @@ void gfx_puts(char *s)
 	}
 }
 
+/* Largest text size drawn as a bitmap through the accelerator */
+#define GFX_ACCEL_MAX_TEXTSIZE	4
+
+/*
+ * Draw a character as one (background) rectangle fill plus one bitmap,
+ * scaling the glyph up into a 1 bit per pixel bitmap first.
+ */
+static void gfx_drawCharAccel(int16_t x, int16_t y,
+			      unsigned const char *glyph, uint16_t color,
+			      uint16_t bg, uint8_t size)
+{
+	static uint8_t bits[12 * GFX_ACCEL_MAX_TEXTSIZE *
+			    GFX_ACCEL_MAX_TEXTSIZE];
+	int i, j, k, row, line;
+	int descender = (*glyph & 0x80) != 0;
+
+	/* 8 * size pixels wide is exactly 'size' bytes per bitmap row */
+	for (i = 0; i < 12 * size * size; i++) {
+		bits[i] = 0;
+	}
+	for (i = 0; i < 12; i++) {
+		line = 0x00;
+		if (descender) {
+			if (i > 2) {
+				line = *(glyph + (i - 3));
+			}
+		} else {
+			if (i < 9) {
+				line = *(glyph + i);
+			}
+		}
+		line &= 0x7f;
+		for (j = 0; j < 8; j++) {
+			if (line & (0x80 >> j)) {
+				for (k = 0; k < size; k++) {
+					int col = j * size + k;
+					for (row = 0; row < size; row++) {
+						bits[(i * size + row) * size +
+						     col / 8] |= 0x80 >> (col & 7);
+					}
+				}
+			}
+		}
+	}
+	if (bg != color) {
+		(__gfx_state.fillrect)(x, y, 8 * size, 12 * size, bg);
+	}
+	(__gfx_state.drawbitmap)(x, y, bits, 8 * size, 12 * size, color);
+}
+
 /* Draw a character */
 void gfx_drawChar(int16_t x, int16_t y, unsigned char c,
 		  uint16_t color, uint16_t bg, uint8_t size)
@@ -452,6 +560,13 @@ void gfx_drawChar(int16_t x, int16_t y, unsigned char c,
 
 	glyph = &mcm_font[(c & 0x7f) * 9];
 
+	if (__gfx_state.fillrect && __gfx_state.drawbitmap &&
+	    (size <= GFX_ACCEL_MAX_TEXTSIZE) &&
+	    gfx_onscreen(x, y, 8 * size, 12 * size)) {
+		gfx_drawCharAccel(x, y, glyph, color, bg, size);
+		return;
+	}
+
 	descender = (*glyph & 0x80) != 0;
 
 	for (i = 0; i < 12; i++) {
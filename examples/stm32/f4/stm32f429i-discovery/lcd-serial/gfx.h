@@ -22,6 +22,9 @@ void gfx_drawCircleHelper(int16_t x0, int16_t y0, int16_t r,
 			  uint8_t cornername, uint16_t color);
 void gfx_fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color);
 void gfx_init(void (*draw)(int, int, uint16_t), int, int);
+void gfx_set_accel(void (*fillrect)(int, int, int, int, uint16_t),
+		   void (*drawbitmap)(int, int, const uint8_t *, int, int,
+				      uint16_t));
 
 void gfx_fillCircleHelper(int16_t x0, int16_t y0, int16_t r,
 			  uint8_t cornername, int16_t delta, uint16_t color);
@@ -59,6 +62,12 @@ struct gfx_state {
 	uint8_t textsize, rotation;
 	uint8_t wrap;
 	void (*drawpixel)(int, int, uint16_t);
+	/*
+	 * Optional hardware assists, NULL when not available. They are
+	 * only ever called with rectangles that are entirely on screen.
+	 */
+	void (*fillrect)(int, int, int, int, uint16_t);
+	void (*drawbitmap)(int, int, const uint8_t *, int, int, uint16_t);
 };
 
 extern struct gfx_state __gfx_state;
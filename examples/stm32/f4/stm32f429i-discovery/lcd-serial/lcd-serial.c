@@ -28,6 +28,30 @@
 /* Convert degrees to radians */
 #define d2r(d) ((d) * 6.2831853 / 360.0)
 
+/* How often the animation reports what it sends to the display */
+#define REPORT_FRAMES	100
+
+static void print_decimal(uint32_t v)
+{
+	char buf[11];
+	int i = sizeof(buf) - 1;
+
+	buf[i] = '\0';
+	do {
+		buf[--i] = '0' + (v % 10);
+		v /= 10;
+	} while (v);
+	console_puts(&buf[i]);
+}
+
+/* Counted from the DMA interrupt as each frame reaches the display */
+static volatile uint32_t frames_sent;
+
+static void frame_sent(void)
+{
+	frames_sent++;
+}
+
 /*
  * This is our example, the heavy lifing is actually in lcd-spi.c but
  * this drives that code.
@@ -35,6 +59,8 @@
 int main(void)
 {
 	int p1, p2, p3;
+	int frames;
+	uint32_t bytes, start;
 
 	clock_setup();
 	console_setup(115200);
@@ -69,6 +95,9 @@ int main(void)
 	p1 = 0;
 	p2 = 45;
 	p3 = 90;
+	frames = 0;
+	bytes = 0;
+	start = mtime();
 	while (1) {
 		gfx_fillScreen(LCD_BLACK);
 		gfx_setCursor(15, 36);
@@ -87,6 +116,28 @@ int main(void)
 		p1 = (p1 + 3) % 360;
 		p2 = (p2 + 2) % 360;
 		p3 = (p3 + 1) % 360;
-		lcd_show_frame();
+		/*
+		 * The frame goes out by DMA while the loop comes around
+		 * and draws the next one.
+		 */
+		lcd_show_frame_async(frame_sent);
+
+		/*
+		 * Only the tiles the planets moved through are sent, a full
+		 * frame would be 153600 bytes.
+		 */
+		bytes += lcd_flush_bytes();
+		if (++frames == REPORT_FRAMES) {
+			console_puts("SPI bytes per frame: ");
+			print_decimal(bytes / REPORT_FRAMES);
+			console_puts(", ms per frame: ");
+			print_decimal((mtime() - start) / REPORT_FRAMES);
+			console_puts(", frames sent: ");
+			print_decimal(frames_sent);
+			console_puts("\n");
+			frames = 0;
+			bytes = 0;
+			start = mtime();
+		}
 	}
 }
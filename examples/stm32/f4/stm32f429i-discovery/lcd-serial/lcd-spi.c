@@ -21,9 +21,11 @@
  * Initialize the ST Micro TFT Display using the SPI port
  */
 #include <stdint.h>
+#include <string.h>
 #include <libopencm3/stm32/spi.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
 #include "console.h"
 #include "clock.h"
@@ -42,6 +44,29 @@ uint16_t *cur_frame;
 uint16_t *display_frame;
 
 
+/*
+ * Dirty tracking.
+ *
+ * The screen is divided into DIRTY_TILE x DIRTY_TILE pixel tiles and
+ * every row of tiles has a bit mask of the tiles that were drawn into
+ * since the last lcd_show_frame(). Only those get sent to the display,
+ * and only if they actually differ from what it shows: the frame being
+ * built always starts out as a copy of the displayed one (see
+ * lcd_write_rect()), so clearing the screen and redrawing a scene only
+ * costs the parts that moved.
+ */
+#define DIRTY_TILE	16
+#define DIRTY_COLS	(LCD_WIDTH / DIRTY_TILE)
+#define DIRTY_ROWS	(LCD_HEIGHT / DIRTY_TILE)
+
+static uint16_t dirty[DIRTY_ROWS];
+
+/* the display content is unknown, send everything next time */
+static int flush_all;
+
+/* bytes sent over SPI by the last lcd_show_frame() */
+static uint32_t flush_bytes;
+
 /*
  * Drawing a pixel consists of storing a 16 bit value in the
  * memory used to hold the frame. This code computes the address
@@ -51,6 +76,7 @@ void
 lcd_draw_pixel(int x, int y, uint16_t color)
 {
 	*(cur_frame + x + y * LCD_WIDTH) = color;
+	dirty[y / DIRTY_TILE] |= 1 << (x / DIRTY_TILE);
 }
 
 /*
@@ -258,33 +284,344 @@ test_image(void)
 }
 
 /*
- * void lcd_show_frame(void)
+ * DMA streaming.
  *
- * Dump an entire frame to the LCD all at once. In theory you
- * could call this with DMA but that is made more difficult by
- * the implementation of SPI and the modules interpretation of
- * D/CX line.
+ * SPI5_TX is served by DMA2 stream 4, channel 2. A flush is a list of
+ * rectangles, and each rectangle goes out as a sequence of pieces, all
+ * of them by DMA:
+ *
+ *	0x2A		D/CX low
+ *	x0, x1		D/CX high, 4 bytes
+ *	0x2B		D/CX low
+ *	y0, y1		D/CX high, 4 bytes
+ *	0x2C		D/CX low
+ *	pixels		D/CX high
+ *
+ * Rectangles as wide as the screen are contiguous in the frame buffer
+ * and their pixels go out in chunks of DMA_CHUNK_ROWS rows, narrower
+ * ones one row at a time. The transfer complete interrupt starts the
+ * next piece. Chip select stays low for the whole flush, a command byte
+ * ends the previous command.
+ *
+ * The DMA is done when it has written the last byte into the data
+ * register, not when the byte has left the shift register, and the
+ * display samples D/CX with the last bit of every byte. So where D/CX
+ * changes, the interrupt first waits for the SPI to go idle: one or two
+ * bytes still in flight, about 1.5us at 10.5MHz. That happens five
+ * times per rectangle, between pixel chunks D/CX stays high and the
+ * next chunk is started right away.
  */
-void lcd_show_frame(void)
+#define LCD_DMA		DMA2
+#define LCD_DMA_STREAM	DMA_STREAM4
+#define LCD_DMA_CHANNEL	DMA_SxCR_CHSEL_2
+#define LCD_DMA_FLAGS	(DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | DMA_FEIF)
+
+/* 128 full rows, 61440 bytes, stay below the 65535 transfer limit */
+#define DMA_CHUNK_ROWS	128
+
+/* The command pieces, as offset and length in rect_cmd[] */
+#define CMD_PIECES	5
+static const uint8_t cmd_piece[CMD_PIECES][2] = {
+	{ 0, 1 }, { 1, 4 }, { 5, 1 }, { 6, 4 }, { 10, 1 }
+};
+
+struct lcd_rect {
+	uint16_t	x, y, w, h;
+};
+
+/* each row of tiles holds at most (DIRTY_COLS + 1) / 2 separate runs */
+static struct lcd_rect rects[DIRTY_ROWS * ((DIRTY_COLS + 1) / 2)];
+static int n_rects;
+static int rect_ndx;		/* rectangle being sent */
+static int rect_piece;		/* its next piece to hand to the DMA */
+static int rect_row;		/* its next row of pixels */
+static uint8_t rect_cmd[11];	/* its address window and write command */
+static int dcx;			/* level of the D/CX pin */
+
+static volatile int dma_busy;
+static void (*frame_done)(void);
+
+/* Wait for the last byte to leave the SPI */
+static void
+lcd_spi_idle(void)
+{
+	while (!(SPI_SR(LCD_SPI) & SPI_SR_TXE));
+	while (SPI_SR(LCD_SPI) & SPI_SR_BSY);
+}
+
+/* Hand the next piece of the current rectangle to the DMA */
+static void
+lcd_dma_next(void)
 {
-	uint16_t	*t;
-	uint8_t size[4];
+	const struct lcd_rect *r = &rects[rect_ndx];
+	uint32_t addr, n;
+	int level, rows;
+
+	if (rect_piece < CMD_PIECES) {
+		/* even pieces are the commands */
+		level = rect_piece & 1;
+		addr = (uint32_t) &rect_cmd[cmd_piece[rect_piece][0]];
+		n = cmd_piece[rect_piece][1];
+		rect_piece++;
+	} else {
+		level = 1;
+		rows = 1;
+		if (r->w == LCD_WIDTH) {
+			rows = r->h - rect_row;
+			if (rows > DMA_CHUNK_ROWS) {
+				rows = DMA_CHUNK_ROWS;
+			}
+		}
+		addr = (uint32_t)
+			(display_frame + r->x + (r->y + rect_row) * LCD_WIDTH);
+		n = rows * r->w * 2;
+		rect_row += rows;
+	}
+
+	if (level != dcx) {
+		lcd_spi_idle();
+		if (level) {
+			gpio_set(GPIOD, GPIO13);
+		} else {
+			gpio_clear(GPIOD, GPIO13);
+		}
+		dcx = level;
+	}
+	dma_set_memory_address(LCD_DMA, LCD_DMA_STREAM, addr);
+	dma_set_number_of_data(LCD_DMA, LCD_DMA_STREAM, n);
+	dma_enable_stream(LCD_DMA, LCD_DMA_STREAM);
+}
+
+/* Fill in the address window of the current rectangle and start it */
+static void
+lcd_start_rect(void)
+{
+	const struct lcd_rect *r = &rects[rect_ndx];
+
+	rect_cmd[0] = 0x2A;
+	rect_cmd[1] = (r->x >> 8) & 0xff;
+	rect_cmd[2] = r->x & 0xff;
+	rect_cmd[3] = ((r->x + r->w - 1) >> 8) & 0xff;
+	rect_cmd[4] = (r->x + r->w - 1) & 0xff;
+	rect_cmd[5] = 0x2B;
+	rect_cmd[6] = (r->y >> 8) & 0xff;
+	rect_cmd[7] = r->y & 0xff;
+	rect_cmd[8] = ((r->y + r->h - 1) >> 8) & 0xff;
+	rect_cmd[9] = (r->y + r->h - 1) & 0xff;
+	rect_cmd[10] = 0x2C;
+	rect_piece = 0;
+	rect_row = 0;
+	lcd_dma_next();
+}
+
+/* The flush is over, release the display */
+static void
+lcd_dma_end(void)
+{
+	lcd_spi_idle();
+	gpio_set(GPIOC, GPIO2);		/* Turn off chip select */
+	gpio_clear(GPIOD, GPIO13);	/* always reset D/CX */
+	dcx = 0;
+	/* nothing read the received bytes, clear RXNE and OVR */
+	(void) SPI_DR(LCD_SPI);
+	(void) SPI_SR(LCD_SPI);
+
+	dma_busy = 0;
+	if (frame_done) {
+		frame_done();
+	}
+}
+
+void
+dma2_stream4_isr(void)
+{
+	const struct lcd_rect *r = &rects[rect_ndx];
+	int error;
+
+	error = dma_get_interrupt_flag(LCD_DMA, LCD_DMA_STREAM, DMA_TEIF);
+	if (!error &&
+	    !dma_get_interrupt_flag(LCD_DMA, LCD_DMA_STREAM, DMA_TCIF)) {
+		return;
+	}
+	/* EN may only be set again once all of the stream's flags are clear */
+	dma_clear_interrupt_flags(LCD_DMA, LCD_DMA_STREAM, LCD_DMA_FLAGS);
+
+	if (error) {
+		/* the stream stopped, what the display holds is unknown */
+		flush_all = 1;
+		lcd_dma_end();
+		return;
+	}
+
+	if (rect_piece == CMD_PIECES && rect_row == r->h) {
+		if (++rect_ndx == n_rects) {
+			lcd_dma_end();
+			return;
+		}
+		lcd_start_rect();
+		return;
+	}
+	lcd_dma_next();
+}
+
+/*
+ * Copy a rectangle of the displayed frame into the one being built,
+ * so that buffer picks up where the display is now and the
+ * application can keep drawing incrementally.
+ */
+static void
+lcd_sync_rect(const struct lcd_rect *r)
+{
+	int row;
+
+	for (row = r->y; row < r->y + r->h; row++) {
+		memcpy(cur_frame + r->x + row * LCD_WIDTH,
+		       display_frame + r->x + row * LCD_WIDTH, r->w * 2);
+	}
+}
+
+/* Is this tile of the new frame the same as the displayed one? */
+static int
+tile_unchanged(int tx, int ty)
+{
+	int	row, offset;
+
+	for (row = 0; row < DIRTY_TILE; row++) {
+		offset = (ty * DIRTY_TILE + row) * LCD_WIDTH + tx * DIRTY_TILE;
+		if (memcmp(cur_frame + offset, display_frame + offset,
+			   DIRTY_TILE * 2) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * void lcd_wait(void)
+ *
+ * Wait until the frame handed to lcd_show_frame_async() has been
+ * sent completely.
+ */
+void lcd_wait(void)
+{
+	while (dma_busy);
+}
+
+/*
+ * void lcd_show_frame_async(done)
+ *
+ * Make the frame that was just drawn the displayed one, and start
+ * sending the parts of it that changed to the LCD. Tiles that were
+ * drawn into but came out the same are dropped first, the rest are
+ * gathered into rectangles greedily: take the first run of dirty
+ * tiles in a row, then extend it downwards for as long as the rows
+ * below are dirty across the same run. Each rectangle costs 11 bytes
+ * of commands, much less than sending clean pixels along, so runs are
+ * never merged across clean tiles.
+ *
+ * This returns as soon as the DMA is going, and the next frame can
+ * be drawn while this one is sent. The frame buffers are swapped right
+ * here; the DMA only ever reads the displayed frame, and a previous
+ * frame still in flight is waited for first. done, if not NULL, is
+ * called from the DMA interrupt once the last pixel went out.
+ */
+void lcd_show_frame_async(void (*done)(void))
+{
+	uint16_t		*t;
+	uint16_t		mask;
+	int			row, end, first, last;
+	struct lcd_rect		*r;
+
+	lcd_wait();
+
+	for (row = 0; row < DIRTY_ROWS; row++) {
+		if (flush_all) {
+			dirty[row] = (1 << DIRTY_COLS) - 1;
+			continue;
+		}
+		for (first = 0; first < DIRTY_COLS; first++) {
+			if ((dirty[row] & (1 << first)) &&
+			    tile_unchanged(first, row)) {
+				dirty[row] &= ~(1 << first);
+			}
+		}
+	}
 
 	t = display_frame;
 	display_frame = cur_frame;
 	cur_frame = t;
-	/*  */
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_WIDTH >> 8) & 0xff;
-	size[3] = (LCD_WIDTH) & 0xff;
-	lcd_command(0x2A, 0, 4, (const uint8_t *)&size[0]);
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_HEIGHT >> 8) & 0xff;
-	size[3] = LCD_HEIGHT & 0xff;
-	lcd_command(0x2B, 0, 4, (const uint8_t *)&size[0]);
-	lcd_command(0x2C, 0, FRAME_SIZE_BYTES, (const uint8_t *)display_frame);
+
+	flush_bytes = 0;
+	flush_all = 0;
+	n_rects = 0;
+	row = 0;
+	while (row < DIRTY_ROWS) {
+		if (dirty[row] == 0) {
+			row++;
+			continue;
+		}
+		first = 0;
+		while ((dirty[row] & (1 << first)) == 0) {
+			first++;
+		}
+		last = first;
+		while ((last + 1 < DIRTY_COLS) &&
+		       (dirty[row] & (1 << (last + 1)))) {
+			last++;
+		}
+		mask = ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
+
+		end = row + 1;
+		while ((end < DIRTY_ROWS) && ((dirty[end] & mask) == mask)) {
+			end++;
+		}
+		r = &rects[n_rects++];
+		r->x = first * DIRTY_TILE;
+		r->y = row * DIRTY_TILE;
+		r->w = (last - first + 1) * DIRTY_TILE;
+		r->h = (end - row) * DIRTY_TILE;
+		lcd_sync_rect(r);
+		/* two windows of 1 + 4 bytes, the write command, the pixels */
+		flush_bytes += 11 + r->w * r->h * 2;
+		while (end-- > row) {
+			dirty[end] &= ~mask;
+		}
+	}
+
+	if (n_rects == 0) {
+		if (done) {
+			done();
+		}
+		return;
+	}
+	frame_done = done;
+	dma_busy = 1;
+	rect_ndx = 0;
+	gpio_clear(GPIOC, GPIO2);	/* Select the LCD */
+	lcd_start_rect();
+}
+
+/*
+ * void lcd_show_frame(void)
+ *
+ * Show the frame that was just drawn, and wait until the display
+ * has it.
+ */
+void lcd_show_frame(void)
+{
+	lcd_show_frame_async(NULL);
+	lcd_wait();
+}
+
+/*
+ * uint32_t lcd_flush_bytes(void)
+ *
+ * How many bytes the last lcd_show_frame() sent to the display. A full
+ * frame is FRAME_SIZE_BYTES plus a few bytes of commands.
+ */
+uint32_t lcd_flush_bytes(void)
+{
+	return flush_bytes;
 }
 
 /*
@@ -309,6 +646,7 @@ void lcd_show_frame(void)
 void
 lcd_spi_init(void)
 {
+	int i;
 
 	/*
 	 * Set up the GPIO lines for the SPI port and
@@ -325,6 +663,12 @@ lcd_spi_init(void)
 	cur_frame = (uint16_t *)(SDRAM_BASE_ADDRESS);
 	display_frame = cur_frame + (LCD_WIDTH * LCD_HEIGHT);
 
+	/* Neither the SDRAM nor the display hold anything useful yet */
+	for (i = 0; i < DIRTY_ROWS; i++) {
+		dirty[i] = (1 << DIRTY_COLS) - 1;
+	}
+	flush_all = 1;
+
 	rcc_periph_clock_enable(RCC_SPI5);
 	spi_init_master(LCD_SPI, SPI_CR1_BAUDRATE_FPCLK_DIV_4,
 					SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
@@ -332,8 +676,26 @@ lcd_spi_init(void)
 					SPI_CR1_DFF_8BIT,
 					SPI_CR1_MSBFIRST);
 	spi_enable_ss_output(LCD_SPI);
+	spi_enable_tx_dma(LCD_SPI);
 	spi_enable(LCD_SPI);
 
+	/* Memory to SPI5, one byte at a time; see lcd_dma_next() */
+	rcc_periph_clock_enable(RCC_DMA2);
+	dma_stream_reset(LCD_DMA, LCD_DMA_STREAM);
+	dma_channel_select(LCD_DMA, LCD_DMA_STREAM, LCD_DMA_CHANNEL);
+	dma_set_priority(LCD_DMA, LCD_DMA_STREAM, DMA_SxCR_PL_MEDIUM);
+	dma_set_transfer_mode(LCD_DMA, LCD_DMA_STREAM,
+			      DMA_SxCR_DIR_MEM_TO_PERIPHERAL);
+	dma_set_memory_size(LCD_DMA, LCD_DMA_STREAM, DMA_SxCR_MSIZE_8BIT);
+	dma_set_peripheral_size(LCD_DMA, LCD_DMA_STREAM,
+				DMA_SxCR_PSIZE_8BIT);
+	dma_enable_memory_increment_mode(LCD_DMA, LCD_DMA_STREAM);
+	dma_set_peripheral_address(LCD_DMA, LCD_DMA_STREAM,
+				   (uint32_t) &SPI_DR(LCD_SPI));
+	dma_enable_transfer_complete_interrupt(LCD_DMA, LCD_DMA_STREAM);
+	dma_enable_transfer_error_interrupt(LCD_DMA, LCD_DMA_STREAM);
+	nvic_enable_irq(NVIC_DMA2_STREAM4_IRQ);
+
 	/* Set up the display */
 	console_puts("Initialize the display.\n");
 	initialize_display(initialization);
@@ -29,7 +29,10 @@
 
 void lcd_spi_init(void);
 void lcd_show_frame(void);
+void lcd_show_frame_async(void (*done)(void));
+void lcd_wait(void);
 void lcd_draw_pixel(int x, int y, uint16_t color);
+uint32_t lcd_flush_bytes(void);
 
 /* Color definitions */
 #define	LCD_BLACK   0x0000
@@ -0,0 +1,421 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test of what lcd_show_frame() sends, built by 'make HOST=1'.
+ *
+ * The Makefile wraps spi_xfer(), gpio_set(), gpio_clear(), msleep() and
+ * dma_enable_stream() at link time. Every byte lcd-spi.c sends, polled
+ * or by DMA, is played into a model of the ILI9341: its column and page
+ * address window and its graphics RAM. There is no DMA on the host, so
+ * the stream is run to the end as soon as it is enabled and its
+ * interrupt raised by hand; lcd_show_frame_async() has therefore
+ * finished when it returns. The stream must never be enabled with any
+ * of its interrupt flags still set.
+ *
+ * After every flush the GRAM has to match the displayed frame, the
+ * frame being built has to start out as a copy of it, and the bytes on
+ * the wire have to be what lcd_flush_bytes() says. A few typical update
+ * patterns are run, and their bytes per frame set against a full frame.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
+#include "lcd-spi.h"
+#include "gfx.h"
+
+#define FULL_FRAME	(FRAME_SIZE_BYTES + 11)
+#define LCD_DMA_FLAGS	(DMA_TCIF | DMA_HTIF | DMA_TEIF | DMA_DMEIF | DMA_FEIF)
+
+#define d2r(d) ((d) * 6.2831853 / 360.0)
+
+uint16_t __real_spi_xfer(uint32_t spi, uint16_t data);
+void __real_gpio_set(uint32_t gpioport, uint16_t gpios);
+void __real_gpio_clear(uint32_t gpioport, uint16_t gpios);
+void __real_dma_enable_stream(uint32_t dma, uint8_t stream);
+
+extern uint16_t *cur_frame;
+extern uint16_t *display_frame;
+
+/* The display controller */
+static uint8_t gram[LCD_HEIGHT][LCD_WIDTH * 2];
+static int cs = 1, dcx;
+static uint8_t cmd, param[4];
+static uint32_t n_param;
+static uint16_t col_start, col_end = LCD_WIDTH - 1;
+static uint16_t page_start, page_end = LCD_HEIGHT - 1;
+static uint16_t col, page;
+
+static uint32_t wire, frames, bytes, done_calls;
+static int errors, fail_in;
+
+static void lcd_byte(uint8_t b)
+{
+	uint16_t start, end;
+
+	if (cs) {
+		printf("byte 0x%02x sent without chip select\n", b);
+		errors++;
+		return;
+	}
+	wire++;
+	if (!dcx) {
+		cmd = b;
+		n_param = 0;
+		col = col_start;
+		page = page_start;
+		return;
+	}
+
+	switch (cmd) {
+	case 0x2A:
+	case 0x2B:
+		if (n_param < 4) {
+			param[n_param] = b;
+		}
+		if (++n_param != 4) {
+			break;
+		}
+		start = param[0] << 8 | param[1];
+		end = param[2] << 8 | param[3];
+		if (cmd == 0x2A) {
+			col_start = start;
+			col_end = end;
+		} else {
+			page_start = start;
+			page_end = end;
+		}
+		break;
+	case 0x2C:
+		if (page > page_end || page >= LCD_HEIGHT ||
+		    col >= LCD_WIDTH) {
+			printf("pixel data past the end of the window\n");
+			errors++;
+			break;
+		}
+		gram[page][col * 2 + (n_param & 1)] = b;
+		if ((++n_param & 1) == 0 && ++col > col_end) {
+			col = col_start;
+			page++;
+		}
+		break;
+	}
+}
+
+uint16_t __wrap_spi_xfer(uint32_t spi, uint16_t data)
+{
+	lcd_byte(data);
+	return __real_spi_xfer(spi, data);
+}
+
+static void pins(uint32_t gpioport, uint16_t gpios, int level)
+{
+	if (gpioport == GPIOC && (gpios & GPIO2)) {
+		cs = level;
+	}
+	if (gpioport == GPIOD && (gpios & GPIO13)) {
+		dcx = level;
+	}
+}
+
+void __wrap_gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	pins(gpioport, gpios, 1);
+	__real_gpio_set(gpioport, gpios);
+}
+
+void __wrap_gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	pins(gpioport, gpios, 0);
+	__real_gpio_clear(gpioport, gpios);
+}
+
+void __wrap_msleep(uint32_t delay)
+{
+	(void)delay;
+}
+
+/*
+ * The register only holds the low 32 bits of the address. The frames
+ * are in SDRAM, which is mapped where it is on the chip, the commands
+ * in the driver's bss, which shares its upper bits with ours.
+ */
+static const uint8_t *dma_buffer(uint32_t m0ar)
+{
+	uintptr_t high = (uintptr_t)gram & ~(uintptr_t)0xffffffff;
+
+	if (m0ar >= 0xc0000000) {
+		return (const uint8_t *)(uintptr_t)m0ar;
+	}
+	return (const uint8_t *)(high | m0ar);
+}
+
+/*
+ * The interrupt handler enables the stream again for the next piece,
+ * which then runs from the loop here rather than recursively. Once
+ * fail_in reaches zero, that transfer stops half way with a transfer
+ * error.
+ */
+void __wrap_dma_enable_stream(uint32_t dma, uint8_t stream)
+{
+	static int running;
+	const uint8_t *p;
+	uint32_t n, flags;
+
+	/* HIFCR is write one to clear; stream 4 has the low bits of HISR */
+	DMA_HISR(DMA2) &= ~DMA_HIFCR(DMA2);
+	DMA_HIFCR(DMA2) = 0;
+	if (DMA_HISR(DMA2) & LCD_DMA_FLAGS) {
+		printf("stream enabled with flags 0x%02x set\n",
+		       DMA_HISR(DMA2) & LCD_DMA_FLAGS);
+		errors++;
+	}
+	__real_dma_enable_stream(dma, stream);
+	if (running) {
+		return;
+	}
+	running = 1;
+	while (DMA_SCR(DMA2, DMA_STREAM4) & DMA_SxCR_EN) {
+		p = dma_buffer(DMA_SM0AR(DMA2, DMA_STREAM4));
+		n = DMA_SNDTR(DMA2, DMA_STREAM4);
+		flags = DMA_TCIF | DMA_HTIF;
+		if (fail_in > 0 && --fail_in == 0) {
+			n /= 2;
+			flags = DMA_TEIF;
+		}
+		while (n--) {
+			lcd_byte(*p++);
+		}
+		DMA_SNDTR(DMA2, DMA_STREAM4) = 0;
+		DMA_SCR(DMA2, DMA_STREAM4) &= ~DMA_SxCR_EN;
+
+		DMA_HISR(DMA2) |= flags;
+		dma2_stream4_isr();
+		DMA_HISR(DMA2) &= ~DMA_HIFCR(DMA2);
+		DMA_HIFCR(DMA2) = 0;
+	}
+	running = 0;
+}
+
+static void check(uint32_t sent)
+{
+	uint32_t i;
+	const uint8_t *frame = (const uint8_t *)display_frame;
+
+	if (sent != lcd_flush_bytes()) {
+		printf("frame %u: %u bytes sent, lcd_flush_bytes() says %u\n",
+		       frames, sent, lcd_flush_bytes());
+		errors++;
+	}
+	for (i = 0; i < FRAME_SIZE_BYTES; i++) {
+		if (gram[i / (LCD_WIDTH * 2)][i % (LCD_WIDTH * 2)] !=
+		    frame[i]) {
+			printf("frame %u: pixel %u, %u not on the display\n",
+			       frames, i / 2 % LCD_WIDTH, i / 2 / LCD_WIDTH);
+			errors++;
+			break;
+		}
+	}
+	if (memcmp(cur_frame, display_frame, FRAME_SIZE_BYTES) != 0) {
+		printf("frame %u: the next frame does not start from the "
+		       "displayed one\n", frames);
+		errors++;
+	}
+}
+
+static void frame_done(void)
+{
+	done_calls++;
+}
+
+static void show(void)
+{
+	uint32_t before = wire;
+
+	done_calls = 0;
+	lcd_show_frame_async(frame_done);
+	lcd_wait();
+	if (done_calls != 1) {
+		printf("frame %u: done called %u times\n", frames, done_calls);
+		errors++;
+	}
+	check(wire - before);
+	frames++;
+	bytes += wire - before;
+}
+
+/* The bytes per frame have to come out between min and max */
+static void report(const char *name, uint32_t min, uint32_t max)
+{
+	uint32_t avg = bytes / frames;
+
+	printf("%-10s %7u %10u %10u %8.1f%%\n", name, frames, bytes, avg,
+	       100.0 * bytes / ((double)frames * FULL_FRAME));
+	if (avg < min || avg > max) {
+		printf("expected %u to %u bytes per frame\n", min, max);
+		errors++;
+	}
+	frames = 0;
+	bytes = 0;
+}
+
+/* The start up screen of lcd-serial.c */
+static void structured(void)
+{
+	gfx_fillScreen(LCD_GREY);
+	gfx_fillRoundRect(10, 10, 220, 220, 5, LCD_WHITE);
+	gfx_drawRoundRect(10, 10, 220, 220, 5, LCD_RED);
+	gfx_fillCircle(20, 250, 10, LCD_RED);
+	gfx_fillCircle(120, 250, 10, LCD_GREEN);
+	gfx_fillCircle(220, 250, 10, LCD_BLUE);
+	gfx_setTextSize(2);
+	gfx_setCursor(15, 25);
+	gfx_puts("STM32F4-DISCO");
+	gfx_setTextSize(1);
+	gfx_setCursor(15, 49);
+	gfx_puts("Simple example to put some");
+	gfx_setCursor(15, 60);
+	gfx_puts("stuff on the LCD screen.");
+}
+
+/* The animation of lcd-serial.c, redrawn from scratch every frame */
+static void planets(void)
+{
+	int p1 = 0, p2 = 45, p3 = 90, i;
+
+	gfx_setTextColor(LCD_YELLOW, LCD_BLACK);
+	gfx_setTextSize(3);
+	for (i = 0; i < 360; i++) {
+		gfx_fillScreen(LCD_BLACK);
+		gfx_setCursor(15, 36);
+		gfx_puts("PLANETS!");
+		gfx_fillCircle(120, 160, 40, LCD_YELLOW);
+		gfx_drawCircle(120, 160, 55, LCD_GREY);
+		gfx_drawCircle(120, 160, 75, LCD_GREY);
+		gfx_drawCircle(120, 160, 100, LCD_GREY);
+		gfx_fillCircle(120 + (sin(d2r(p1)) * 55),
+			       160 + (cos(d2r(p1)) * 55), 5, LCD_RED);
+		gfx_fillCircle(120 + (sin(d2r(p2)) * 75),
+			       160 + (cos(d2r(p2)) * 75), 10, LCD_WHITE);
+		gfx_fillCircle(120 + (sin(d2r(p3)) * 100),
+			       160 + (cos(d2r(p3)) * 100), 8, LCD_BLUE);
+		p1 = (p1 + 3) % 360;
+		p2 = (p2 + 2) % 360;
+		p3 = (p3 + 1) % 360;
+		show();
+	}
+}
+
+/* A status line: a counter drawn over its old value */
+static void counter(void)
+{
+	char s[12];
+	int i;
+
+	gfx_setTextColor(LCD_WHITE, LCD_BLACK);
+	gfx_setTextSize(1);
+	for (i = 0; i < 500; i++) {
+		snprintf(s, sizeof(s), "%8d", i * 37);
+		gfx_setCursor(180, 304);
+		gfx_puts(s);
+		show();
+	}
+}
+
+/* Console output: a line of text at a time, scrolling the screen up */
+static void console(void)
+{
+	char s[40];
+	int i, line;
+
+	gfx_setTextColor(LCD_GREEN, LCD_BLACK);
+	gfx_setTextSize(1);
+	for (i = 0; i < 200; i++) {
+		line = i % 26;
+		if (line == 0) {
+			gfx_fillScreen(LCD_BLACK);
+		}
+		snprintf(s, sizeof(s), "%4d: sample %d", i, i * i % 1000);
+		gfx_setCursor(0, line * 12);
+		gfx_puts(s);
+		show();
+	}
+}
+
+int main(void)
+{
+	int i;
+
+	printf("%-10s %7s %10s %10s %9s\n", "workload", "frames", "bytes",
+	       "per frame", "of full");
+
+	lcd_spi_init();
+	check(lcd_flush_bytes());
+	bytes = lcd_flush_bytes();
+	frames = 1;
+	report("init", FULL_FRAME, FULL_FRAME);
+
+	gfx_init(lcd_draw_pixel, LCD_WIDTH, LCD_HEIGHT);
+	structured();
+	show();
+	report("screen", FULL_FRAME, FULL_FRAME);
+	for (i = 0; i < 10; i++) {
+		structured();
+		show();
+	}
+	report("same", 0, 0);
+
+	/* These should cost an order of magnitude less than full frames */
+	planets();
+	report("planets", 1, FULL_FRAME / 10);
+	counter();
+	report("counter", 1, FULL_FRAME / 10);
+	console();
+	report("console", 1, FULL_FRAME / 10);
+
+	/* Every tile changes, one full width rectangle */
+	for (i = 0; i < 4; i++) {
+		gfx_fillScreen(i & 1 ? LCD_BLUE : LCD_RED);
+		show();
+	}
+	report("full", FULL_FRAME, FULL_FRAME);
+
+	/*
+	 * A transfer error part way through a frame: the frame is given
+	 * up, and the next one has to send everything.
+	 */
+	gfx_fillScreen(LCD_BLACK);
+	gfx_fillCircle(120, 160, 40, LCD_YELLOW);
+	fail_in = 3;
+	done_calls = 0;
+	lcd_show_frame_async(frame_done);
+	lcd_wait();
+	if (fail_in != 0 || done_calls != 1) {
+		printf("transfer error not seen\n");
+		errors++;
+	}
+	show();
+	report("error", FULL_FRAME, FULL_FRAME);
+
+	printf("%s\n", errors ? "FAILED" : "GRAM matches the frame after every "
+	       "flush");
+	return errors ? 1 : 0;
+}
@@ -21,6 +21,10 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef HOST_BUILD
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
 #include <stdio.h>
 #include <ctype.h>
 #include <libopencm3/stm32/rcc.h>
@@ -74,6 +78,7 @@ void sys_tick_handler(void)
  * nearly immediately. So if you need really
  * precise delays, use one of the timers.
  */
+#ifndef HOST_BUILD
 void
 msleep(uint32_t delay)
 {
@@ -86,3 +91,25 @@ mtime(void)
 {
 	return system_millis;
 }
+#else
+/*
+ * There is no SysTick interrupt in a host build, so time comes
+ * from the host's monotonic clock instead.
+ */
+uint32_t
+mtime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+msleep(uint32_t delay)
+{
+	uint32_t start = mtime();
+
+	while (mtime() - start < delay);
+}
+#endif
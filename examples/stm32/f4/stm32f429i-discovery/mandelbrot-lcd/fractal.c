@@ -0,0 +1,346 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Alternative Mandelbrot kernels and a tile renderer.
+ *
+ * Instead of calling lcd_draw_pixel() for every point, a band of
+ * TILE_ROWS scanlines is computed into a buffer in internal SRAM and
+ * handed to the LCD code in one go, which then copies whole rows into
+ * the SDRAM frame buffer.
+ *
+ * All kernels reject points inside the main cardioid and the period-2
+ * bulb up front, since those never escape and would otherwise cost the
+ * full FRACTAL_MAX_ITER iterations. Points that fall into a cycle are
+ * caught by comparing against a saved orbit point (Brent's method); in
+ * fixed point the orbit repeats exactly, so this triggers often.
+ */
+
+#include <stdint.h>
+#include "fractal.h"
+#include "lcd.h"
+
+#define TILE_ROWS	8
+
+#define Q26_ONE		(1 << 26)
+#define Q12_ONE		(1 << 12)
+#define TO_Q26(f)	((int32_t)((f) * (float)Q26_ONE))
+#define TO_Q12(f)	((int32_t)((f) * (float)Q12_ONE))
+
+/*
+ * Dual 16 bit multiply helpers. Lane 0 (bits 15:0) holds the real
+ * part, lane 1 (bits 31:16) the imaginary part.
+ */
+#if defined(__ARM_FEATURE_DSP)
+/* lo * lo + hi * hi */
+static inline int32_t dsp_smuad(uint32_t a, uint32_t b)
+{
+	int32_t r;
+
+	__asm__("smuad %0, %1, %2" : "=r" (r) : "r" (a), "r" (b));
+	return r;
+}
+
+/* lo * lo - hi * hi + acc */
+static inline int32_t dsp_smlsd(uint32_t a, uint32_t b, int32_t acc)
+{
+	int32_t r;
+
+	__asm__("smlsd %0, %1, %2, %3" : "=r" (r) : "r" (a), "r" (b), "r" (acc));
+	return r;
+}
+
+/* lo * hi + hi * lo + acc */
+static inline int32_t dsp_smladx(uint32_t a, uint32_t b, int32_t acc)
+{
+	int32_t r;
+
+	__asm__("smladx %0, %1, %2, %3" : "=r" (r) : "r" (a), "r" (b), "r" (acc));
+	return r;
+}
+
+/* Pack the low halves of lo and hi into one word */
+static inline uint32_t dsp_pkhbt(int32_t lo, int32_t hi)
+{
+	uint32_t r;
+
+	__asm__("pkhbt %0, %1, %2, lsl #16" : "=r" (r) : "r" (lo), "r" (hi));
+	return r;
+}
+#else
+static inline int32_t dsp_smuad(uint32_t a, uint32_t b)
+{
+	return (int16_t)a * (int16_t)b +
+	       (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+
+static inline int32_t dsp_smlsd(uint32_t a, uint32_t b, int32_t acc)
+{
+	return (int16_t)a * (int16_t)b -
+	       (int16_t)(a >> 16) * (int16_t)(b >> 16) + acc;
+}
+
+static inline int32_t dsp_smladx(uint32_t a, uint32_t b, int32_t acc)
+{
+	return (int16_t)a * (int16_t)(b >> 16) +
+	       (int16_t)(a >> 16) * (int16_t)b + acc;
+}
+
+static inline uint32_t dsp_pkhbt(int32_t lo, int32_t hi)
+{
+	return ((uint32_t)lo & 0xffff) | ((uint32_t)hi << 16);
+}
+#endif
+
+/*
+ * Is c = px + i*py inside the main cardioid or the period-2 bulb?
+ * Only points close to the set are tested, which keeps the 64 bit
+ * intermediates well away from overflowing.
+ */
+static int in_main_bulbs_q26(int32_t px, int32_t py)
+{
+	int64_t x = px, y = py;
+	int64_t xm, y2, q;
+
+	if ((px < -2 * Q26_ONE) || (px > Q26_ONE / 2) ||
+	    (py < -3 * Q26_ONE / 2) || (py > 3 * Q26_ONE / 2)) {
+		return 0;
+	}
+
+	y2 = (y * y) >> 26;
+
+	/* (x + 1)^2 + y^2 <= 1/16 */
+	if ((((x + Q26_ONE) * (x + Q26_ONE)) >> 26) + y2 <= Q26_ONE / 16) {
+		return 1;
+	}
+
+	/* q = (x - 1/4)^2 + y^2, q * (q + x - 1/4) <= y^2 / 4 */
+	xm = x - Q26_ONE / 4;
+	q = ((xm * xm) >> 26) + y2;
+	return ((q * (q + xm)) >> 26) <= (y2 >> 2);
+}
+
+static int in_main_bulbs_float(float px, float py)
+{
+	float xm = px - 0.25f;
+	float y2 = py * py;
+	float q = xm * xm + y2;
+
+	if ((px + 1.0f) * (px + 1.0f) + y2 <= 0.0625f) {
+		return 1;
+	}
+	return q * (q + xm) <= 0.25f * y2;
+}
+
+int fractal_iterate_float(float px, float py)
+{
+	int it, save_at = 1;
+	float x = 0, y = 0, sx = 0, sy = 0;
+
+	if (in_main_bulbs_float(px, py)) {
+		return 0;
+	}
+	for (it = 0; it < FRACTAL_MAX_ITER; it++) {
+		float nx = x*x;
+		float ny = y*y;
+		if ((nx + ny) > 4) {
+			return it;
+		}
+		/* Zn+1 = Zn^2 + P */
+		y = 2*x*y + py;
+		x = nx - ny + px;
+		if ((x == sx) && (y == sy)) {
+			return 0;
+		}
+		if (it == save_at) {
+			sx = x;
+			sy = y;
+			save_at <<= 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Q5.26: |z| stays below 6 until the escape test catches it, the
+ * squares are kept in 64 bits (one SMULL each on the Cortex-M4).
+ */
+int fractal_iterate_q26(int32_t px, int32_t py)
+{
+	int it, save_at = 1;
+	int32_t x = 0, y = 0, sx = 0, sy = 0;
+
+	if (in_main_bulbs_q26(px, py)) {
+		return 0;
+	}
+	for (it = 0; it < FRACTAL_MAX_ITER; it++) {
+		int64_t nx = (int64_t)x * x;
+		int64_t ny = (int64_t)y * y;
+		if ((nx + ny) > ((int64_t)4 << 52)) {
+			return it;
+		}
+		/* 2xy in Q26 is (x * y) >> 25 */
+		y = (int32_t)(((int64_t)x * y) >> 25) + py;
+		x = (int32_t)((nx - ny) >> 26) + px;
+		if ((x == sx) && (y == sy)) {
+			return 0;
+		}
+		if (it == save_at) {
+			sx = x;
+			sy = y;
+			save_at <<= 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Q3.12, z packed as (y << 16 | x). One iteration is three dual MACs:
+ *   |z|^2          = smuad(z, z)
+ *   x^2 - y^2 + px = smlsd(z, z, px)
+ *   2xy + py       = smladx(z, z, py)
+ * with the products and accumulators in Q24.
+ */
+int fractal_iterate_simd(int32_t px, int32_t py)
+{
+	int it, save_at = 1;
+	uint32_t z = 0, saved = 0;
+	int32_t cx = px * Q12_ONE, cy = py * Q12_ONE;
+
+	if (in_main_bulbs_q26(px * (1 << 14), py * (1 << 14))) {
+		return 0;
+	}
+	for (it = 0; it < FRACTAL_MAX_ITER; it++) {
+		if (dsp_smuad(z, z) > (4 << 24)) {
+			return it;
+		}
+		z = dsp_pkhbt(dsp_smlsd(z, z, cx) >> 12,
+			      dsp_smladx(z, z, cy) >> 12);
+		if (z == saved) {
+			return 0;
+		}
+		if (it == save_at) {
+			saved = z;
+			save_at <<= 1;
+		}
+	}
+	return 0;
+}
+
+const char *fractal_kernel_name(enum fractal_kernel k)
+{
+	switch (k) {
+	case FRACTAL_FLOAT:
+		return "float";
+	case FRACTAL_Q26:
+		return "q26";
+	case FRACTAL_SIMD:
+		return "simd";
+	default:
+		return "?";
+	}
+}
+
+/*
+ * Use the cheapest kernel whose resolution is still at least 16 steps
+ * per pixel, so zooming in does not turn into blocks.
+ */
+enum fractal_kernel fractal_pick_kernel(float scale)
+{
+	if (scale >= 16.0f / Q12_ONE) {
+		return FRACTAL_SIMD;
+	}
+	if (scale >= 16.0f / Q26_ONE) {
+		return FRACTAL_Q26;
+	}
+	return FRACTAL_FLOAT;
+}
+
+/*
+ * Every c outside |c| <= 2 escapes on the first step, so coordinates
+ * can be clamped to +-4 to keep them inside the range of the fixed
+ * point formats without changing the result.
+ */
+static float clamp_coord(float f)
+{
+	if (f > 4.0f) {
+		return 4.0f;
+	}
+	if (f < -4.0f) {
+		return -4.0f;
+	}
+	return f;
+}
+
+/* One band of scanlines, built here and then copied to the frame */
+static uint16_t tile[LCD_WIDTH * TILE_ROWS];
+
+/* Real part of every column, computed once per frame */
+static float col_float[LCD_WIDTH];
+static int32_t col_fixed[LCD_WIDTH];
+
+/* One scanline of LCD_WIDTH pixels at imaginary coordinate py */
+static void render_line(enum fractal_kernel k, uint16_t *dst, float py,
+			const uint16_t *colors)
+{
+	int x;
+	int32_t qy;
+
+	switch (k) {
+	case FRACTAL_FLOAT:
+		for (x = 0; x < LCD_WIDTH; x++) {
+			*dst++ = colors[fractal_iterate_float(col_float[x], py)];
+		}
+		break;
+	case FRACTAL_Q26:
+		qy = TO_Q26(clamp_coord(py));
+		for (x = 0; x < LCD_WIDTH; x++) {
+			*dst++ = colors[fractal_iterate_q26(col_fixed[x], qy)];
+		}
+		break;
+	case FRACTAL_SIMD:
+		qy = TO_Q12(clamp_coord(py));
+		for (x = 0; x < LCD_WIDTH; x++) {
+			*dst++ = colors[fractal_iterate_simd(col_fixed[x], qy)];
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void fractal_render(enum fractal_kernel k, float cx, float cy, float scale,
+		    const uint16_t *colors)
+{
+	int x, y, row;
+	float px;
+
+	for (x = 0; x < LCD_WIDTH; x++) {
+		col_float[x] = cx + (x - LCD_WIDTH / 2) * scale;
+		px = clamp_coord(col_float[x]);
+		col_fixed[x] = (k == FRACTAL_SIMD) ? TO_Q12(px) : TO_Q26(px);
+	}
+
+	for (y = 0; y < LCD_HEIGHT; y += TILE_ROWS) {
+		for (row = 0; row < TILE_ROWS; row++) {
+			render_line(k, &tile[row * LCD_WIDTH],
+				    cy + (y + row - LCD_HEIGHT / 2) * scale,
+				    colors);
+		}
+		lcd_draw_tile(0, y, LCD_WIDTH, TILE_ROWS, tile);
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRACTAL_H
+#define __FRACTAL_H
+
+#include <stdint.h>
+
+/* Maximum number of iterations for the escape-time calculation */
+#define FRACTAL_MAX_ITER	32
+
+/*
+ * The escape-time kernels. All of them return the iteration at which
+ * the point escaped, or 0 if it is (assumed to be) part of the set.
+ *
+ *  FLOAT - single precision, using the FPU
+ *  Q26   - Q5.26 fixed point with 64 bit products
+ *  SIMD  - Q3.12 fixed point, real and imaginary part packed into one
+ *          word and processed with the Cortex-M4 dual 16 bit MAC
+ *          instructions (portable C is used where they do not exist)
+ */
+enum fractal_kernel {
+	FRACTAL_FLOAT,
+	FRACTAL_Q26,
+	FRACTAL_SIMD,
+	FRACTAL_KERNELS
+};
+
+int fractal_iterate_float(float px, float py);
+int fractal_iterate_q26(int32_t px, int32_t py);
+int fractal_iterate_simd(int32_t px, int32_t py);
+
+const char *fractal_kernel_name(enum fractal_kernel k);
+enum fractal_kernel fractal_pick_kernel(float scale);
+
+/*
+ * Render a whole frame centered on (cx, cy), scale units per pixel,
+ * mapping iteration counts through colors[0 .. FRACTAL_MAX_ITER].
+ */
+void fractal_render(enum fractal_kernel k, float cx, float cy, float scale,
+		    const uint16_t *colors);
+
+#endif
@@ -22,6 +22,7 @@
  */
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <libopencm3/stm32/spi.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
@@ -52,6 +53,29 @@ uint16_t *cur_frame;
 uint16_t *display_frame;
 
 
+/*
+ * Dirty tracking.
+ *
+ * The screen is divided into DIRTY_TILE x DIRTY_TILE pixel tiles and
+ * every row of tiles has a bit mask of the tiles that were drawn into
+ * since the last lcd_show_frame(). Only those get sent to the display,
+ * and only if they actually differ from what it shows: the frame being
+ * built always starts out as a copy of the displayed one (see
+ * lcd_write_rect()), so clearing the screen and redrawing a scene only
+ * costs the parts that moved.
+ */
+#define DIRTY_TILE	16
+#define DIRTY_COLS	(LCD_WIDTH / DIRTY_TILE)
+#define DIRTY_ROWS	(LCD_HEIGHT / DIRTY_TILE)
+
+static uint16_t dirty[DIRTY_ROWS];
+
+/* the display content is unknown, send everything next time */
+static int flush_all;
+
+/* bytes sent over SPI by the last lcd_show_frame() */
+static uint32_t flush_bytes;
+
 /*
  * Drawing a pixel consists of storing a 16 bit value in the
  * memory used to hold the frame. This code computes the address
@@ -65,6 +89,35 @@ lcd_draw_pixel(int x, int y, uint16_t color)
 		while (1);
 	}
 	*(cur_frame + x + y * LCD_WIDTH) = color;
+	dirty[y / DIRTY_TILE] |= 1 << (x / DIRTY_TILE);
+}
+
+/*
+ * Copy a w x h block of pixels, stored row after row, into the
+ * frame buffer. Each row is a single memcpy() into SDRAM rather
+ * than w separate calls to lcd_draw_pixel().
+ */
+void
+lcd_draw_tile(int x, int y, int w, int h, const uint16_t *pixels)
+{
+	uint16_t *dst;
+	int tx, ty;
+
+	if ((x + w > LCD_WIDTH) || (y + h > LCD_HEIGHT)) {
+		printf("Tile out of range [%d, %d] %dx%d\n", x, y, w, h);
+		while (1);
+	}
+	for (ty = y / DIRTY_TILE; ty <= (y + h - 1) / DIRTY_TILE; ty++) {
+		for (tx = x / DIRTY_TILE; tx <= (x + w - 1) / DIRTY_TILE; tx++) {
+			dirty[ty] |= 1 << tx;
+		}
+	}
+	dst = cur_frame + x + y * LCD_WIDTH;
+	while (h--) {
+		memcpy(dst, pixels, w * sizeof(uint16_t));
+		dst += LCD_WIDTH;
+		pixels += w;
+	}
 }
 
 /*
@@ -255,34 +308,142 @@ test_image(void)
 	}
 }
 
+/*
+ * void lcd_write_rect(x, y, w, h)
+ *
+ * Set the column and page address window of the display to the
+ * rectangle and stream that part of the displayed frame into it,
+ * one row at a time. Every row is also copied into the frame being
+ * built, so that buffer picks up where the display is now and the
+ * application can keep drawing incrementally.
+ */
+static void
+lcd_write_rect(int x, int y, int w, int h)
+{
+	uint8_t		win[4];
+	const uint8_t	*src;
+	int		row, i;
+
+	win[0] = (x >> 8) & 0xff;
+	win[1] = x & 0xff;
+	win[2] = ((x + w - 1) >> 8) & 0xff;
+	win[3] = (x + w - 1) & 0xff;
+	lcd_command(0x2A, 0, 4, win);
+	win[0] = (y >> 8) & 0xff;
+	win[1] = y & 0xff;
+	win[2] = ((y + h - 1) >> 8) & 0xff;
+	win[3] = (y + h - 1) & 0xff;
+	lcd_command(0x2B, 0, 4, win);
+
+	gpio_clear(GPIOC, GPIO2);	/* Select the LCD */
+	(void) spi_xfer(LCD_SPI, 0x2C);
+	gpio_set(GPIOD, GPIO13);	/* Set the D/CX pin */
+	for (row = y; row < y + h; row++) {
+		src = (const uint8_t *)(display_frame + x + row * LCD_WIDTH);
+		for (i = 0; i < w * 2; i++) {
+			(void) spi_xfer(LCD_SPI, src[i]);
+		}
+		memcpy(cur_frame + x + row * LCD_WIDTH, src, w * 2);
+	}
+	gpio_set(GPIOC, GPIO2);		/* Turn off chip select */
+	gpio_clear(GPIOD, GPIO13);	/* always reset D/CX */
+
+	/* two windows of 1 + 4 bytes, the write command, the pixels */
+	flush_bytes += 11 + w * h * 2;
+}
+
+/* Is this tile of the new frame the same as the displayed one? */
+static int
+tile_unchanged(int tx, int ty)
+{
+	int	row, offset;
+
+	for (row = 0; row < DIRTY_TILE; row++) {
+		offset = (ty * DIRTY_TILE + row) * LCD_WIDTH + tx * DIRTY_TILE;
+		if (memcmp(cur_frame + offset, display_frame + offset,
+			   DIRTY_TILE * 2) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /*
  * void lcd_show_frame(void)
  *
- * Dump an entire frame to the LCD all at once. In theory you
- * could call this with DMA but that is made more difficult by
- * the implementation of SPI and the modules interpretation of
- * D/CX line.
+ * Make the frame that was just drawn the displayed one, and send
+ * the parts of it that changed to the LCD. Tiles that were drawn
+ * into but came out the same are dropped first, the rest are
+ * gathered into rectangles greedily: take the first run of dirty
+ * tiles in a row, then extend it downwards for as long as the rows
+ * below are dirty across the same run. Each rectangle costs 11 bytes of
+ * commands, much less than sending clean pixels along, so runs are
+ * never merged across clean tiles.
+ *
+ * In theory you could send the pixels with DMA but that is made more
+ * difficult by the implementation of SPI and the modules
+ * interpretation of D/CX line.
  */
 void lcd_show_frame(void)
 {
 	uint16_t	*t;
-	uint8_t size[4];
+	uint16_t	mask;
+	int		row, end, first, last;
+
+	for (row = 0; row < DIRTY_ROWS && !flush_all; row++) {
+		for (first = 0; first < DIRTY_COLS; first++) {
+			if ((dirty[row] & (1 << first)) &&
+			    tile_unchanged(first, row)) {
+				dirty[row] &= ~(1 << first);
+			}
+		}
+	}
 
 	t = display_frame;
 	display_frame = cur_frame;
 	cur_frame = t;
-	/*  */
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_WIDTH >> 8) & 0xff;
-	size[3] = (LCD_WIDTH) & 0xff;
-	lcd_command(0x2A, 0, 4, (const uint8_t *)&size[0]);
-	size[0] = 0;
-	size[1] = 0;
-	size[2] = (LCD_HEIGHT >> 8) & 0xff;
-	size[3] = LCD_HEIGHT & 0xff;
-	lcd_command(0x2B, 0, 4, (const uint8_t *)&size[0]);
-	lcd_command(0x2C, 0, FRAME_SIZE_BYTES, (const uint8_t *)display_frame);
+
+	flush_bytes = 0;
+	flush_all = 0;
+	row = 0;
+	while (row < DIRTY_ROWS) {
+		if (dirty[row] == 0) {
+			row++;
+			continue;
+		}
+		first = 0;
+		while ((dirty[row] & (1 << first)) == 0) {
+			first++;
+		}
+		last = first;
+		while ((last + 1 < DIRTY_COLS) &&
+		       (dirty[row] & (1 << (last + 1)))) {
+			last++;
+		}
+		mask = ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
+
+		end = row + 1;
+		while ((end < DIRTY_ROWS) && ((dirty[end] & mask) == mask)) {
+			end++;
+		}
+		lcd_write_rect(first * DIRTY_TILE, row * DIRTY_TILE,
+			       (last - first + 1) * DIRTY_TILE,
+			       (end - row) * DIRTY_TILE);
+		while (end-- > row) {
+			dirty[end] &= ~mask;
+		}
+	}
+}
+
+/*
+ * uint32_t lcd_flush_bytes(void)
+ *
+ * How many bytes the last lcd_show_frame() sent to the display. A full
+ * frame is FRAME_SIZE_BYTES plus a few bytes of commands.
+ */
+uint32_t lcd_flush_bytes(void)
+{
+	return flush_bytes;
 }
 
 /*
@@ -307,6 +468,7 @@ void lcd_show_frame(void)
 void
 lcd_init(void)
 {
+	int i;
 
 	/*
 	 * Set up the GPIO lines for the SPI port and
@@ -323,6 +485,12 @@ lcd_init(void)
 	cur_frame = (uint16_t *)(SDRAM_BASE_ADDRESS);
 	display_frame = cur_frame + (LCD_WIDTH * LCD_HEIGHT);
 
+	/* Neither the SDRAM nor the display hold anything useful yet */
+	for (i = 0; i < DIRTY_ROWS; i++) {
+		dirty[i] = (1 << DIRTY_COLS) - 1;
+	}
+	flush_all = 1;
+
 	rcc_periph_clock_enable(RCC_SPI5);
 	spi_init_master(LCD_SPI, SPI_CR1_BAUDRATE_FPCLK_DIV_4,
 					SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE,
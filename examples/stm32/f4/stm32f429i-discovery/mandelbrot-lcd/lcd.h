@@ -30,6 +30,8 @@
 void lcd_init(void);
 void lcd_show_frame(void);
 void lcd_draw_pixel(int x, int y, uint16_t color);
+void lcd_draw_tile(int x, int y, int w, int h, const uint16_t *pixels);
+uint32_t lcd_flush_bytes(void);
 
 /* Color definitions */
 #define	LCD_BLACK   0x0000
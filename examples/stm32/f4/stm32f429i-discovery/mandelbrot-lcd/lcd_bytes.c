@@ -0,0 +1,275 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host test of what lcd_show_frame() sends, built by
+ * 'make HOST=1 BINARY=lcd_bytes'.
+ *
+ * The Makefile wraps spi_xfer(), gpio_set(), gpio_clear() and msleep()
+ * at link time, and every byte lcd.c sends is played into a model of
+ * the ILI9341: its column and page address window and its graphics
+ * RAM. After every flush the GRAM has to match the displayed frame, the
+ * frame being built has to start out as a copy of it, and the bytes on
+ * the wire have to be what lcd_flush_bytes() says. A few typical update
+ * patterns are run, and their bytes per frame set against a full frame.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <libopencm3/stm32/gpio.h>
+#include "lcd.h"
+#include "fractal.h"
+
+#define FRAME_SIZE_BYTES	(LCD_WIDTH * LCD_HEIGHT * 2)
+#define FULL_FRAME		(FRAME_SIZE_BYTES + 11)
+
+uint16_t __real_spi_xfer(uint32_t spi, uint16_t data);
+void __real_gpio_set(uint32_t gpioport, uint16_t gpios);
+void __real_gpio_clear(uint32_t gpioport, uint16_t gpios);
+
+extern uint16_t *cur_frame;
+extern uint16_t *display_frame;
+
+/* The display controller */
+static uint8_t gram[LCD_HEIGHT][LCD_WIDTH * 2];
+static int cs = 1, dcx;
+static uint8_t cmd, param[4];
+static uint32_t n_param;
+static uint16_t col_start, col_end = LCD_WIDTH - 1;
+static uint16_t page_start, page_end = LCD_HEIGHT - 1;
+static uint16_t col, page;
+
+static uint32_t wire, frames, bytes;
+static int errors;
+
+static void lcd_byte(uint8_t b)
+{
+	uint16_t start, end;
+
+	if (cs) {
+		printf("byte 0x%02x sent without chip select\n", b);
+		errors++;
+		return;
+	}
+	wire++;
+	if (!dcx) {
+		cmd = b;
+		n_param = 0;
+		col = col_start;
+		page = page_start;
+		return;
+	}
+
+	switch (cmd) {
+	case 0x2A:
+	case 0x2B:
+		if (n_param < 4) {
+			param[n_param] = b;
+		}
+		if (++n_param != 4) {
+			break;
+		}
+		start = param[0] << 8 | param[1];
+		end = param[2] << 8 | param[3];
+		if (cmd == 0x2A) {
+			col_start = start;
+			col_end = end;
+		} else {
+			page_start = start;
+			page_end = end;
+		}
+		break;
+	case 0x2C:
+		if (page > page_end || page >= LCD_HEIGHT ||
+		    col >= LCD_WIDTH) {
+			printf("pixel data past the end of the window\n");
+			errors++;
+			break;
+		}
+		gram[page][col * 2 + (n_param & 1)] = b;
+		if ((++n_param & 1) == 0 && ++col > col_end) {
+			col = col_start;
+			page++;
+		}
+		break;
+	}
+}
+
+uint16_t __wrap_spi_xfer(uint32_t spi, uint16_t data)
+{
+	lcd_byte(data);
+	return __real_spi_xfer(spi, data);
+}
+
+static void pins(uint32_t gpioport, uint16_t gpios, int level)
+{
+	if (gpioport == GPIOC && (gpios & GPIO2)) {
+		cs = level;
+	}
+	if (gpioport == GPIOD && (gpios & GPIO13)) {
+		dcx = level;
+	}
+}
+
+void __wrap_gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	pins(gpioport, gpios, 1);
+	__real_gpio_set(gpioport, gpios);
+}
+
+void __wrap_gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	pins(gpioport, gpios, 0);
+	__real_gpio_clear(gpioport, gpios);
+}
+
+void __wrap_msleep(uint32_t delay)
+{
+	(void)delay;
+}
+
+static void check(uint32_t sent)
+{
+	uint32_t i;
+	const uint8_t *frame = (const uint8_t *)display_frame;
+
+	if (sent != lcd_flush_bytes()) {
+		printf("frame %u: %u bytes sent, lcd_flush_bytes() says %u\n",
+		       frames, sent, lcd_flush_bytes());
+		errors++;
+	}
+	for (i = 0; i < FRAME_SIZE_BYTES; i++) {
+		if (gram[i / (LCD_WIDTH * 2)][i % (LCD_WIDTH * 2)] !=
+		    frame[i]) {
+			printf("frame %u: pixel %u, %u not on the display\n",
+			       frames, i / 2 % LCD_WIDTH, i / 2 / LCD_WIDTH);
+			errors++;
+			break;
+		}
+	}
+	if (memcmp(cur_frame, display_frame, FRAME_SIZE_BYTES) != 0) {
+		printf("frame %u: the next frame does not start from the "
+		       "displayed one\n", frames);
+		errors++;
+	}
+}
+
+static void show(void)
+{
+	uint32_t before = wire;
+
+	lcd_show_frame();
+	check(wire - before);
+	frames++;
+	bytes += wire - before;
+}
+
+/* The bytes per frame have to come out between min and max */
+static void report(const char *name, uint32_t min, uint32_t max)
+{
+	uint32_t avg = bytes / frames;
+
+	printf("%-10s %7u %10u %10u %8.1f%%\n", name, frames, bytes, avg,
+	       100.0 * bytes / ((double)frames * FULL_FRAME));
+	if (avg < min || avg > max) {
+		printf("expected %u to %u bytes per frame\n", min, max);
+		errors++;
+	}
+	frames = 0;
+	bytes = 0;
+}
+
+static uint16_t colors[FRACTAL_MAX_ITER + 1];
+
+/* The animation of mandel.c: zoom in, one step per frame */
+static void zoom(int n)
+{
+	float scale = 0.25f, x = -0.5f, y = 0.0f;
+
+	while (n--) {
+		fractal_render(fractal_pick_kernel(scale), x, y, scale,
+			       colors);
+		show();
+		x += 0.1815f * scale;
+		y += 0.505f * scale;
+		scale *= 0.875f;
+	}
+}
+
+/* A status box in the corner over a still picture, new every frame */
+static void status(void)
+{
+	uint16_t box[48 * 12];
+	int i, j;
+
+	for (i = 0; i < 200; i++) {
+		for (j = 0; j < 48 * 12; j++) {
+			box[j] = (j % 48 < (i % 48)) ? LCD_WHITE : LCD_BLACK;
+		}
+		lcd_draw_tile(LCD_WIDTH - 48, LCD_HEIGHT - 12, 48, 12, box);
+		show();
+	}
+}
+
+static void fill(uint16_t color)
+{
+	int x, y;
+
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			lcd_draw_pixel(x, y, color);
+		}
+	}
+}
+
+int main(void)
+{
+	int i;
+
+	for (i = 0; i <= FRACTAL_MAX_ITER; i++) {
+		colors[i] = i * 0x0841;
+	}
+
+	printf("%-10s %7s %10s %10s %9s\n", "workload", "frames", "bytes",
+	       "per frame", "of full");
+
+	lcd_init();
+	check(lcd_flush_bytes());
+	bytes = lcd_flush_bytes();
+	frames = 1;
+	report("init", FULL_FRAME, FULL_FRAME);
+
+	zoom(1);
+	report("set", FULL_FRAME, FULL_FRAME);
+	zoom(1);
+	report("same", 0, 0);
+	zoom(100);
+	report("zoom", 1, FULL_FRAME);
+	status();
+	report("status", 1, FULL_FRAME / 10);
+
+	/* Every tile changes, one full width rectangle */
+	for (i = 0; i < 4; i++) {
+		fill(i & 1 ? LCD_BLUE : LCD_RED);
+		show();
+	}
+	report("full", FULL_FRAME, FULL_FRAME);
+
+	printf("%s\n", errors ? "FAILED" : "GRAM matches the frame after every "
+	       "flush");
+	return errors ? 1 : 0;
+}
@@ -30,6 +30,7 @@
 #include "clock.h"
 #include "sdram.h"
 #include "lcd.h"
+#include "fractal.h"
 
 /* utility functions */
 void uart_putc(char c);
@@ -139,9 +140,48 @@ void mandel(float cx, float cy, float scale)
 	}
 }
 
+/* Frames rendered per kernel by the start up benchmark */
+#define BENCH_FRAMES	4
+
+static void bench_report(const char *name, uint32_t ms)
+{
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("%-6s %5lu ms/frame %8lu pixels/s\n", name,
+	       (unsigned long)(ms / BENCH_FRAMES),
+	       (unsigned long)(BENCH_FRAMES * LCD_WIDTH * LCD_HEIGHT * 1000UL / ms));
+}
+
+/*
+ * Render the whole set with the original pixel at a time float code and
+ * with each of the tiled kernels, and print the rate each achieved.
+ */
+static void benchmark(void)
+{
+	float scale = 3.0f / LCD_WIDTH;
+	uint32_t start;
+	int i, k;
+
+	start = mtime();
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		mandel(-0.5f, 0.0f, scale);
+	}
+	bench_report("pixel", mtime() - start);
+
+	for (k = 0; k < FRACTAL_KERNELS; k++) {
+		start = mtime();
+		for (i = 0; i < BENCH_FRAMES; i++) {
+			fractal_render(k, -0.5f, 0.0f, scale, lcd_colors);
+		}
+		bench_report(fractal_kernel_name(k), mtime() - start);
+	}
+}
+
 int main(void)
 {
 	int gen = 0;
+	uint32_t flushed = 0;
 	float scale = 0.25f, center_x = -0.5f, center_y = 0.0f;
 
 
@@ -155,18 +195,25 @@ int main(void)
 	lcd_init();
 
 	printf("System initialized.\n");
+	benchmark();
 
 	while (1) {
 		/* Blink the LED (PG13) on the board with each fractal drawn. */
 		gpio_toggle(GPIOG, GPIO13);		/* LED on/off */
-		mandel(center_x, center_y, scale);	/* draw mandelbrot */
+		fractal_render(fractal_pick_kernel(scale),
+			       center_x, center_y, scale, lcd_colors);
 		lcd_show_frame();			/* show it */
+		flushed += lcd_flush_bytes();
 		/* Change scale and center */
 		center_x += 0.1815f * scale;
 		center_y += 0.505f * scale;
 		scale	*= 0.875f;
 		gen++;
 		if (gen > 99) {
+			/* areas that stay in (or out of) the set are not resent */
+			printf("SPI: %lu bytes/frame\n",
+			       (unsigned long)(flushed / gen));
+			flushed = 0;
 			scale = 0.25f;
 			center_x = -0.5f;
 			center_y = 0.0f;
@@ -26,6 +26,8 @@
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/msc.h>
 
+#include "clock.h"
+#include "sdram.h"
 #include "ramdisk.h"
 
 static const struct usb_device_descriptor dev_descr = {
@@ -105,7 +107,9 @@ static uint8_t usbd_control_buffer[128];
 
 int main(void)
 {
-	rcc_clock_setup_pll(&rcc_hse_8mhz_3v3[RCC_CLOCK_3V3_168MHZ]);
+	clock_setup();
+	/* the disk image lives in the SDRAM */
+	sdram_init();
 
 	rcc_periph_clock_enable(RCC_GPIOB);
 	rcc_periph_clock_enable(RCC_OTGHS);
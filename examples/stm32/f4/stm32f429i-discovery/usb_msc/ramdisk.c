@@ -18,32 +18,69 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * A block device in the 8MB SDRAM of the board.
+ *
+ * The whole volume is an image in the SDRAM, formatted as FAT16 by
+ * ramdisk_init() with a single 64kB file on it. Reads and writes are plain
+ * copies between the image and the USB buffer, whatever the sector.
+ *
+ * The libopencm3 MSC stack asks for one sector at a time, even within a
+ * multi-sector READ(10)/WRITE(10), and a 512 byte memcpy() is done before
+ * a DMA transfer would even be set up, so sectors are copied by the CPU.
+ * ramdisk_init() clears and lays out the 8MB image with DMA2, the only
+ * controller that can do memory to memory.
+ */
+
+#include <stdbool.h>
 #include <string.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include "sdram.h"
 #include "ramdisk.h"
 
 #define WBVAL(x) ((x) & 0xFF), (((x) >> 8) & 0xFF)
 #define QBVAL(x) ((x) & 0xFF), (((x) >> 8) & 0xFF), \
 		 (((x) >> 16) & 0xFF), (((x) >> 24) & 0xFF)
 
-/* filesystem size is 512kB (1024 * SECTOR_SIZE) */
-#define SECTOR_COUNT		1024
+/* filesystem size is 8MB (16384 * SECTOR_SIZE), all of the SDRAM */
+#define SECTOR_COUNT		16384
 #define SECTOR_SIZE		512
 #define BYTES_PER_SECTOR	512
-#define SECTORS_PER_CLUSTER	4
+#define SECTORS_PER_CLUSTER	2
 #define RESERVED_SECTORS	1
 #define FAT_COPIES		2
+#define SECTORS_PER_FAT		32
 #define ROOT_ENTRIES		512
 #define ROOT_ENTRY_LENGTH	32
-#define FILEDATA_START_CLUSTER	3
-#define DATA_REGION_SECTOR	(RESERVED_SECTORS + FAT_COPIES + \
+#define FILEDATA_START_CLUSTER	2
+#define FAT_START_SECTOR	RESERVED_SECTORS
+#define DIR_START_SECTOR	(RESERVED_SECTORS + FAT_COPIES * SECTORS_PER_FAT)
+#define DATA_REGION_SECTOR	(DIR_START_SECTOR + \
 			(ROOT_ENTRIES * ROOT_ENTRY_LENGTH) / BYTES_PER_SECTOR)
 #define FILEDATA_START_SECTOR	(DATA_REGION_SECTOR + \
 			(FILEDATA_START_CLUSTER - 2) * SECTORS_PER_CLUSTER)
 
 /* filesize is 64kB (128 * SECTOR_SIZE) */
 #define FILEDATA_SECTOR_COUNT	128
+#define FILEDATA_CLUSTER_COUNT	(FILEDATA_SECTOR_COUNT / SECTORS_PER_CLUSTER)
 
-uint8_t BootSector[] = {
+/*
+ * 8143 clusters of 1kB: too many for FAT12, and with 2 bytes per entry the
+ * FAT fits in SECTORS_PER_FAT.
+ */
+#define CLUSTER_COUNT		((SECTOR_COUNT - DATA_REGION_SECTOR) / \
+				 SECTORS_PER_CLUSTER)
+
+/* DMA2 stream 0 does the copies, the channel does not matter for M2M */
+#define DISK_DMA		DMA2
+#define DISK_DMA_STREAM		DMA_STREAM0
+/* NDTR is 16 bits, keep chunks a multiple of the 4 word burst */
+#define DISK_DMA_MAX_WORDS	0xfffc
+
+static uint8_t *const disk = SDRAM_BASE_ADDRESS;
+
+static const uint8_t BootSector[] = {
 	0xEB, 0x3C, 0x90,		/* code to jump to the bootstrap code */
 	'm', 'k', 'd', 'o', 's', 'f', 's', 0x00, /* OEM ID */
 	WBVAL(BYTES_PER_SECTOR),	/* bytes per sector */
@@ -53,7 +90,7 @@ uint8_t BootSector[] = {
 	WBVAL(ROOT_ENTRIES),		/* root entries (512) */
 	WBVAL(SECTOR_COUNT),		/* total number of sectors */
 	0xF8,				/* media descriptor (0xF8 = Fixed disk) */
-	0x01, 0x00,			/* sectors per FAT (1) */
+	WBVAL(SECTORS_PER_FAT),		/* sectors per FAT (32) */
 	0x20, 0x00,			/* sectors per track (32) */
 	0x40, 0x00,			/* number of heads (64) */
 	0x00, 0x00, 0x00, 0x00,		/* hidden sectors (0) */
@@ -63,35 +100,10 @@ uint8_t BootSector[] = {
 	0x29,				/* extended boot signature */
 	0x69, 0x17, 0xAD, 0x53,		/* volume serial number */
 	'R', 'A', 'M', 'D', 'I', 'S', 'K', ' ', ' ', ' ', ' ', /* volume label */
-	'F', 'A', 'T', '1', '2', ' ', ' ', ' '	/* filesystem type */
-};
-
-uint8_t FatSector[] = {
-	0xF8, 0xFF, 0xFF, 0x00, 0x40, 0x00, 0x05, 0x60, 0x00, 0x07, 0x80, 0x00,
-	0x09, 0xA0, 0x00, 0x0B, 0xC0, 0x00, 0x0D, 0xE0, 0x00, 0x0F, 0x00, 0x01,
-	0x11, 0x20, 0x01, 0x13, 0x40, 0x01, 0x15, 0x60, 0x01, 0x17, 0x80, 0x01,
-	0x19, 0xA0, 0x01, 0x1B, 0xC0, 0x01, 0x1D, 0xE0, 0x01, 0x1F, 0x00, 0x02,
-	0x21, 0x20, 0x02, 0x23, 0x40, 0x02, 0x25, 0x60, 0x02, 0x27, 0x80, 0x02,
-	0x29, 0xA0, 0x02, 0x2B, 0xC0, 0x02, 0x2D, 0xE0, 0x02, 0x2F, 0x00, 0x03,
-	0x31, 0x20, 0x03, 0x33, 0x40, 0x03, 0x35, 0x60, 0x03, 0x37, 0x80, 0x03,
-	0x39, 0xA0, 0x03, 0x3B, 0xC0, 0x03, 0x3D, 0xE0, 0x03, 0x3F, 0x00, 0x04,
-	0x41, 0x20, 0x04, 0x43, 0x40, 0x04, 0x45, 0x60, 0x04, 0x47, 0x80, 0x04,
-	0x49, 0xA0, 0x04, 0x4B, 0xC0, 0x04, 0x4D, 0xE0, 0x04, 0x4F, 0x00, 0x05,
-	0x51, 0x20, 0x05, 0x53, 0x40, 0x05, 0x55, 0x60, 0x05, 0x57, 0x80, 0x05,
-	0x59, 0xA0, 0x05, 0x5B, 0xC0, 0x05, 0x5D, 0xE0, 0x05, 0x5F, 0x00, 0x06,
-	0x61, 0x20, 0x06, 0x63, 0x40, 0x06, 0x65, 0x60, 0x06, 0x67, 0x80, 0x06,
-	0x69, 0xA0, 0x06, 0x6B, 0xC0, 0x06, 0x6D, 0xE0, 0x06, 0x6F, 0x00, 0x07,
-	0x71, 0x20, 0x07, 0x73, 0x40, 0x07, 0x75, 0x60, 0x07, 0x77, 0x80, 0x07,
-	0x79, 0xA0, 0x07, 0x7B, 0xC0, 0x07, 0x7D, 0xE0, 0x07, 0x7F, 0x00, 0x08,
-	0x81, 0x20, 0x08, 0xFF, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00
+	'F', 'A', 'T', '1', '6', ' ', ' ', ' '	/* filesystem type */
 };
 
-uint8_t DirSector[] = {
+static uint8_t DirSector[] = {
 	/* long filename entry */
 	0x41,						/* sequence number */
 	WBVAL('r'), WBVAL('a'), WBVAL('m'), WBVAL('d'), WBVAL('i'), /* five name characters in UTF-16 */
@@ -117,64 +129,159 @@ uint8_t DirSector[] = {
 	QBVAL(FILEDATA_SECTOR_COUNT * SECTOR_SIZE)	/* file size in bytes */
 };
 
-static uint8_t ramdata[FILEDATA_SECTOR_COUNT * SECTOR_SIZE];
+/*
+ * Copy len bytes (a multiple of 4) with DMA2, or fill them with the word at
+ * src if fill is set. Returns 0 once the data is there, or -1 after a
+ * transfer error, with the data only partly copied.
+ */
+static int disk_dma(void *dst, const void *src, uint32_t len, bool fill)
+{
+	uint32_t d = (uint32_t)dst;
+	uint32_t s = (uint32_t)src;
+	uint32_t words;
+	bool error;
+
+	/* The USB buffer has no alignment guarantee, words are a must */
+	if ((d | s) & 3) {
+		memcpy(dst, src, len);
+		return 0;
+	}
+
+	while (len) {
+		words = len / 4;
+		if (words > DISK_DMA_MAX_WORDS) {
+			words = DISK_DMA_MAX_WORDS;
+		}
+
+		dma_stream_reset(DISK_DMA, DISK_DMA_STREAM);
+		dma_set_transfer_mode(DISK_DMA, DISK_DMA_STREAM,
+				      DMA_SxCR_DIR_MEM_TO_MEM);
+		/* in memory to memory mode the "peripheral" is the source */
+		dma_set_peripheral_address(DISK_DMA, DISK_DMA_STREAM, s);
+		dma_set_memory_address(DISK_DMA, DISK_DMA_STREAM, d);
+		dma_set_number_of_data(DISK_DMA, DISK_DMA_STREAM, words);
+		dma_set_peripheral_size(DISK_DMA, DISK_DMA_STREAM,
+					DMA_SxCR_PSIZE_32BIT);
+		dma_set_memory_size(DISK_DMA, DISK_DMA_STREAM,
+				    DMA_SxCR_MSIZE_32BIT);
+		dma_enable_memory_increment_mode(DISK_DMA, DISK_DMA_STREAM);
+		if (!fill) {
+			dma_enable_peripheral_increment_mode(DISK_DMA,
+							     DISK_DMA_STREAM);
+		}
+		/*
+		 * M2M needs the FIFO. Bursts of 4 words must not cross a 1kB
+		 * boundary, which they cannot when both sides are 16 byte
+		 * aligned; sectors in the image always are.
+		 */
+		dma_enable_fifo_mode(DISK_DMA, DISK_DMA_STREAM);
+		dma_set_fifo_threshold(DISK_DMA, DISK_DMA_STREAM,
+				       DMA_SxFCR_FTH_4_4_FULL);
+		if (((d | s) & 15) == 0) {
+			dma_set_memory_burst(DISK_DMA, DISK_DMA_STREAM,
+					     DMA_SxCR_MBURST_INCR4);
+			if (!fill) {
+				dma_set_peripheral_burst(DISK_DMA,
+							 DISK_DMA_STREAM,
+							 DMA_SxCR_PBURST_INCR4);
+			}
+		}
+		dma_enable_stream(DISK_DMA, DISK_DMA_STREAM);
+
+		while (!dma_get_interrupt_flag(DISK_DMA, DISK_DMA_STREAM,
+					       DMA_TCIF | DMA_TEIF));
+		/* the stream is disabled by then, either way */
+		error = dma_get_interrupt_flag(DISK_DMA, DISK_DMA_STREAM,
+					       DMA_TEIF);
+		dma_clear_interrupt_flags(DISK_DMA, DISK_DMA_STREAM,
+					  DMA_TCIF | DMA_HTIF | DMA_TEIF |
+					  DMA_DMEIF | DMA_FEIF);
+		if (error) {
+			return -1;
+		}
+
+		len -= words * 4;
+		d += words * 4;
+		if (!fill) {
+			s += words * 4;
+		}
+	}
+	return 0;
+}
+
+static void fat_set(uint32_t cluster, uint16_t next)
+{
+	uint8_t *fat = disk + FAT_START_SECTOR * SECTOR_SIZE;
+
+	fat[cluster * 2] = next & 0xFF;
+	fat[cluster * 2 + 1] = next >> 8;
+}
 
 int ramdisk_init(void)
 {
+	static const uint32_t zero;
 	uint32_t i = 0;
 
+	rcc_periph_clock_enable(RCC_DMA2);
+
+	/* start from an empty disk */
+	if (disk_dma(disk, &zero, SECTOR_COUNT * SECTOR_SIZE, true) < 0) {
+		return -1;
+	}
+
+	memcpy(disk, BootSector, sizeof(BootSector));
+	disk[SECTOR_SIZE - 2] = 0x55;
+	disk[SECTOR_SIZE - 1] = 0xAA;
+
+	/* media descriptor, end of chain marker, then the file's chain */
+	fat_set(0, 0xFFF8);
+	fat_set(1, 0xFFFF);
+	for (i = 0; i < FILEDATA_CLUSTER_COUNT; i++) {
+		fat_set(FILEDATA_START_CLUSTER + i,
+			i == FILEDATA_CLUSTER_COUNT - 1 ?
+			0xFFFF : FILEDATA_START_CLUSTER + i + 1);
+	}
+	for (i = 1; i < FAT_COPIES; i++) {
+		if (disk_dma(disk + (FAT_START_SECTOR + i * SECTORS_PER_FAT) *
+			     SECTOR_SIZE, disk + FAT_START_SECTOR * SECTOR_SIZE,
+			     SECTORS_PER_FAT * SECTOR_SIZE, false) < 0) {
+			return -1;
+		}
+	}
+
 	/* compute checksum in the directory entry */
 	uint8_t chk = 0;
 	for (i = 32; i < 43; i++) {
 		chk = (((chk & 1) << 7) | ((chk & 0xFE) >> 1)) + DirSector[i];
 	}
 	DirSector[13] = chk;
+	memcpy(disk + DIR_START_SECTOR * SECTOR_SIZE, DirSector,
+	       sizeof(DirSector));
 
-	/* fill ramdata */
+	/* fill the file */
 	const uint8_t text[] = "USB Mass Storage Class example. ";
-	i = 0;
-	while (i < sizeof(ramdata)) {
-		ramdata[i] = text[i % (sizeof(text) - 1)];
-		i++;
+	uint8_t *data = disk + FILEDATA_START_SECTOR * SECTOR_SIZE;
+	for (i = 0; i < FILEDATA_SECTOR_COUNT * SECTOR_SIZE; i++) {
+		data[i] = text[i % (sizeof(text) - 1)];
 	}
 	return 0;
 }
 
 int ramdisk_read(uint32_t lba, uint8_t *copy_to)
 {
-	memset(copy_to, 0, SECTOR_SIZE);
-	switch (lba) {
-	case 0: /* sector 0 is the boot sector */
-		memcpy(copy_to, BootSector, sizeof(BootSector));
-		copy_to[SECTOR_SIZE - 2] = 0x55;
-		copy_to[SECTOR_SIZE - 1] = 0xAA;
-		break;
-	case 1: /* sector 1 is FAT 1st copy */
-	case 2: /* sector 2 is FAT 2nd copy */
-		memcpy(copy_to, FatSector, sizeof(FatSector));
-		break;
-	case 3: /* sector 3 is the directory entry */
-		memcpy(copy_to, DirSector, sizeof(DirSector));
-		break;
-	default:
-		/* ignore reads outside of the data section */
-		if (lba >= FILEDATA_START_SECTOR &&
-		    lba < FILEDATA_START_SECTOR + FILEDATA_SECTOR_COUNT) {
-			memcpy(copy_to, ramdata +
-					(lba - FILEDATA_START_SECTOR) *
-					SECTOR_SIZE,
-			       SECTOR_SIZE);
-		}
-		break;
+	if (lba >= SECTOR_COUNT) {
+		return -1;
 	}
+	memcpy(copy_to, disk + lba * SECTOR_SIZE, SECTOR_SIZE);
 	return 0;
 }
 
 int ramdisk_write(uint32_t lba, const uint8_t *copy_from)
 {
-	(void)lba;
-	(void)copy_from;
-	/* ignore writes */
+	if (lba >= SECTOR_COUNT) {
+		return -1;
+	}
+	memcpy(disk + lba * SECTOR_SIZE, copy_from, SECTOR_SIZE);
 	return 0;
 }
 
@@ -0,0 +1,196 @@
+#! /usr/bin/env python
+#
+# This file is part of the libopencm3 project.
+#
+# This library is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this library.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Throughput and latency benchmark for the usb_bulk_dev example.
+#
+#   bench.py source   [seconds]   device -> host on EP2
+#   bench.py sink     [seconds]   host -> device on EP1
+#   bench.py loopback [seconds]   one packet out, wait for it to come back
+#
+# Needs pyusb. Throughput is reported both as seen by the host and as
+# timestamped by the device, latency (loopback only) as percentiles of
+# the round trip time of single 64 byte packets.
+
+from __future__ import print_function, division
+
+import struct
+import sys
+import time
+
+import usb.core
+
+VID = 0xc03e
+PID = 0xb007
+
+EP_OUT = 0x01
+EP_IN = 0x82
+
+MODES = {'sink': 1, 'source': 2, 'loopback': 4}
+
+REQ_SET_MODE = 1
+REQ_GET_STATS = 2
+
+# struct bench_stats in usb_bulk_dev.c
+STATS_FMT = '<IIIIQQQQI'
+STATS_LEN = struct.calcsize(STATS_FMT)
+
+CHUNK = 64 * 64
+
+try:
+	now = time.perf_counter
+except AttributeError:
+	now = time.time
+
+
+def set_mode(dev, mode):
+	dev.ctrl_transfer(0x40, REQ_SET_MODE, MODES[mode], 0)
+
+
+def get_stats(dev):
+	data = dev.ctrl_transfer(0xc0, REQ_GET_STATS, 0, 0, STATS_LEN)
+	keys = ('mode', 'tick_hz', 'rx_packets', 'tx_packets', 'rx_bytes',
+		'tx_bytes', 'first_tick', 'last_tick', 'clock_changes')
+	return dict(zip(keys, struct.unpack(STATS_FMT, bytes(bytearray(data)))))
+
+
+def flush(dev):
+	# Whatever the previous mode left in the IN FIFO
+	try:
+		while True:
+			dev.read(EP_IN, CHUNK, 50)
+	except usb.core.USBError:
+		pass
+
+
+def mbps(nbytes, seconds):
+	if seconds <= 0:
+		return 0.0
+	return nbytes / seconds / 1e6
+
+
+def percentile(sorted_values, p):
+	i = int(round(p / 100.0 * (len(sorted_values) - 1)))
+	return sorted_values[i]
+
+
+def run_source(dev, seconds):
+	total = 0
+	lost = 0
+	expect = 0
+	end = now() + seconds
+	start = now()
+	while now() < end:
+		data = dev.read(EP_IN, CHUNK, 1000)
+		for off in range(0, len(data) - 63, 64):
+			seq = struct.unpack_from('<I', bytes(bytearray(data[off:off + 4])))[0]
+			if seq != expect:
+				lost += (seq - expect) & 0xffffffff
+			expect = (seq + 1) & 0xffffffff
+		total += len(data)
+	elapsed = now() - start
+	print('host:   %d bytes in %.3f s, %.3f MB/s, %d packets missing' %
+	      (total, elapsed, mbps(total, elapsed), lost))
+	return elapsed
+
+
+def run_sink(dev, seconds):
+	total = 0
+	buf = bytearray(CHUNK)
+	end = now() + seconds
+	start = now()
+	while now() < end:
+		total += dev.write(EP_OUT, buf, 1000)
+	elapsed = now() - start
+	print('host:   %d bytes in %.3f s, %.3f MB/s' %
+	      (total, elapsed, mbps(total, elapsed)))
+	return elapsed
+
+
+def run_loopback(dev, seconds):
+	rtt = []
+	errors = 0
+	n = 0
+	end = now() + seconds
+	start = now()
+	while now() < end:
+		out = bytearray(struct.pack('<I', n) * 16)
+		t = now()
+		dev.write(EP_OUT, out, 1000)
+		back = dev.read(EP_IN, 64, 1000)
+		rtt.append(now() - t)
+		if bytearray(back) != out:
+			errors += 1
+		n += 1
+	elapsed = now() - start
+	rtt.sort()
+	print('host:   %d round trips in %.3f s, %d mismatched' %
+	      (n, elapsed, errors))
+	if rtt:
+		print('        latency us: min %.0f  p50 %.0f  p90 %.0f  '
+		      'p99 %.0f  p99.9 %.0f  max %.0f' %
+		      tuple(1e6 * v for v in (rtt[0], percentile(rtt, 50),
+					      percentile(rtt, 90),
+					      percentile(rtt, 99),
+					      percentile(rtt, 99.9), rtt[-1])))
+	return elapsed
+
+
+def report_device(stats, before):
+	ticks = stats['last_tick'] - stats['first_tick']
+	seconds = ticks / stats['tick_hz'] if stats['tick_hz'] else 0
+	print('device: rx %d packets %d bytes, tx %d packets %d bytes' %
+	      (stats['rx_packets'], stats['rx_bytes'],
+	       stats['tx_packets'], stats['tx_bytes']))
+	print('        %.3f s between first and last packet, '
+	      'rx %.3f MB/s, tx %.3f MB/s' %
+	      (seconds, mbps(stats['rx_bytes'], seconds),
+	       mbps(stats['tx_bytes'], seconds)))
+	if stats['clock_changes'] != before:
+		print('        warning: the system clock changed during the run,'
+		      ' device timings are meaningless')
+
+
+def main():
+	if len(sys.argv) < 2 or sys.argv[1] not in MODES:
+		print('usage: %s source|sink|loopback [seconds]' % sys.argv[0])
+		sys.exit(1)
+	mode = sys.argv[1]
+	seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 5.0
+
+	dev = usb.core.find(idVendor=VID, idProduct=PID)
+	if dev is None:
+		raise ValueError('Device not found')
+	dev.set_configuration()
+
+	# Stop the source first so the flush terminates, then start for real
+	set_mode(dev, 'sink')
+	flush(dev)
+	set_mode(dev, mode)
+	before = get_stats(dev)['clock_changes']
+
+	{'source': run_source, 'sink': run_sink,
+	 'loopback': run_loopback}[mode](dev, seconds)
+	report_device(get_stats(dev), before)
+
+	# Back to something quiet, and leave the IN FIFO empty
+	set_mode(dev, 'sink')
+	flush(dev)
+
+
+if __name__ == '__main__':
+	main()
@@ -21,15 +21,18 @@
  * \addtogroup Examples
  *
  * Establishes a basic USB devices with interrupt-driven and polled IN and OUT
- * bulk endpoints.
+ * bulk endpoints. The interrupt-driven pair doubles as a throughput benchmark,
+ * see bench.py.
  */
 #include <libopencm3/lm4f/rcc.h>
 #include <libopencm3/lm4f/gpio.h>
 #include <libopencm3/lm4f/nvic.h>
+#include <libopencm3/cm3/systick.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/lm4f/usb.h>
 
 #include<stdio.h>
+#include<string.h>
 
 int _write(int file, char *ptr, int len);
 void uart_setup(void);
@@ -77,6 +80,11 @@ static size_t ipll = 0;
 /* Are we bypassing the PLL, or not? */
 static bool bypass = false;
 
+static uint32_t sysclk_hz(void)
+{
+	return bypass ? 16000000 : 400000000 / plldiv[ipll];
+}
+
 /* =============================================================================
  * = USB descriptors
  * ---------------------------------------------------------------------------*/
@@ -187,6 +195,187 @@ static const char *usb_strings[] = {
 	"DEMO",
 };
 
+/* =============================================================================
+ * = Benchmark module
+ * ---------------------------------------------------------------------------*/
+
+/*
+ * EP1 OUT and EP2 IN run one of these modes, picked by the host with a vendor
+ * request. The default is what this example always did: drain EP1 and keep
+ * EP2 full, both at once.
+ */
+enum bench_mode {
+	BENCH_SINK		= 1,	/* EP1 packets are counted and dropped */
+	BENCH_SOURCE		= 2,	/* EP2 always has a packet ready */
+	BENCH_SOURCE_SINK	= 3,	/* both of the above */
+	BENCH_LOOPBACK		= 4,	/* EP1 packets are sent back on EP2 */
+};
+
+/* Vendor requests, to the device */
+enum {
+	BENCH_REQ_SET_MODE	= 1,	/* wValue = mode, also clears the stats */
+	BENCH_REQ_GET_STATS	= 2,	/* IN, returns struct bench_stats */
+};
+
+/*
+ * Timestamps are in system clock ticks since reset: SysTick counts the low 24
+ * bits, its interrupt the rest. Events are timestamped when the USB controller
+ * reports them, so first_tick/last_tick bracket the data that actually moved.
+ *
+ * The tick rate is the system clock, which the buttons change; clock_changes
+ * lets the host throw away runs during which that happened. Both are filled
+ * in when the stats are read, not kept in the running stats.
+ */
+struct bench_stats {
+	uint32_t mode;
+	uint32_t tick_hz;
+	uint32_t rx_packets;
+	uint32_t tx_packets;
+	uint64_t rx_bytes;
+	uint64_t tx_bytes;
+	uint64_t first_tick;
+	uint64_t last_tick;
+	uint32_t clock_changes;
+} __attribute__((packed));
+
+static volatile uint32_t tick_wraps;
+static volatile uint32_t clock_changes;
+
+static enum bench_mode bench_mode = BENCH_SOURCE_SINK;
+static struct bench_stats stats;
+static struct bench_stats stats_reply;
+
+/* A packet is sitting in the EP2 FIFO, waiting for the host to read it */
+static bool tx_busy;
+static uint16_t tx_len;
+/* Loopback: EP1 has a packet we could not send back yet, left in its FIFO */
+static bool rx_waiting;
+/* Source: numbers the packets, so the host can tell when one went missing */
+static uint32_t tx_seq;
+
+static void bench_timer_setup(void)
+{
+	systick_set_clocksource(STK_CSR_CLKSOURCE_AHB);
+	systick_set_reload(0x00ffffff);
+	systick_interrupt_enable();
+	systick_counter_enable();
+	/*
+	 * SysTick must be able to preempt the USB interrupt, or a wrap that
+	 * happens while we are timestamping in there would be missed.
+	 */
+	nvic_set_priority(NVIC_SYSTICK_IRQ, 0);
+}
+
+static uint64_t bench_now(void)
+{
+	uint32_t hi, lo;
+
+	do {
+		hi = tick_wraps;
+		lo = systick_get_value();
+	} while (hi != tick_wraps);
+
+	return ((uint64_t)hi << 24) | (0x00ffffff - lo);
+}
+
+static void bench_count(bool tx, uint16_t len)
+{
+	uint64_t now = bench_now();
+
+	if (stats.rx_packets == 0 && stats.tx_packets == 0)
+		stats.first_tick = now;
+	stats.last_tick = now;
+	if (tx) {
+		stats.tx_packets++;
+		stats.tx_bytes += len;
+	} else {
+		stats.rx_packets++;
+		stats.rx_bytes += len;
+	}
+}
+
+static void bench_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	stats.mode = bench_mode;
+	tx_seq = 0;
+}
+
+/* Queue the next source packet: sequence number, timestamp, filler */
+static void bench_source_next(usbd_device *usbd_dev)
+{
+	uint32_t buf[16];
+	uint32_t i;
+
+	buf[0] = tx_seq++;
+	buf[1] = (uint32_t)bench_now();
+	for (i = 2; i < 16; i++)
+		buf[i] = 0x55aa55aa;
+	usbd_ep_write_packet(usbd_dev, 0x82, buf, 64);
+	tx_len = 64;
+	tx_busy = true;
+}
+
+/* Send the packet waiting in EP1 back out on EP2, which must be free */
+static void bench_loop_next(usbd_device *usbd_dev)
+{
+	uint8_t buf[64] __attribute__ ((aligned(4)));
+	uint16_t len;
+
+	len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+	rx_waiting = false;
+	bench_count(false, len);
+	usbd_ep_write_packet(usbd_dev, 0x82, buf, len);
+	tx_len = len;
+	tx_busy = true;
+}
+
+static void bench_set_mode(usbd_device *usbd_dev, enum bench_mode mode)
+{
+	uint8_t buf[64] __attribute__ ((aligned(4)));
+
+	bench_mode = mode;
+	bench_reset();
+
+	if (rx_waiting) {
+		if (mode == BENCH_LOOPBACK) {
+			if (!tx_busy)
+				bench_loop_next(usbd_dev);
+		} else {
+			usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+			rx_waiting = false;
+		}
+	}
+	if ((mode & BENCH_SOURCE) && mode != BENCH_LOOPBACK && !tx_busy)
+		bench_source_next(usbd_dev);
+}
+
+static enum usbd_request_return_codes bench_control_request(
+	usbd_device *usbd_dev, struct usb_setup_data *req, uint8_t **buf,
+	uint16_t *len,
+	void (**complete)(usbd_device *usbd_dev, struct usb_setup_data *req))
+{
+	(void)complete;
+
+	switch (req->bRequest) {
+	case BENCH_REQ_SET_MODE:
+		if (req->wValue < BENCH_SINK || req->wValue > BENCH_LOOPBACK)
+			return USBD_REQ_NOTSUPP;
+		bench_set_mode(usbd_dev, (enum bench_mode)req->wValue);
+		return USBD_REQ_HANDLED;
+	case BENCH_REQ_GET_STATS:
+		/* The reply is sent after we return, keep a stable copy */
+		stats_reply = stats;
+		stats_reply.tick_hz = sysclk_hz();
+		stats_reply.clock_changes = clock_changes;
+		*buf = (uint8_t *)&stats_reply;
+		if (*len > sizeof(stats_reply))
+			*len = sizeof(stats_reply);
+		return USBD_REQ_HANDLED;
+	}
+	return USBD_REQ_NOTSUPP;
+}
+
 /* =============================================================================
  * = USB Module
  * ---------------------------------------------------------------------------*/
@@ -215,6 +404,8 @@ static void usb_ints_setup(void)
 	usbints = USB_INT_RESET | USB_INT_DISCON | USB_INT_RESUME |
 	    USB_INT_SUSPEND | USB_INT_SOF;
 	usb_enable_interrupts(usbints, 0xff, 0xff);
+	/* Below SysTick, so benchmark timestamps stay correct */
+	nvic_set_priority(NVIC_USB0_IRQ, 0x20);
 	nvic_enable_irq(NVIC_USB0_IRQ);
 }
 
@@ -226,11 +417,26 @@ static void usb_ints_setup(void)
 static void bulk_rx_cb(usbd_device * usbd_dev, uint8_t ep)
 {
 	char buf[64] __attribute__ ((aligned(4)));
+	uint16_t len;
 
 	(void)ep;
 
+	if (bench_mode == BENCH_LOOPBACK) {
+		/*
+		 * If EP2 is still busy, leave the packet in the FIFO. The
+		 * hardware NAKs further OUT packets until we read it, which is
+		 * all the flow control we need.
+		 */
+		rx_waiting = true;
+		if (!tx_busy)
+			bench_loop_next(usbd_dev);
+		return;
+	}
+
 	/* Read the packet to clear the FIFO and make room for a new packet */
-	usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+	len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
+	if (bench_mode & BENCH_SINK)
+		bench_count(false, len);
 }
 
 /*
@@ -240,12 +446,18 @@ static void bulk_rx_cb(usbd_device * usbd_dev, uint8_t ep)
  */
 static void bulk_tx_cb(usbd_device * usbd_dev, uint8_t ep)
 {
-	char buf[64] __attribute__ ((aligned(4)));
-
 	(void)ep;
 
-	/* Keep sending packets */
-	usbd_ep_write_packet(usbd_dev, 0x82, buf, 64);
+	tx_busy = false;
+	bench_count(true, tx_len);
+
+	if (bench_mode == BENCH_LOOPBACK) {
+		if (rx_waiting)
+			bench_loop_next(usbd_dev);
+	} else if (bench_mode & BENCH_SOURCE) {
+		/* Keep sending packets */
+		bench_source_next(usbd_dev);
+	}
 }
 
 /*
@@ -255,8 +467,6 @@ static void bulk_tx_cb(usbd_device * usbd_dev, uint8_t ep)
  */
 static void set_config(usbd_device * usbd_dev, uint16_t wValue)
 {
-	uint8_t data[64] __attribute__ ((aligned(4)));
-
 	(void)wValue;
 	printf("Configuring endpoints.\n\r");
 	usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, 64, bulk_rx_cb);
@@ -266,6 +476,13 @@ static void set_config(usbd_device * usbd_dev, uint16_t wValue)
 	usbd_ep_setup(usbd_dev, 0x05, USB_ENDPOINT_ATTR_BULK, 64, NULL);
 	usbd_ep_setup(usbd_dev, 0x86, USB_ENDPOINT_ATTR_BULK, 64, NULL);
 
+	usbd_register_control_callback(usbd_dev,
+				       USB_REQ_TYPE_VENDOR |
+				       USB_REQ_TYPE_DEVICE,
+				       USB_REQ_TYPE_TYPE |
+				       USB_REQ_TYPE_RECIPIENT,
+				       bench_control_request);
+
 	/* The main loop will not touch the EPs until this is set */
 	config_set = 1;
 
@@ -274,7 +491,9 @@ static void set_config(usbd_device * usbd_dev, uint16_t wValue)
 	 * Data will stay in the FIFO until the host reads it. Once it's sent
 	 * our callback kicks in and writes another packet in the FIFO.
 	 */
-	usbd_ep_write_packet(bulk_dev, 0x82, data, 64);
+	tx_busy = false;
+	rx_waiting = false;
+	bench_set_mode(usbd_dev, bench_mode);
 	printf("Done.\n\r");
 }
 
@@ -329,6 +548,8 @@ int main(void)
 	uart_setup();
 	/* And the buttons for changing the system clock on-the-fly */
 	button_setup();
+	/* The benchmark timestamps come from SysTick */
+	bench_timer_setup();
 
 	/* Mux the GPIO pins to the USB peripheral */
 	usb_setup();
@@ -371,6 +592,15 @@ void usb0_isr(void)
 	usbd_poll(bulk_dev);
 }
 
+/* =============================================================================
+ * = SysTick interrupt service routine. Extends the timer to 64 bits.
+ * ---------------------------------------------------------------------------*/
+
+void sys_tick_handler(void)
+{
+	tick_wraps++;
+}
+
 /* =============================================================================
  * = GPIO interrupt service routine. Pressing a button gets us here.
  * ---------------------------------------------------------------------------*/
@@ -412,6 +642,10 @@ void gpiof_isr(void)
 		serviced_irqs |= USR_SW2;
 	}
 
+	/* The benchmark tick rate just changed */
+	if (serviced_irqs)
+		clock_changes++;
+
 	gpio_clear_interrupt_flag(GPIOF, serviced_irqs);
 }
 